@@ -0,0 +1,36 @@
+#version 330 core
+
+// Last light pass of the deferred path: the directional and the spot light of every pixel the
+// G-buffer covered, plus the point lights the light volumes (light_volume.frag) summed for it,
+// written over the cleared scene color.
+out vec4 FragColor;
+
+in vec2 texCoords;
+
+uniform sampler2D albedoTexture;
+uniform sampler2D normalTexture;
+uniform sampler2D depthTexture;
+uniform sampler2D pointLighting;
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+
+#include "lighting.glsl"
+#include "gbuffer.glsl"
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(depthTexture, pixel, 0).r;
+    if (depth >= 1.0) {
+        discard;
+    }
+    vec4 surface = texelFetch(albedoTexture, pixel, 0);
+    vec3 normal = decodeNormal(texelFetch(normalTexture, pixel, 0).rg);
+    vec3 fragPos = reconstructPosition(gl_FragCoord.xy, viewportSize, depth, inverseViewProjection);
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 result = calcDirLight(dirLight, normal, viewDir, surface.rgb, vec3(surface.a), dirShadow(fragPos, normal));
+    result += calcSpotLight(spotLight, normal, fragPos, viewDir, surface.rgb, vec3(surface.a));
+    result += texelFetch(pointLighting, pixel, 0).rgb;
+    FragColor = vec4(result, 1.0);
+}
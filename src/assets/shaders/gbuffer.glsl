@@ -0,0 +1,33 @@
+// Compact G-buffer of the deferred path (deferred_shading.h): target 0 (RGBA8) holds the albedo
+// and the specular intensity (the specular maps are gray), target 1 (RG16) the octahedral
+// normal. The position is rebuilt from the depth buffer.
+
+vec2 octahedronWrap(vec2 v) {
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// unit normal folded onto the octahedron and unrolled into [0, 1]^2
+vec2 encodeNormal(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = n.z >= 0.0 ? n.xy : octahedronWrap(n.xy);
+    return folded * 0.5 + 0.5;
+}
+
+vec3 decodeNormal(vec2 encoded) {
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+vec4 packSurface(vec3 albedo, vec3 specular) {
+    return vec4(albedo, max(max(specular.r, specular.g), specular.b));
+}
+
+// world position of the pixel at gl_FragCoord.xy with the given depth buffer value
+vec3 reconstructPosition(vec2 fragCoord, vec2 viewportSize, float depth, mat4 inverseViewProjection) {
+    vec4 ndc = vec4(vec3(fragCoord / viewportSize, depth) * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * ndc;
+    return world.xyz / world.w;
+}
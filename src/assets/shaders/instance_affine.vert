@@ -0,0 +1,13 @@
+#version 330 core
+#include "instance_common.glsl"
+
+// INSTANCE_AFFINE: the three top rows of the model matrix, 48 bytes
+layout (location = 3) in vec4 aInstanceRow0;
+layout (location = 4) in vec4 aInstanceRow1;
+layout (location = 5) in vec4 aInstanceRow2;
+
+void main()
+{
+    mat3 linear = transpose(mat3(aInstanceRow0.xyz, aInstanceRow1.xyz, aInstanceRow2.xyz));
+    emitInstance(linear, vec3(aInstanceRow0.w, aInstanceRow1.w, aInstanceRow2.w));
+}
@@ -0,0 +1,42 @@
+// shared by the instance_*.vert variants: each one decodes its instance attributes (locations 3-6,
+// see instance_encoding.h) into a linear part and a translation and hands them to emitInstance
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+// same interface as vertex_shader.vert, so fragment_shader.frag lights the instances too
+out VS_OUT {
+    vec3 fragPos;
+    vec3 normal;
+    vec2 TexCoords;
+
+} vs_out;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+// QuantizationRange of the batch, only read by instance_quantized.vert
+uniform vec3 instanceOrigin;
+uniform vec3 instanceExtent;
+uniform vec2 instanceScale;
+
+// unit quaternion (x, y, z, w) to rotation matrix
+mat3 quatToMat3(vec4 q)
+{
+    vec3 q2 = q.xyz * 2.0;
+    float xx = q.x * q2.x, yy = q.y * q2.y, zz = q.z * q2.z;
+    float xy = q.x * q2.y, xz = q.x * q2.z, yz = q.y * q2.z;
+    float wx = q.w * q2.x, wy = q.w * q2.y, wz = q.w * q2.z;
+    return mat3(1.0 - yy - zz, xy + wz, xz - wy,
+                xy - wz, 1.0 - xx - zz, yz + wx,
+                xz + wy, yz - wx, 1.0 - xx - yy);
+}
+
+void emitInstance(mat3 linear, vec3 translation)
+{
+    vs_out.TexCoords = aTexCoords;
+    vs_out.normal = linear * aNormal;
+    vs_out.fragPos = linear * aPos + translation;
+    gl_Position = projection * view * vec4(vs_out.fragPos, 1.0f);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+#include "instance_common.glsl"
+
+// INSTANCE_QUANTIZED: unorm16 position + scale inside the batch's QuantizationRange and an snorm16
+// quaternion, 16 bytes
+layout (location = 3) in vec4 aInstancePositionScale;
+layout (location = 4) in vec4 aInstanceRotation;
+
+void main()
+{
+    vec3 position = instanceOrigin + aInstancePositionScale.xyz * instanceExtent;
+    float scale = mix(instanceScale.x, instanceScale.y, aInstancePositionScale.w);
+    emitInstance(quatToMat3(normalize(aInstanceRotation)) * scale, position);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+#include "instance_common.glsl"
+
+// INSTANCE_QUAT: position + uniform scale and a rotation quaternion, 32 bytes
+layout (location = 3) in vec4 aInstancePositionScale;
+layout (location = 4) in vec4 aInstanceRotation;
+
+void main()
+{
+    emitInstance(quatToMat3(aInstanceRotation) * aInstancePositionScale.w, aInstancePositionScale.xyz);
+}
@@ -1,15 +1,10 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in mat4 aInstanceMatrix;
-
-out vec2 TexCoords;
+#include "instance_common.glsl"
 
-uniform mat4 projection;
-uniform mat4 view;
+// INSTANCE_MAT4: the full model matrix, 64 bytes
+layout (location = 3) in mat4 aInstanceMatrix;
 
 void main()
 {
-    TexCoords = aTexCoords;
-    gl_Position = projection * view * aInstanceMatrix * vec4(aPos, 1.0f); 
-}
\ No newline at end of file
+    emitInstance(mat3(aInstanceMatrix), aInstanceMatrix[3].xyz);
+}
@@ -0,0 +1,35 @@
+#version 330 core
+
+// One point light over the pixels its volume covers, added to the point lighting target. The
+// scene depth is read here rather than attached (it would be read and attached at once), so
+// pixels past the light's radius are dropped by distance instead of by the depth test.
+out vec4 FragColor;
+
+flat in int light;
+
+uniform sampler2D albedoTexture;
+uniform sampler2D normalTexture;
+uniform sampler2D depthTexture;
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+
+#include "lighting.glsl"
+#include "gbuffer.glsl"
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(depthTexture, pixel, 0).r;
+    if (depth >= 1.0) {
+        discard;
+    }
+    vec3 fragPos = reconstructPosition(gl_FragCoord.xy, viewportSize, depth, inverseViewProjection);
+    PointLight pointLight = fetchPointLight(light);
+    if (distance(pointLight.position, fragPos) >= pointLight.radius) {
+        discard;
+    }
+    vec4 surface = texelFetch(albedoTexture, pixel, 0);
+    vec3 normal = decodeNormal(texelFetch(normalTexture, pixel, 0).rg);
+    vec3 viewDir = normalize(viewPos - fragPos);
+    FragColor = vec4(calcPointLight(pointLight, normal, fragPos, viewDir, surface.rgb, vec3(surface.a)), 1.0);
+}
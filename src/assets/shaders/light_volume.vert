@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// one instance per visible point light
+layout (location = 1) in int lightIndex;
+
+uniform mat4 viewProjection;
+uniform samplerBuffer pointLightTexture;
+
+flat out int light;
+
+void main() {
+
+	// the unit cube around the light, scaled to its radius so it holds the whole sphere
+	vec4 center = texelFetch(pointLightTexture, lightIndex * 4);
+	float radius = texelFetch(pointLightTexture, lightIndex * 4 + 3).w;
+	gl_Position = viewProjection * vec4(center.xyz + aPos * radius, 1.0);
+	// never clipped by the far plane, so the back faces of a volume that crosses it still cover
+	// its pixels; unlike GL_DEPTH_CLAMP the near plane still cuts what is behind the camera
+	gl_Position.z = min(gl_Position.z, gl_Position.w);
+	light = lightIndex;
+
+}
@@ -0,0 +1,208 @@
+// Blinn/Phong lighting shared by the fragment shaders of the lit programs: the lights of the
+// Lights block (see light_buffer.h) and the point lights of the fragment's cluster (see
+// light_clusters.h) applied to colors the including shader already sampled.
+
+// std140: each vec3 shares its 16 bytes with the float after it (see light_buffer.h)
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+	vec3 direction;
+    float outerCutOff;
+
+    vec3 ambient;
+    float constant;
+	vec3 diffuse;
+    float linear;
+	vec3 specular;
+    float quadratic;
+
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    float radius;
+};
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    SpotLight spotLight;
+    ivec4 clusterGrid;      // clusters along x, y and z
+    vec4 clusterScale;      // clusters per pixel in x and y, scale and bias of the log depth slice
+    mat4 shadowMatrices[4]; // world to shadow map of each cascade (LightBuffer::MAX_CASCADES)
+    vec4 shadowTexelSizes;  // world size of a shadow map texel in each cascade
+    ivec4 shadowCascades;   // x: cascades in use, 0 without shadows
+};
+
+uniform samplerBuffer pointLightTexture;    // 4 texels per light, the PointLight struct in order
+uniform usamplerBuffer clusterTexture;      // per cluster: offset into lightIndexTexture, count
+uniform usamplerBuffer lightIndexTexture;
+uniform sampler2DArrayShadow shadowMap;     // one layer per cascade (shadow_maps.h)
+
+uniform vec3 viewPos;
+uniform bool blinn;
+
+float near = 0.1; 
+float far  = 100.0; 
+
+float linearizeDepth(float depth){
+
+    float z = depth * 2.0 - 1.0; //back to ndc
+    return (2.0 * near * far) / (far + near - z * (far - near));
+
+}
+
+
+float specularFactor(vec3 lightDir, vec3 normal, vec3 viewDir) {
+
+    if(blinn) {
+
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        return pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+
+    }
+
+    vec3 reflectDir = reflect(-lightDir, normal);
+    return pow(max(dot(viewDir, reflectDir), 0.0), 8.0);
+}
+
+// fraction of the directional light reaching fragPos: the first cascade holding the point,
+// four bilinear compare taps (a 3x3 texel filter), pushed out along the normal against acne
+float dirShadow(vec3 fragPos, vec3 normal) {
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    for (int i = 0; i < shadowCascades.x; i++) {
+        vec4 coord = shadowMatrices[i] * vec4(fragPos + normal * shadowTexelSizes[i] * 1.5, 1.0);
+        if (any(lessThan(coord.xy, 1.5 * texel)) || any(greaterThan(coord.xy, 1.0 - 1.5 * texel)) || coord.z > 1.0) {
+            continue;
+        }
+        float lit = texture(shadowMap, vec4(coord.xy + vec2(-0.5, -0.5) * texel, float(i), coord.z));
+        lit += texture(shadowMap, vec4(coord.xy + vec2(0.5, -0.5) * texel, float(i), coord.z));
+        lit += texture(shadowMap, vec4(coord.xy + vec2(-0.5, 0.5) * texel, float(i), coord.z));
+        lit += texture(shadowMap, vec4(coord.xy + vec2(0.5, 0.5) * texel, float(i), coord.z));
+        return lit * 0.25;
+    }
+    return 1.0;
+
+}
+
+// shadow scales the diffuse and specular terms, see dirShadow()
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shadow) {
+
+    vec3 lightDir = normalize(-light.direction);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    float spec = specularFactor(lightDir, normal, viewDir);
+
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+
+    return (ambient + shadow * (diffuse + specular));
+}
+
+vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor) {
+
+    vec3 lightDir = normalize(light.position - fragPos);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    float spec = specularFactor(lightDir, normal, viewDir);
+
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // fades to 0 at the radius the light was clustered with
+    float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
+
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+
+    return (ambient + diffuse + specular);
+}
+
+vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor) {
+
+    vec3 lightDir = normalize(light.position - fragPos);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    float spec = specularFactor(lightDir, normal, viewDir);
+
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon   = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0); 
+
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse =  light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+    ambient  *= intensity;
+    diffuse  *= intensity;
+    specular *= intensity;
+
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    
+    return (ambient + diffuse + specular);
+}
+
+PointLight fetchPointLight(int index) {
+
+    vec4 texel0 = texelFetch(pointLightTexture, index * 4);
+    vec4 texel1 = texelFetch(pointLightTexture, index * 4 + 1);
+    vec4 texel2 = texelFetch(pointLightTexture, index * 4 + 2);
+    vec4 texel3 = texelFetch(pointLightTexture, index * 4 + 3);
+    return PointLight(texel0.xyz, texel0.w, texel1.xyz, texel1.w, texel2.xyz, texel2.w, texel3.xyz, texel3.w);
+
+}
+
+// offset and count of the point lights of the cluster under this fragment
+uvec2 fragmentCluster() {
+
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterScale.xy), clusterGrid.xy - 1);
+    int slice = clamp(int(log(linearizeDepth(gl_FragCoord.z)) * clusterScale.z + clusterScale.w), 0, clusterGrid.z - 1);
+    return texelFetch(clusterTexture, (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x).rg;
+
+}
+
+// all lights at fragPos, normal normalized
+vec3 shade(vec3 normal, vec3 fragPos, vec3 diffuseColor, vec3 specularColor)
+{
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 result = calcDirLight(dirLight, normal, viewDir, diffuseColor, specularColor, dirShadow(fragPos, normal));
+
+    uvec2 cluster = fragmentCluster();
+    for(uint i = 0u; i < cluster.y; i++) {
+        int index = int(texelFetch(lightIndexTexture, int(cluster.x + i)).r);
+        result += calcPointLight(fetchPointLight(index), normal, fragPos, viewDir, diffuseColor, specularColor);
+    }
+
+    result += calcSpotLight(spotLight, normal, fragPos, viewDir, diffuseColor, specularColor);
+    return result;
+}
@@ -0,0 +1,39 @@
+#version 330 core
+
+layout (location = 0) out vec4 FragColor;
+// the normal of the G-buffer, written only in the deferred path
+layout (location = 1) out vec2 gbufferNormal;
+
+in VS_OUT {
+
+    vec3 fragPos;
+    vec3 normal;
+    vec2 TexCoords;
+
+}fs_in;
+
+flat in uvec2 materialLayers;
+
+// every texture of the model, resampled to one size (see multi_draw_model.h)
+uniform sampler2DArray materialTextures;
+
+// deferred path: store the surface in the G-buffer instead of lighting it
+uniform bool gbufferPass;
+
+#include "lighting.glsl"
+#include "gbuffer.glsl"
+
+void main()
+{
+    vec4 diffuseColor = texture(materialTextures, vec3(fs_in.TexCoords, float(materialLayers.x)));
+    vec3 specularColor = texture(materialTextures, vec3(fs_in.TexCoords, float(materialLayers.y))).rgb;
+
+    if (gbufferPass) {
+        FragColor = packSurface(diffuseColor.rgb, specularColor);
+        gbufferNormal = encodeNormal(normalize(fs_in.normal));
+        return;
+    }
+
+    vec3 result = shade(normalize(fs_in.normal), fs_in.fragPos, diffuseColor.rgb, specularColor);
+    FragColor = vec4(result, diffuseColor.a);
+}
@@ -0,0 +1,29 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// diffuse and specular layer of the mesh being drawn: one value per draw, fetched through the
+// baseInstance of its indirect command (see multi_draw_model.h)
+layout (location = 7) in uvec2 aMaterialLayers;
+
+out VS_OUT {
+    vec3 fragPos;
+    vec3 normal;
+    vec2 TexCoords;
+
+} vs_out;
+
+flat out uvec2 materialLayers;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vs_out.TexCoords = aTexCoords;
+    vs_out.normal = mat3(model) * aNormal;
+    vs_out.fragPos = vec3(model * vec4(aPos, 1.0));
+    materialLayers = aMaterialLayers;
+    gl_Position = projection * view * vec4(vs_out.fragPos, 1.0);
+}
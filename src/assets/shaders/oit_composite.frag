@@ -0,0 +1,22 @@
+#version 330 core
+
+// Resolve of WeightedBlendedOIT: the weighted average color of the transparent layers over the
+// opaque scene. Drawn with blend (GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA), alpha being the revealage.
+// Pixel for pixel, so it only has to cover the viewport the layers were drawn with.
+out vec4 fragColor;
+
+uniform sampler2D accumTexture;
+uniform sampler2D weightTexture;
+
+void main() {
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 accumulation = texelFetch(accumTexture, pixel, 0);
+    float revealage = accumulation.a;
+    if (revealage >= 1.0) {
+        discard;
+    }
+    float weightSum = texelFetch(weightTexture, pixel, 0).r;
+    fragColor = vec4(accumulation.rgb / clamp(weightSum, 1e-4, 5e4), revealage);
+
+}
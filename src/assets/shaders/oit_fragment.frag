@@ -0,0 +1,48 @@
+#version 330 core
+
+// Accumulation side of WeightedBlendedOIT (oit_pass.h): lit like fragment_shader.frag, but every
+// transparent fragment is summed instead of blended in order. The blend of that pass is
+// (GL_ONE, GL_ONE) for color and (GL_ZERO, GL_ONE_MINUS_SRC_ALPHA) for alpha, so
+// accumulation.a ends up as the product of (1 - alpha), the share of the background still visible.
+
+struct Material {
+	sampler2D texture_diffuse1;
+    sampler2D texture_diffuse2;
+    sampler2D texture_diffuse3;
+    sampler2D texture_specular1;
+    sampler2D texture_specular2;
+	float shininess;
+};
+
+layout (location = 0) out vec4 accumulation; // rgb: sum of color * alpha * weight
+layout (location = 1) out float weightSum;   // sum of alpha * weight
+
+in VS_OUT {
+
+    vec3 fragPos;
+    vec3 normal;
+    vec2 TexCoords;
+
+}fs_in;
+
+uniform Material material;
+
+#include "lighting.glsl"
+
+void main()
+{
+    vec4 diffuseColor = texture(material.texture_diffuse1, fs_in.TexCoords);
+    if (diffuseColor.a < 0.01) {
+        discard;
+    }
+    vec3 specularColor = texture(material.texture_specular1, fs_in.TexCoords).rgb;
+
+    vec3 result = shade(normalize(fs_in.normal), fs_in.fragPos, diffuseColor.rgb, specularColor);
+
+    // McGuire and Bavoil's depth weight (eq. 10): near layers dominate the average, clamped to fit in 16-bit floats
+    float alpha = diffuseColor.a;
+    float weight = clamp(alpha * max(1e-2, 3e3 * pow(1.0 - gl_FragCoord.z, 3.0)), 1e-2, 3e3);
+    accumulation = vec4(result * alpha * weight, alpha);
+    weightSum = alpha * weight;
+
+}
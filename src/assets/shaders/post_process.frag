@@ -0,0 +1,119 @@
+#version 330 core
+
+// One pass of PostProcessChain (post_process.h): a filter reads the input texture, then the
+// pixel effects fused into the pass run in order on its result. Filter and effects come from
+// uniforms, the same for every pixel, so the branches stay coherent and cost next to nothing.
+
+#define MAX_EFFECTS 8
+#define MAX_TAPS 16
+
+#define FILTER_COPY 0       // one bilinear sample (the upscale when inputScale is below 1), optional sharpen
+#define FILTER_KERNEL 1     // 3x3 convolution
+#define FILTER_BLUR 2       // one axis of a separable gaussian, taps between texel pairs
+
+#define EFFECT_GRADE 0      // params: exposure, contrast, saturation
+#define EFFECT_GRAYSCALE 1  // params.x: amount
+#define EFFECT_INVERT 2     // params.x: amount
+#define EFFECT_VIGNETTE 3   // params.x: amount
+
+out vec4 fragColor;
+
+in vec2 texCoords;
+
+uniform sampler2D inputTexture;
+uniform vec2 inputScale;        // the lower left part of inputTexture that holds the image
+uniform vec2 texelSize;         // 1 / size of inputTexture
+uniform int filterMode;
+uniform float sharpness;        // FILTER_COPY, 0 is plain bilinear
+uniform mat3 kernel;            // FILTER_KERNEL
+uniform float kernelAmount;     // FILTER_KERNEL, mix between the input and the convolution
+uniform vec2 blurAxis;          // FILTER_BLUR, one texel along x or y
+uniform int tapCount;           // FILTER_BLUR, center tap included
+uniform float tapOffsets[MAX_TAPS];
+uniform float tapWeights[MAX_TAPS];
+uniform int effectCount;
+uniform int effects[MAX_EFFECTS];
+uniform vec4 effectParams[MAX_EFFECTS];
+
+const vec3 luminance = vec3(0.2126, 0.7152, 0.0722);
+
+// texels outside the image (last frame at another render scale) are never read
+vec3 fetch(vec2 uv) {
+    return texture(inputTexture, clamp(uv, 0.5 * texelSize, inputScale - 0.5 * texelSize)).rgb;
+}
+
+vec3 copy(vec2 uv) {
+    vec3 center = fetch(uv);
+    if (sharpness <= 0.0) {
+        return center;
+    }
+    // 4 neighbour sharpen clamped to the local range so edges do not ring
+    vec3 north = fetch(uv + vec2(0.0, texelSize.y));
+    vec3 south = fetch(uv - vec2(0.0, texelSize.y));
+    vec3 east = fetch(uv + vec2(texelSize.x, 0.0));
+    vec3 west = fetch(uv - vec2(texelSize.x, 0.0));
+    vec3 low = min(center, min(min(north, south), min(east, west)));
+    vec3 high = max(center, max(max(north, south), max(east, west)));
+    return clamp(center + sharpness * (4.0 * center - north - south - east - west), low, high);
+}
+
+vec3 convolve(vec2 uv) {
+    vec3 sum = vec3(0.0);
+    vec3 center = vec3(0.0);
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            vec3 color = fetch(uv + vec2(x, y) * texelSize);
+            sum += color * kernel[x + 1][y + 1];
+            if (x == 0 && y == 0) {
+                center = color;
+            }
+        }
+    }
+    return mix(center, sum, kernelAmount);
+}
+
+vec3 blur(vec2 uv) {
+    vec3 sum = fetch(uv) * tapWeights[0];
+    for (int i = 1; i < tapCount; i++) {
+        vec2 offset = blurAxis * tapOffsets[i];
+        sum += (fetch(uv + offset) + fetch(uv - offset)) * tapWeights[i];
+    }
+    return sum;
+}
+
+vec3 applyEffect(int effect, vec4 params, vec3 color) {
+    if (effect == EFFECT_GRADE) {
+        color *= params.x;
+        color = (color - 0.5) * params.y + 0.5;
+        return mix(vec3(dot(color, luminance)), color, params.z);
+    }
+    if (effect == EFFECT_GRAYSCALE) {
+        return mix(color, vec3(dot(color, luminance)), params.x);
+    }
+    if (effect == EFFECT_INVERT) {
+        return mix(color, 1.0 - color, params.x);
+    }
+    if (effect == EFFECT_VIGNETTE) {
+        float distance = length(texCoords - 0.5) * 1.4142;
+        return color * (1.0 - params.x * smoothstep(0.4, 1.0, distance));
+    }
+    return color;
+}
+
+void main() {
+
+    vec2 uv = texCoords * inputScale;
+    vec3 color;
+    if (filterMode == FILTER_KERNEL) {
+        color = convolve(uv);
+    } else if (filterMode == FILTER_BLUR) {
+        color = blur(uv);
+    } else {
+        color = copy(uv);
+    }
+    for (int i = 0; i < effectCount; i++) {
+        color = applyEffect(effects[i], effectParams[i], color);
+    }
+    fragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+
+}
@@ -0,0 +1,21 @@
+#version 330 core
+
+// Depth only pass of the shadow casters (shadow_maps.h). Texels the diffuse map leaves mostly
+// transparent (the glass of the windows) cast no shadow.
+
+in VS_OUT {
+
+    vec3 fragPos;
+    vec3 normal;
+    vec2 TexCoords;
+
+} fs_in;
+
+uniform sampler2D casterTexture;
+
+void main()
+{
+    if (texture(casterTexture, fs_in.TexCoords).a < 0.5) {
+        discard;
+    }
+}
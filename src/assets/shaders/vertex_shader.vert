@@ -18,7 +18,8 @@ uniform mat4 projection;
 void main()
 {
     vs_out.TexCoords = aTexCoords;
-    vs_out.normal = aNormal;
-    vs_out.fragPos = aPos;
-    gl_Position = projection * view * vec4(aPos, 1.0);
+    // models only get translated and uniformly scaled, so mat3(model) keeps normals perpendicular
+    vs_out.normal = mat3(model) * aNormal;
+    vs_out.fragPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(vs_out.fragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,515 @@
+#pragma once
+#ifndef ASTEROID_FIELD_H
+#define ASTEROID_FIELD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "model.h"
+#include "frustum.h"
+#include "parallel.h"
+#include "render_queue.h"
+#include "gl_state.h"
+#include "gpu_culler.h"
+#include "procedural_placement.h"
+#include "instance_encoding.h"
+#include "occlusion_culler.h"
+
+// Instanced field of one Model (the asteroid belt). The instance matrices stay on the CPU with a
+// bounding sphere per instance in SoA form; every frame cull() tests the spheres against the
+// frustum and a view distance on all cores, and writes only the survivors into a streaming
+// instance buffer, so the instanced draw costs what is visible rather than the whole field.
+// On GL 4.3 the same cull can run in a compute shader (GpuCuller) feeding indirect draws.
+// The instance buffer holds records of the field's InstanceEncoding (mat4 by default), encoded once
+// by setEncoding(); cull() only copies records, so a smaller encoding is also less to stream.
+class AsteroidField {
+public:
+
+	// instances per parallel chunk, also the unit the visible lists are merged in
+	static const size_t CHUNK_SIZE = 8192;
+
+	AsteroidField() : instanceBuffer(0), visible(0), gpuReady(false), useGpu(false), procedural(false), encoding(INSTANCE_MAT4) {}
+
+	// copies the matrices and builds the per-instance spheres from the model bounds
+	void create(const glm::mat4* matrices, size_t count, const Bounds& modelBounds) {
+		this->matrices.assign(matrices, matrices + count);
+		procedural = false;
+		setup(modelBounds);
+	}
+
+	// generates the belt in place (see ProceduralPlacement); the GPU copy is regenerated the same way
+	void createBelt(const BeltParams& params, const Bounds& modelBounds) {
+		matrices.resize(params.count);
+		ProceduralPlacement::buildBelt(params, matrices.data());
+		belt = params;
+		procedural = true;
+		setup(modelBounds);
+	}
+
+	// feeds the instance buffer to attributes 3-6 of every mesh of the model, laid out for the
+	// current encoding
+	void attach(const Model& model) const {
+		GLState& state = GLState::get();
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			state.bindVertexArray(model.meshes[i].VAO);
+			state.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+			InstanceEncoder::setAttributes(encoding);
+		}
+		state.bindVertexArray(0);
+	}
+
+	// re-encodes every instance, resizes the instance buffers and re-attaches the model; the draws
+	// must then use the matching vertex shader (InstanceEncoder::vertexShader)
+	void setEncoding(InstanceEncoding encoding, const Model& model) {
+		this->encoding = encoding;
+		encodeRecords();
+		GLState::get().bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, size() * stride(), NULL, GL_STREAM_DRAW);
+		visible = 0;
+		attach(model);
+		if (gpuReady)
+		{
+			gpuCuller.destroy();
+			gpuReady = false;
+			enableGpuCulling(model);
+		}
+	}
+
+	InstanceEncoding instanceEncoding() const {
+		return encoding;
+	}
+
+	// what the quantized shader needs as instanceOrigin / instanceExtent / instanceScale
+	const QuantizationRange& quantization() const {
+		return quantizationRange;
+	}
+
+	// Vertex cost of each encoding: every instance is streamed and drawn repeats times with the
+	// rasterizer discarded, so the GL_TIME_ELAPSED query covers fetch and decode only. useProgram
+	// binds the shader of the encoding with its uniforms. Prints one line per encoding and restores
+	// the current one.
+	void benchmarkEncodings(const Model& model, int repeats, const std::function<void(InstanceEncoding)>& useProgram) {
+		InstanceEncoding previous = encoding;
+		GLuint query;
+		glGenQueries(1, &query);
+		GLState::get().enable(GL_RASTERIZER_DISCARD);
+		for (int e = 0; e < INSTANCE_ENCODING_COUNT; e++)
+		{
+			setEncoding((InstanceEncoding)e, model);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			streamAll();
+			double streamMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			useProgram((InstanceEncoding)e);
+
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for (int r = 0; r < repeats; r++)
+			{
+				for (size_t i = 0; i < model.meshes.size(); i++)
+				{
+					GLState::get().bindVertexArray(model.meshes[i].VAO);
+					glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)model.meshes[i].indices.size(), GL_UNSIGNED_INT, 0, (GLsizei)size());
+				}
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+
+			std::cout << "ASTEROID_FIELD::ENCODING " << InstanceEncoder::name((InstanceEncoding)e) << ": " << stride() << " B x "
+				<< size() << " = " << size() * stride() / (1024.0 * 1024.0) << " MB, stream " << streamMs << " ms, vertex "
+				<< nanoseconds / 1e6 / repeats << " ms per draw" << std::endl;
+		}
+		GLState::get().disable(GL_RASTERIZER_DISCARD);
+		glDeleteQueries(1, &query);
+		GLState::get().bindVertexArray(0);
+		setEncoding(previous, model);
+	}
+
+	// culls against the culler's frustum with the far plane pulled in to maxDistance along the
+	// view direction, then streams the visible matrices; adds to the culler's counters. With an
+	// occlusion culler (rendered this frame) the CPU path also drops the asteroids it hides, with
+	// a built Hi-Z pyramid (last frame) the GPU path does, see cullDisoccluded().
+	void cull(FrustumCuller& culler, const glm::vec3& eye, const glm::vec3& front, float maxDistance, OcclusionCuller* occlusion = NULL,
+		const HiZBuffer* hiZ = NULL) {
+		Frustum frustum = culler.getFrustum();
+		frustum.setFarPlane(eye, front, maxDistance);
+		if (useGpu)
+		{
+			// the count stays on the GPU, the culler's counters only cover the CPU path
+			gpuCuller.cull(frustum, hiZ);
+			return;
+		}
+		cullOnCpu(frustum, occlusion);
+		culler.addStats((unsigned int)visible, (unsigned int)(size() - visible));
+		streamVisible();
+	}
+
+	// prepares the compute path for the meshes of model, false when the context is older than 4.3
+	bool enableGpuCulling(const Model& model) {
+		if (!GLExt::get().hasCompute())
+		{
+			return false;
+		}
+		std::vector<glm::vec4> spheres(size());
+		for (size_t i = 0; i < size(); i++)
+		{
+			spheres[i] = glm::vec4(centerX[i], centerY[i], centerZ[i], radius[i]);
+		}
+		std::vector<DrawElementsIndirectCommand> commands(model.meshes.size());
+		for (size_t i = 0; i < commands.size(); i++)
+		{
+			DrawElementsIndirectCommand command = { (GLuint)model.meshes[i].indices.size(), 0, 0, 0, 0 };
+			commands[i] = command;
+		}
+		gpuCuller.create(spheres, stride(), instanceBuffer, commands);
+
+		// the GPU keeps its own copy of the records, written straight into the mapped buffer
+		unsigned char* instances = (unsigned char*)gpuCuller.mapInstances();
+		if (instances == NULL)
+		{
+			return false;
+		}
+		if (procedural && encoding == INSTANCE_MAT4)
+		{
+			ProceduralPlacement::buildBelt(belt, (glm::mat4*)instances);
+		}
+		else
+		{
+			const unsigned char* source = records();
+			size_t recordSize = stride();
+			ThreadPool::get().parallelFor(size(), CHUNK_SIZE, [&](size_t, size_t begin, size_t end) {
+				memcpy(instances + begin * recordSize, source + begin * recordSize, (end - begin) * recordSize);
+			});
+		}
+		gpuCuller.unmapInstances();
+		gpuReady = true;
+		return true;
+	}
+
+	void setGpuCulling(bool on) {
+		useGpu = on && gpuReady;
+	}
+
+	bool gpuCulling() const {
+		return useGpu;
+	}
+
+	// Culls the same frustum on both paths and compares the visible sets (matched by record, the
+	// GPU order is arbitrary). Differences on spheres touching a plane within rounding are
+	// tolerated. Reads the GPU results back, so it stalls: run it on demand, not every frame.
+	bool validateGpuCulling(const FrustumCuller& culler, const glm::vec3& eye, const glm::vec3& front, float maxDistance) {
+		if (!gpuReady)
+		{
+			return false;
+		}
+		Frustum frustum = culler.getFrustum();
+		frustum.setFarPlane(eye, front, maxDistance);
+		cullOnCpu(frustum);
+		std::vector<uint64_t> cpu;
+		for (size_t c = 0; c < chunkVisible.size(); c++)
+		{
+			for (size_t i = 0; i < chunkVisible[c].size(); i++)
+			{
+				cpu.push_back(hashRecord(chunkVisible[c][i]));
+			}
+		}
+		gpuCuller.cull(frustum);
+		std::vector<unsigned char> gpuRecords;
+		gpuCuller.readVisible(gpuRecords);
+		std::vector<uint64_t> gpu;
+		for (size_t offset = 0; offset < gpuRecords.size(); offset += stride())
+		{
+			gpu.push_back(hash(&gpuRecords[offset], stride()));
+		}
+		std::sort(cpu.begin(), cpu.end());
+		std::sort(gpu.begin(), gpu.end());
+		std::vector<uint64_t> differ;
+		std::set_symmetric_difference(cpu.begin(), cpu.end(), gpu.begin(), gpu.end(), std::back_inserter(differ));
+
+		unsigned int borderline = 0;
+		for (size_t i = 0; i < size() && !differ.empty(); i++)
+		{
+			if (std::binary_search(differ.begin(), differ.end(), hashRecord(i)) && planeMargin(frustum, i) < 1e-3f)
+			{
+				borderline++;
+			}
+		}
+		bool ok = differ.size() == borderline;
+		std::cout << "ASTEROID_FIELD::GPU_CULL " << (ok ? "matches" : "DIFFERS FROM") << " the CPU culler: cpu " << cpu.size()
+			<< " gpu " << gpu.size() << " visible, " << differ.size() << " different (" << borderline << " on a plane)" << std::endl;
+		// the instance buffer now holds the GPU result
+		visible = 0;
+		return ok;
+	}
+
+	// GPU path, after the draws of submit() and hiZ rebuilt from their depth: the asteroids the
+	// last frame's pyramid hid that turn out to be visible; true when submitDisoccluded() has work
+	bool cullDisoccluded(const HiZBuffer& hiZ) {
+		return useGpu && gpuCuller.cullDisoccluded(hiZ);
+	}
+
+	// draws of the asteroids found by cullDisoccluded()
+	void submitDisoccluded(RenderQueue& queue, const Shader& shader, const Model& model) const {
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			const Mesh& mesh = model.meshes[i];
+			DrawItem item = { shader.ID, mesh.VAO, mesh.material(), GL_TRIANGLES, (GLsizei)mesh.indices.size(), 0, true, glm::mat4(1.0f),
+				gpuCuller.lateIndirectBuffer(), GpuCuller::commandOffset(i), 1 };
+			queue.submit(PASS_OPAQUE, item, glm::vec3(0.0f));
+		}
+	}
+
+	// one instanced draw per mesh, sized to what survived the last cull(); shader is the variant
+	// of instanceEncoding()
+	void submit(RenderQueue& queue, const Shader& shader, const Model& model) const {
+		if (visible == 0 && !useGpu)
+		{
+			return;
+		}
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			const Mesh& mesh = model.meshes[i];
+			DrawItem item = { shader.ID, mesh.VAO, mesh.material(), GL_TRIANGLES, (GLsizei)mesh.indices.size(),
+				(GLsizei)visible, true, glm::mat4(1.0f), 0, 0, 1 };
+			if (useGpu)
+			{
+				item.indirectBuffer = gpuCuller.indirectBuffer();
+				item.indirectOffset = GpuCuller::commandOffset(i);
+			}
+			queue.submit(PASS_OPAQUE, item, glm::vec3(0.0f));
+		}
+	}
+
+	// shadow casters of one cascade: culled on the CPU against frustum and streamed over the
+	// instances of the camera, so it must run before cull() in the frame, and the draws of one
+	// cascade must be issued before the next call. A plain instanced draw on the GPU path too.
+	void submitShadow(RenderQueue& queue, const Frustum& frustum, const Shader& shader, const Model& model) {
+		cullOnCpu(frustum);
+		streamVisible();
+		if (visible == 0)
+		{
+			return;
+		}
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			const Mesh& mesh = model.meshes[i];
+			DrawItem item = { shader.ID, mesh.VAO, mesh.material(), GL_TRIANGLES, (GLsizei)mesh.indices.size(),
+				(GLsizei)visible, true, glm::mat4(1.0f), 0, 0, 1 };
+			queue.submit(PASS_OPAQUE, item, glm::vec3(0.0f));
+		}
+	}
+
+	size_t size() const {
+		return matrices.size();
+	}
+
+	size_t visibleCount() const {
+		return visible;
+	}
+
+	void destroy() {
+		if (gpuReady)
+		{
+			gpuCuller.destroy();
+		}
+		GLState::get().forgetBuffer(instanceBuffer);
+		glDeleteBuffers(1, &instanceBuffer);
+		instanceBuffer = 0;
+	}
+
+private:
+
+	std::vector<glm::mat4> matrices;
+	std::vector<float> centerX, centerY, centerZ, radius;
+	std::vector<std::vector<uint32_t> > chunkVisible;
+	std::vector<size_t> chunkOffsets;
+	std::vector<unsigned int> chunkTested; // frustum survivors per chunk, before occlusion
+	GLuint instanceBuffer;
+	size_t visible;
+	GpuCuller gpuCuller;
+	bool gpuReady;
+	bool useGpu;
+	bool procedural;
+	BeltParams belt;
+	InstanceEncoding encoding;
+	QuantizationRange quantizationRange;
+	std::vector<unsigned char> encoded; // empty for INSTANCE_MAT4, the matrices are the records
+
+	size_t stride() const {
+		return (size_t)InstanceEncoder::stride(encoding);
+	}
+
+	const unsigned char* records() const {
+		return encoding == INSTANCE_MAT4 ? (const unsigned char*)matrices.data() : encoded.data();
+	}
+
+	void encodeRecords() {
+		quantizationRange = InstanceEncoder::range(matrices.data(), size());
+		if (encoding == INSTANCE_MAT4)
+		{
+			std::vector<unsigned char>().swap(encoded);
+			return;
+		}
+		encoded.resize(size() * stride());
+		ThreadPool::get().parallelFor(size(), CHUNK_SIZE, [&](size_t, size_t begin, size_t end) {
+			InstanceEncoder::encode(encoding, &matrices[begin], end - begin, quantizationRange, &encoded[begin * stride()]);
+		});
+	}
+
+	// per-instance spheres, chunk lists and the streaming buffer for the current matrices
+	void setup(const Bounds& modelBounds) {
+		size_t count = matrices.size();
+		centerX.resize(count);
+		centerY.resize(count);
+		centerZ.resize(count);
+		radius.resize(count);
+		ThreadPool::get().parallelFor(count, CHUNK_SIZE, [&](size_t, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				const glm::mat4& m = matrices[i];
+				glm::vec3 center = glm::vec3(m * glm::vec4(modelBounds.center, 1.0f));
+				float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+				centerX[i] = center.x;
+				centerY[i] = center.y;
+				centerZ[i] = center.z;
+				radius[i] = modelBounds.radius * scale;
+			}
+		});
+		chunkVisible.resize(ThreadPool::chunkCount(count, CHUNK_SIZE));
+		chunkTested.resize(chunkVisible.size());
+
+		GLState& state = GLState::get();
+		glGenBuffers(1, &instanceBuffer);
+		state.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		encodeRecords();
+		glBufferData(GL_ARRAY_BUFFER, count * stride(), NULL, GL_STREAM_DRAW);
+		visible = 0;
+	}
+
+	void cullOnCpu(const Frustum& frustum, OcclusionCuller* occlusion = NULL) {
+		ThreadPool& pool = ThreadPool::get();
+		pool.parallelFor(size(), CHUNK_SIZE, [&](size_t chunk, size_t begin, size_t end) {
+			std::vector<uint32_t>& indices = chunkVisible[chunk];
+			indices.clear();
+			FrustumCuller::cullSpheres(frustum, centerX.data(), centerY.data(), centerZ.data(), radius.data(),
+				begin, end - begin, indices);
+			chunkTested[chunk] = (unsigned int)indices.size();
+			if (occlusion != NULL)
+			{
+				// compacted in place, the order is kept
+				size_t kept = 0;
+				for (size_t i = 0; i < indices.size(); i++)
+				{
+					uint32_t index = indices[i];
+					if (occlusion->testSphere(glm::vec3(centerX[index], centerY[index], centerZ[index]), radius[index]))
+					{
+						indices[kept++] = index;
+					}
+				}
+				indices.resize(kept);
+			}
+		});
+
+		// chunk outputs are concatenated in chunk order
+		chunkOffsets.resize(chunkVisible.size());
+		visible = 0;
+		for (size_t c = 0; c < chunkVisible.size(); c++)
+		{
+			chunkOffsets[c] = visible;
+			visible += chunkVisible[c].size();
+		}
+		if (occlusion != NULL)
+		{
+			unsigned int tested = 0;
+			for (size_t c = 0; c < chunkTested.size(); c++)
+			{
+				tested += chunkTested[c];
+			}
+			occlusion->addStats(tested, tested - (unsigned int)visible);
+		}
+	}
+
+	void streamVisible() {
+		ThreadPool& pool = ThreadPool::get();
+		if (visible == 0)
+		{
+			return;
+		}
+
+		// invalidating the whole buffer lets the driver hand us fresh memory instead of waiting
+		// for the draws of the previous frame
+		GLState::get().bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		unsigned char* out = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, visible * stride(),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (out == NULL)
+		{
+			visible = 0;
+			return;
+		}
+		const unsigned char* source = records();
+		size_t recordSize = stride();
+		pool.parallelFor(chunkVisible.size(), 1, [&](size_t chunk, size_t, size_t) {
+			const std::vector<uint32_t>& indices = chunkVisible[chunk];
+			unsigned char* dst = out + chunkOffsets[chunk] * recordSize;
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				memcpy(dst + i * recordSize, source + indices[i] * recordSize, recordSize);
+			}
+		});
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	// every record, nothing culled (benchmarkEncodings)
+	void streamAll() {
+		visible = size();
+		GLState::get().bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		unsigned char* out = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, visible * stride(),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (out == NULL)
+		{
+			visible = 0;
+			return;
+		}
+		const unsigned char* source = records();
+		size_t recordSize = stride();
+		ThreadPool::get().parallelFor(size(), CHUNK_SIZE, [&](size_t, size_t begin, size_t end) {
+			memcpy(out + begin * recordSize, source + begin * recordSize, (end - begin) * recordSize);
+		});
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	// distance between the surface of sphere i and the closest frustum plane
+	float planeMargin(const Frustum& frustum, size_t i) const {
+		float margin = 1e30f;
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			margin = std::min(margin, std::fabs(plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w + radius[i]));
+		}
+		return margin;
+	}
+
+	uint64_t hashRecord(size_t i) const {
+		return hash(records() + i * stride(), stride());
+	}
+
+	static uint64_t hash(const unsigned char* bytes, size_t length) {
+		uint64_t value = 14695981039346656037ull;
+		for (size_t i = 0; i < length; i++)
+		{
+			value = (value ^ bytes[i]) * 1099511628211ull;
+		}
+		return value;
+	}
+
+};
+
+#endif
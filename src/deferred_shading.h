@@ -0,0 +1,172 @@
+#pragma once
+#ifndef DEFERRED_SHADING_H
+#define DEFERRED_SHADING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "gl_state.h"
+#include "shader.h"
+#include "render_graph.h"
+#include "light_clusters.h"
+
+// Deferred path of the opaque geometry, as passes of a RenderGraph. The G-buffer is two
+// transients (gbuffer.glsl): albedo and specular in RGBA8, an octahedral normal in RG16, plus
+// the scene depth the position is rebuilt from; 8 bytes per pixel besides the depth.
+// Every visible point light is drawn as a cube around its radius, instanced, blended additively
+// into a float transient; only the back faces are drawn, never clipped by the far plane
+// (light_volume.vert), so a volume still covers its pixels when the camera is inside it. One
+// fullscreen pass then adds the directional and the spot light and writes the scene color.
+// The light volumes need no compute shaders, which tiled deferred shading would (GL 4.3).
+class DeferredShading {
+public:
+
+	DeferredShading() : cubeVAO(0), cubeVBO(0), cubeEBO(0), instanceVBO(0), instanceCapacity(0) {}
+
+	// unit cube of the light volumes and the buffer of their light indices
+	void create() {
+		const float vertices[] = {
+			-1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f,  1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,
+			-1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,   1.0f,  1.0f,  1.0f,  -1.0f,  1.0f,  1.0f
+		};
+		// counter-clockwise seen from outside
+		const GLubyte indices[] = {
+			0, 2, 1,  0, 3, 2,      // -z
+			4, 5, 6,  4, 6, 7,      // +z
+			0, 4, 7,  0, 7, 3,      // -x
+			1, 2, 6,  1, 6, 5,      // +x
+			0, 1, 5,  0, 5, 4,      // -y
+			3, 7, 6,  3, 6, 2       // +y
+		};
+
+		GLState& state = GLState::get();
+		glGenVertexArrays(1, &cubeVAO);
+		glGenBuffers(1, &cubeVBO);
+		glGenBuffers(1, &cubeEBO);
+		glGenBuffers(1, &instanceVBO);
+		state.bindVertexArray(cubeVAO);
+		state.bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+		state.bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glEnableVertexAttribArray(1);
+		glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)0);
+		glVertexAttribDivisor(1, 1);
+		state.bindVertexArray(0);
+	}
+
+	// drawOpaque draws the opaque geometry with gbufferPass set; the lighting and volume programs
+	// must have their samplers on units 0 (albedo), 1 (normal) and 2 (depth), the lighting program
+	// pointLighting on unit 3, the volume program the point light texture of lightClusters, whose
+	// build() for this frame has run
+	void addPasses(RenderGraph& graph, RenderResource sceneColor, RenderResource sceneDepth, const glm::ivec2& viewport,
+		const std::function<void()>& drawOpaque, const Shader& lightingShader, const Shader& volumeShader, GLuint quadVAO,
+		const LightClusters& lightClusters, const glm::vec4& clearColor) {
+		TextureDesc scene = graph.desc(sceneColor);
+		TextureDesc albedoDesc = { scene.width, scene.height, GL_RGBA8, GL_NEAREST };
+		TextureDesc normalDesc = { scene.width, scene.height, GL_RG16, GL_NEAREST };
+		TextureDesc pointDesc = { scene.width, scene.height, GL_RGBA16F, GL_NEAREST };
+		RenderResource albedo = graph.create("gbuffer albedo", albedoDesc);
+		RenderResource normal = graph.create("gbuffer normal", normalDesc);
+		RenderResource pointLighting = graph.create("point lighting", pointDesc);
+
+		graph.addPass("gbuffer", [drawOpaque](RenderGraph&) {
+			const GLfloat clearSurface[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			const GLfloat clearNormal[] = { 0.5f, 0.5f, 0.0f, 0.0f };
+			const GLfloat clearDepth = 1.0f;
+			GLState::get().depthMask(GL_TRUE);
+			glClearBufferfv(GL_COLOR, 0, clearSurface);
+			glClearBufferfv(GL_COLOR, 1, clearNormal);
+			glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+			drawOpaque();
+		}).write(albedo).write(normal).depthStencil(sceneDepth, true).viewport(viewport);
+
+		// the visible lights of this frame, one instance each
+		const std::vector<uint32_t>& visible = lightClusters.visibleLights();
+		GLsizei count = (GLsizei)visible.size();
+		if (count > 0)
+		{
+			GLState::get().bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			if (visible.size() > instanceCapacity)
+			{
+				instanceCapacity = visible.size() + visible.size() / 2;
+				glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(uint32_t), NULL, GL_STREAM_DRAW);
+			}
+			glBufferSubData(GL_ARRAY_BUFFER, 0, visible.size() * sizeof(uint32_t), visible.data());
+		}
+
+		// summed in a float target: thousands of small terms blended into 8 bits would each be rounded
+		const Shader* volume = &volumeShader;
+		GLuint vao = cubeVAO;
+		graph.addPass("light volumes", [volume, vao, count, albedo, normal, sceneDepth](RenderGraph& graph) {
+			const GLfloat clearLighting[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			glClearBufferfv(GL_COLOR, 0, clearLighting);
+			if (count == 0)
+			{
+				return;
+			}
+			GLState& state = GLState::get();
+			state.disable(GL_DEPTH_TEST);
+			state.enable(GL_BLEND);
+			state.blendFunc(GL_ONE, GL_ONE);
+			state.enable(GL_CULL_FACE);
+			glCullFace(GL_FRONT);
+			state.useProgram(volume->ID);
+			state.bindVertexArray(vao);
+			bindGBuffer(graph, albedo, normal, sceneDepth);
+			glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0, count);
+			glCullFace(GL_BACK);
+			state.disable(GL_CULL_FACE);
+			state.enable(GL_DEPTH_TEST);
+		}).read(albedo).read(normal).read(sceneDepth).write(pointLighting).viewport(viewport);
+
+		const Shader* lighting = &lightingShader;
+		graph.addPass("deferred lights", [lighting, quadVAO, albedo, normal, sceneDepth, pointLighting, clearColor](RenderGraph& graph) {
+			glClearBufferfv(GL_COLOR, 0, &clearColor[0]);
+			GLState& state = GLState::get();
+			state.disable(GL_DEPTH_TEST);
+			state.disable(GL_BLEND);
+			state.useProgram(lighting->ID);
+			state.bindVertexArray(quadVAO);
+			bindGBuffer(graph, albedo, normal, sceneDepth);
+			state.bindTexture(3, GL_TEXTURE_2D, graph.texture(pointLighting));
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+			state.enable(GL_DEPTH_TEST);
+		}).read(albedo).read(normal).read(sceneDepth).read(pointLighting).write(sceneColor).viewport(viewport);
+	}
+
+	void destroy() {
+		GLState& state = GLState::get();
+		state.forgetVertexArray(cubeVAO);
+		state.forgetBuffer(cubeVBO);
+		state.forgetBuffer(cubeEBO);
+		state.forgetBuffer(instanceVBO);
+		glDeleteVertexArrays(1, &cubeVAO);
+		glDeleteBuffers(1, &cubeVBO);
+		glDeleteBuffers(1, &cubeEBO);
+		glDeleteBuffers(1, &instanceVBO);
+	}
+
+private:
+
+	GLuint cubeVAO, cubeVBO, cubeEBO;
+	GLuint instanceVBO;
+	size_t instanceCapacity;
+
+	static void bindGBuffer(RenderGraph& graph, RenderResource albedo, RenderResource normal, RenderResource depth) {
+		GLState& state = GLState::get();
+		state.bindTexture(0, GL_TEXTURE_2D, graph.texture(albedo));
+		state.bindTexture(1, GL_TEXTURE_2D, graph.texture(normal));
+		state.bindTexture(2, GL_TEXTURE_2D, graph.texture(depth));
+	}
+
+};
+
+#endif
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Picks the render scale of RenderTargets from the measured GPU frame time. Every frame is
+// bracketed by two GL_TIMESTAMP queries (timestamps, not GL_TIME_ELAPSED, so other timings can
+// nest inside); the result is read FRAME_LATENCY frames later, when it is ready, so the CPU
+// never waits. The cost of a pixel bound frame grows with scale^2, so the scale that would
+// meet the budget is scale * sqrt(budget / time); the scale moves part of the way there each
+// frame and stays put while the time is within the dead band of the budget, so it settles
+// instead of oscillating.
+class DynamicResolution {
+public:
+
+	static const int FRAME_LATENCY = 4;
+
+	DynamicResolution(float budgetMs = 14.0f, float minScale = 0.5f, float maxScale = 1.0f)
+		: budget(budgetMs), minimum(minScale), maximum(maxScale), current(maxScale), measured(0.0f), frame(0), created(false) {}
+
+	void beginFrame() {
+		if (!created)
+		{
+			glGenQueries(FRAME_LATENCY * 2, queries);
+			created = true;
+		}
+		int slot = frame % FRAME_LATENCY;
+		// the slot about to be reused holds the frame from FRAME_LATENCY frames ago
+		if (frame >= FRAME_LATENCY)
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(queries[slot * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 start, end;
+				glGetQueryObjectui64v(queries[slot * 2], GL_QUERY_RESULT, &start);
+				glGetQueryObjectui64v(queries[slot * 2 + 1], GL_QUERY_RESULT, &end);
+				measured = (float)((end - start) / 1.0e6);
+				adjust();
+			}
+		}
+		glQueryCounter(queries[slot * 2], GL_TIMESTAMP);
+	}
+
+	void endFrame() {
+		glQueryCounter(queries[(frame % FRAME_LATENCY) * 2 + 1], GL_TIMESTAMP);
+		frame++;
+	}
+
+	float scale() const {
+		return current;
+	}
+
+	// GPU time of the last measured frame
+	float gpuMs() const {
+		return measured;
+	}
+
+	void setBudget(float budgetMs) {
+		budget = budgetMs;
+	}
+
+	// back to full resolution, e.g. when the mode is switched off
+	void reset() {
+		current = maximum;
+	}
+
+	void destroy() {
+		if (created)
+		{
+			glDeleteQueries(FRAME_LATENCY * 2, queries);
+			created = false;
+		}
+	}
+
+private:
+
+	static constexpr float DEAD_BAND = 0.05f;
+	static constexpr float RATE = 0.25f;
+	static constexpr float SNAP = 0.01f;
+
+	float budget;
+	float minimum, maximum;
+	float current;
+	float measured;
+	GLuint queries[FRAME_LATENCY * 2];
+	unsigned int frame;
+	bool created;
+
+	void adjust() {
+		if (measured <= 0.0f)
+		{
+			return;
+		}
+		float ratio = budget / measured;
+		if (std::fabs(ratio - 1.0f) < DEAD_BAND)
+		{
+			return;
+		}
+		float ideal = std::min(std::max(current * std::sqrt(ratio), minimum), maximum);
+		current += (ideal - current) * RATE;
+		if (std::fabs(ideal - current) < SNAP)
+		{
+			current = ideal;
+		}
+	}
+
+};
+
+#endif
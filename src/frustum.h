@@ -0,0 +1,282 @@
+#pragma once
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// x86 builds always have SSE2; AVX is used when the compiler targets it (make AVX=1 or /arch:AVX2)
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_SSE
+#endif
+
+// Local-space bounding volumes of a mesh: an AABB and the sphere around its center.
+struct Bounds {
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec3 center;
+	float radius;
+
+	Bounds() : min(0.0f), max(0.0f), center(0.0f), radius(0.0f) {}
+
+	Bounds(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {
+		center = (min + max) * 0.5f;
+		radius = glm::length(max - center);
+	}
+};
+
+// The six planes (ax + by + cz + d >= 0 inside) of a projection * view matrix, normalized so the
+// plane distance of a point is in world units (Gribb & Hartmann).
+struct Frustum {
+	glm::vec4 planes[6];
+
+	Frustum() {}
+
+	explicit Frustum(const glm::mat4& viewProjection) {
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+		{
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+		}
+		planes[0] = rows[3] + rows[0]; // left
+		planes[1] = rows[3] - rows[0]; // right
+		planes[2] = rows[3] + rows[1]; // bottom
+		planes[3] = rows[3] - rows[1]; // top
+		planes[4] = rows[3] + rows[2]; // near
+		planes[5] = rows[3] - rows[2]; // far
+		for (int i = 0; i < 6; i++)
+		{
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+		}
+	}
+
+	// replaces the far plane by one at distance along the view direction (cheap distance culling)
+	void setFarPlane(const glm::vec3& eye, const glm::vec3& front, float distance) {
+		glm::vec3 normal = -glm::normalize(front);
+		planes[5] = glm::vec4(normal, -glm::dot(normal, eye) + distance);
+	}
+
+	bool containsSphere(const glm::vec3& center, float radius) const {
+		for (int i = 0; i < 6; i++)
+		{
+			if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+// Culls batches of world-space boxes against the frame frustum. Bounds are kept as structure of
+// arrays so the SIMD loop tests 4 (SSE) or 8 (AVX) objects against each plane per instruction;
+// cull() returns the indices of the visible ones, compacted, in the order they were added.
+class FrustumCuller {
+public:
+
+	struct Stats {
+		unsigned int visible = 0;
+		unsigned int culled = 0;
+	};
+
+	// once per frame, also resets the counters
+	void setFrustum(const glm::mat4& viewProjection) {
+		frustum = Frustum(viewProjection);
+		frameStats = Stats();
+		clear();
+	}
+
+	// same, from planes already extracted (a shadow cascade)
+	void setFrustum(const Frustum& planes) {
+		frustum = planes;
+		frameStats = Stats();
+		clear();
+	}
+
+	const Frustum& getFrustum() const {
+		return frustum;
+	}
+
+	// starts a new batch
+	void clear() {
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		extentX.clear();
+		extentY.clear();
+		extentZ.clear();
+	}
+
+	// adds the local bounds moved by model as a world AABB (Arvo's method), returns its index
+	uint32_t add(const Bounds& bounds, const glm::mat4& model) {
+		glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+		glm::vec3 extent = bounds.max - bounds.center;
+		glm::vec3 worldExtent;
+		for (int i = 0; i < 3; i++)
+		{
+			worldExtent[i] = std::fabs(model[0][i]) * extent.x + std::fabs(model[1][i]) * extent.y + std::fabs(model[2][i]) * extent.z;
+		}
+		return addBox(center, worldExtent);
+	}
+
+	uint32_t addBox(const glm::vec3& center, const glm::vec3& extent) {
+		centerX.push_back(center.x);
+		centerY.push_back(center.y);
+		centerZ.push_back(center.z);
+		extentX.push_back(extent.x);
+		extentY.push_back(extent.y);
+		extentZ.push_back(extent.z);
+		return (uint32_t)(centerX.size() - 1);
+	}
+
+	// tests the current batch, the result stays valid until the next clear()/cull()
+	const std::vector<uint32_t>& cull() {
+		visibleList.clear();
+		cullBoxes(frustum, centerX.data(), centerY.data(), centerZ.data(), extentX.data(), extentY.data(), extentZ.data(),
+			centerX.size(), visibleList);
+		frameStats.visible += (unsigned int)visibleList.size();
+		frameStats.culled += (unsigned int)(centerX.size() - visibleList.size());
+		return visibleList;
+	}
+
+	void addStats(unsigned int visible, unsigned int culled) {
+		frameStats.visible += visible;
+		frameStats.culled += culled;
+	}
+
+	const Stats& stats() const {
+		return frameStats;
+	}
+
+	// Appends to visible the indices [first, first + count) of the spheres inside the frustum.
+	// Spheres are the same test as boxes with the projected extent replaced by the radius.
+	static void cullSpheres(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+		size_t first, size_t count, std::vector<uint32_t>& visible) {
+		test(frustum, x, y, z, NULL, NULL, NULL, radius, first, count, visible);
+	}
+
+	static void cullBoxes(const Frustum& frustum, const float* x, const float* y, const float* z,
+		const float* ex, const float* ey, const float* ez, size_t count, std::vector<uint32_t>& visible) {
+		test(frustum, x, y, z, ex, ey, ez, NULL, 0, count, visible);
+	}
+
+private:
+
+	Frustum frustum;
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+	std::vector<uint32_t> visibleList;
+	Stats frameStats;
+
+	// outside a plane when dot(n, c) + d < -r, with r = |n| . extent for boxes or the radius for spheres
+	static bool testOne(const Frustum& frustum, const float* x, const float* y, const float* z,
+		const float* ex, const float* ey, const float* ez, const float* radius, size_t i) {
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			float r = radius ? radius[i] : std::fabs(plane.x) * ex[i] + std::fabs(plane.y) * ey[i] + std::fabs(plane.z) * ez[i];
+			if (plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w < -r)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static void test(const Frustum& frustum, const float* x, const float* y, const float* z,
+		const float* ex, const float* ey, const float* ez, const float* radius, size_t first, size_t count,
+		std::vector<uint32_t>& visible) {
+		size_t i = first;
+		size_t end = first + count;
+#if defined(FRUSTUM_AVX)
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(x + i);
+			__m256 cy = _mm256_loadu_ps(y + i);
+			__m256 cz = _mm256_loadu_ps(z + i);
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+					_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), cz), _mm256_set1_ps(plane.w)));
+				__m256 r;
+				if (radius)
+				{
+					r = _mm256_loadu_ps(radius + i);
+				}
+				else
+				{
+					r = _mm256_add_ps(_mm256_add_ps(
+						_mm256_mul_ps(_mm256_andnot_ps(signMask, _mm256_set1_ps(plane.x)), _mm256_loadu_ps(ex + i)),
+						_mm256_mul_ps(_mm256_andnot_ps(signMask, _mm256_set1_ps(plane.y)), _mm256_loadu_ps(ey + i))),
+						_mm256_mul_ps(_mm256_andnot_ps(signMask, _mm256_set1_ps(plane.z)), _mm256_loadu_ps(ez + i)));
+				}
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(dist, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+			}
+			appendLanes(_mm256_movemask_ps(inside), i, visible);
+		}
+#elif defined(FRUSTUM_SSE)
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(x + i);
+			__m128 cy = _mm_loadu_ps(y + i);
+			__m128 cz = _mm_loadu_ps(z + i);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+				__m128 r;
+				if (radius)
+				{
+					r = _mm_loadu_ps(radius + i);
+				}
+				else
+				{
+					r = _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(_mm_andnot_ps(signMask, _mm_set1_ps(plane.x)), _mm_loadu_ps(ex + i)),
+						_mm_mul_ps(_mm_andnot_ps(signMask, _mm_set1_ps(plane.y)), _mm_loadu_ps(ey + i))),
+						_mm_mul_ps(_mm_andnot_ps(signMask, _mm_set1_ps(plane.z)), _mm_loadu_ps(ez + i)));
+				}
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, r), _mm_setzero_ps()));
+			}
+			appendLanes(_mm_movemask_ps(inside), i, visible);
+		}
+#endif
+		// remainder (and the whole batch without SIMD)
+		for (; i < end; i++)
+		{
+			if (testOne(frustum, x, y, z, ex, ey, ez, radius, i))
+			{
+				visible.push_back((uint32_t)i);
+			}
+		}
+	}
+
+	static void appendLanes(int mask, size_t base, std::vector<uint32_t>& visible) {
+		while (mask)
+		{
+			int lane = 0;
+			while (!(mask & (1 << lane)))
+			{
+				lane++;
+			}
+			visible.push_back((uint32_t)(base + lane));
+			mask &= mask - 1;
+		}
+	}
+
+};
+
+#endif
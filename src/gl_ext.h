@@ -0,0 +1,115 @@
+#pragma once
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+// glad was generated for 3.3 core; the optional GL 4.x paths (compute culling, indirect draws) load
+// their entry points here. Everything stays NULL and the has*() queries return false on a 3.3
+// context, so callers fall back to the 3.3 path.
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_TEXTURE_FETCH_BARRIER_BIT
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#endif
+
+// layout read by glDrawElementsIndirect / glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+class GLExt {
+public:
+
+	typedef void (APIENTRYP DispatchComputeProc)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+	typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+	typedef void (APIENTRYP DrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect);
+	typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+	typedef void (APIENTRYP BindImageTextureProc)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+
+	DispatchComputeProc dispatchCompute = NULL;
+	MemoryBarrierProc memoryBarrier = NULL;
+	DrawElementsIndirectProc drawElementsIndirect = NULL;
+	MultiDrawElementsIndirectProc multiDrawElementsIndirect = NULL;
+	BindImageTextureProc bindImageTexture = NULL;
+
+	static GLExt& get() {
+		static GLExt ext;
+		return ext;
+	}
+
+	// call once after gladLoadGLLoader with the same loader
+	void load(GLADloadproc loader) {
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		if (atLeast(4, 0))
+		{
+			drawElementsIndirect = (DrawElementsIndirectProc)loader("glDrawElementsIndirect");
+		}
+		if (atLeast(4, 3))
+		{
+			dispatchCompute = (DispatchComputeProc)loader("glDispatchCompute");
+			memoryBarrier = (MemoryBarrierProc)loader("glMemoryBarrier");
+			multiDrawElementsIndirect = (MultiDrawElementsIndirectProc)loader("glMultiDrawElementsIndirect");
+			bindImageTexture = (BindImageTextureProc)loader("glBindImageTexture");
+		}
+		std::cout << "GL " << major << "." << minor << " context, compute " << (hasCompute() ? "available" : "unavailable") << std::endl;
+	}
+
+	bool atLeast(int wantMajor, int wantMinor) const {
+		return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+	}
+
+	// glMultiDrawElementsIndirect, including the baseInstance of the commands (core in 4.3)
+	bool hasMultiDrawIndirect() const {
+		return multiDrawElementsIndirect != NULL;
+	}
+
+	// compute shaders, SSBOs and multi-draw indirect (all core in 4.3)
+	bool hasCompute() const {
+		return dispatchCompute != NULL && memoryBarrier != NULL && multiDrawElementsIndirect != NULL;
+	}
+
+	// compute shaders writing textures through image units (core in 4.2)
+	bool hasImageStore() const {
+		return hasCompute() && bindImageTexture != NULL;
+	}
+
+private:
+
+	GLint major = 3;
+	GLint minor = 3;
+
+	GLExt() {}
+	GLExt(const GLExt&) = delete;
+	GLExt& operator=(const GLExt&) = delete;
+
+};
+
+#endif
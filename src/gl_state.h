@@ -0,0 +1,357 @@
+#pragma once
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+// Thin shadow of the GL state we touch every frame. Every setter compares against the last value it
+// issued and skips the call when nothing would change. Anything done with raw gl* calls behind its
+// back (setup code, texture loading) must be followed by invalidate(), otherwise the shadow lies.
+class GLState {
+public:
+
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+	static const int MAX_TEXTURE_UNITS = 32;
+
+	struct Stats {
+		unsigned int issued = 0;
+		unsigned int skipped = 0;
+	};
+
+	static GLState& get() {
+		static GLState state;
+		return state;
+	}
+
+	// forget everything, the next call of each kind always reaches the driver
+	void invalidate() {
+		program = UNKNOWN;
+		vertexArray = UNKNOWN;
+		arrayBuffer = UNKNOWN;
+		elementBuffer = UNKNOWN;
+		uniformBuffer = UNKNOWN;
+		textureBuffer = UNKNOWN;
+		activeUnit = UNKNOWN;
+		for (int i = 0; i < MAX_TEXTURE_UNITS; i++)
+		{
+			for (int t = 0; t < TARGET_COUNT; t++)
+			{
+				textures[i][t] = UNKNOWN;
+			}
+		}
+		for (int i = 0; i < CAP_COUNT; i++)
+		{
+			caps[i] = -1;
+		}
+		blendSrc = blendDst = blendSrcAlpha = blendDstAlpha = UNKNOWN;
+		depthFunc_ = UNKNOWN;
+		depthMask_ = -1;
+		stencilFunc_ = UNKNOWN;
+		stencilRef = 0;
+		stencilFuncMask = UNKNOWN;
+		stencilFail = stencilDepthFail = stencilPass = UNKNOWN;
+		stencilMask_ = UNKNOWN;
+	}
+
+	// call once per frame, keeps the counters of the frame that just ended in lastFrame
+	void endFrame() {
+		lastFrame = current;
+		current = Stats();
+	}
+
+	const Stats& frameStats() const {
+		return lastFrame;
+	}
+
+	void useProgram(GLuint id) {
+		if (check(program, id))
+		{
+			glUseProgram(id);
+		}
+	}
+
+	void bindVertexArray(GLuint id) {
+		if (check(vertexArray, id))
+		{
+			glBindVertexArray(id);
+			// the element buffer binding belongs to the VAO
+			elementBuffer = UNKNOWN;
+		}
+	}
+
+	void bindBuffer(GLenum target, GLuint id) {
+		GLuint* slot = target == GL_ARRAY_BUFFER ? &arrayBuffer
+			: target == GL_ELEMENT_ARRAY_BUFFER ? &elementBuffer
+			: target == GL_UNIFORM_BUFFER ? &uniformBuffer
+			: target == GL_TEXTURE_BUFFER ? &textureBuffer
+			: NULL;
+		if (slot == NULL || check(*slot, id))
+		{
+			glBindBuffer(target, id);
+		}
+	}
+
+	// glBindBufferBase also changes the generic binding of the target
+	void bindBufferBase(GLenum target, GLuint index, GLuint id) {
+		glBindBufferBase(target, index, id);
+		current.issued++;
+		if (target == GL_UNIFORM_BUFFER)
+		{
+			uniformBuffer = id;
+		}
+	}
+
+	void activeTexture(GLuint unit) {
+		if (check(activeUnit, unit))
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+	}
+
+	// binds a texture to a unit, switching the active unit only when the binding actually changes
+	void bindTexture(GLuint unit, GLenum target, GLuint id) {
+		int t = targetIndex(target);
+		if (t < 0 || unit >= (GLuint)MAX_TEXTURE_UNITS)
+		{
+			activeTexture(unit);
+			glBindTexture(target, id);
+			current.issued++;
+			return;
+		}
+		if (check(textures[unit][t], id))
+		{
+			activeTexture(unit);
+			glBindTexture(target, id);
+		}
+	}
+
+	void enable(GLenum cap) {
+		setCap(cap, true);
+	}
+
+	void disable(GLenum cap) {
+		setCap(cap, false);
+	}
+
+	void blendFunc(GLenum src, GLenum dst) {
+		if (blendSrc == src && blendDst == dst && blendSrcAlpha == src && blendDstAlpha == dst)
+		{
+			current.skipped++;
+			return;
+		}
+		blendSrc = blendSrcAlpha = src;
+		blendDst = blendDstAlpha = dst;
+		current.issued++;
+		glBlendFunc(src, dst);
+	}
+
+	// different factors for the alpha channel
+	void blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha) {
+		if (blendSrc == srcRGB && blendDst == dstRGB && blendSrcAlpha == srcAlpha && blendDstAlpha == dstAlpha)
+		{
+			current.skipped++;
+			return;
+		}
+		blendSrc = srcRGB;
+		blendDst = dstRGB;
+		blendSrcAlpha = srcAlpha;
+		blendDstAlpha = dstAlpha;
+		current.issued++;
+		glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+	}
+
+	void depthFunc(GLenum func) {
+		if (check(depthFunc_, func))
+		{
+			glDepthFunc(func);
+		}
+	}
+
+	void depthMask(GLboolean flag) {
+		if (depthMask_ == (int)flag)
+		{
+			current.skipped++;
+			return;
+		}
+		depthMask_ = flag;
+		current.issued++;
+		glDepthMask(flag);
+	}
+
+	void stencilFunc(GLenum func, GLint ref, GLuint mask) {
+		if (stencilFunc_ == func && stencilRef == ref && stencilFuncMask == mask)
+		{
+			current.skipped++;
+			return;
+		}
+		stencilFunc_ = func;
+		stencilRef = ref;
+		stencilFuncMask = mask;
+		current.issued++;
+		glStencilFunc(func, ref, mask);
+	}
+
+	void stencilOp(GLenum sfail, GLenum dpfail, GLenum dppass) {
+		if (stencilFail == sfail && stencilDepthFail == dpfail && stencilPass == dppass)
+		{
+			current.skipped++;
+			return;
+		}
+		stencilFail = sfail;
+		stencilDepthFail = dpfail;
+		stencilPass = dppass;
+		current.issued++;
+		glStencilOp(sfail, dpfail, dppass);
+	}
+
+	void stencilMask(GLuint mask) {
+		if (check(stencilMask_, mask))
+		{
+			glStencilMask(mask);
+		}
+	}
+
+	// objects that get deleted may have their name reused by the driver
+	void forgetProgram(GLuint id) {
+		deletedPrograms++;
+		if (program == id)
+		{
+			program = UNKNOWN;
+		}
+	}
+
+	// programs forgotten so far: caches keyed on program names drop their entries when it changes
+	unsigned int programDeletions() const {
+		return deletedPrograms;
+	}
+
+	void forgetVertexArray(GLuint id) {
+		if (vertexArray == id)
+		{
+			vertexArray = UNKNOWN;
+		}
+	}
+
+	void forgetBuffer(GLuint id) {
+		GLuint* slots[] = { &arrayBuffer, &elementBuffer, &uniformBuffer, &textureBuffer };
+		for (GLuint* slot : slots)
+		{
+			if (*slot == id)
+			{
+				*slot = UNKNOWN;
+			}
+		}
+	}
+
+	void forgetTexture(GLuint id) {
+		for (int i = 0; i < MAX_TEXTURE_UNITS; i++)
+		{
+			for (int t = 0; t < TARGET_COUNT; t++)
+			{
+				if (textures[i][t] == id)
+				{
+					textures[i][t] = UNKNOWN;
+				}
+			}
+		}
+	}
+
+private:
+
+	enum { TARGET_COUNT = 4, CAP_COUNT = 8 };
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint arrayBuffer;
+	GLuint elementBuffer;
+	GLuint uniformBuffer;
+	GLuint textureBuffer;
+	GLuint activeUnit;
+	GLuint textures[MAX_TEXTURE_UNITS][TARGET_COUNT];
+	int caps[CAP_COUNT];
+	GLenum blendSrc, blendDst;
+	GLenum blendSrcAlpha, blendDstAlpha;
+	GLenum depthFunc_;
+	int depthMask_;
+	GLenum stencilFunc_;
+	GLint stencilRef;
+	GLuint stencilFuncMask;
+	GLenum stencilFail, stencilDepthFail, stencilPass;
+	GLuint stencilMask_;
+	unsigned int deletedPrograms;
+
+	Stats current;
+	Stats lastFrame;
+
+	GLState() : deletedPrograms(0) {
+		invalidate();
+	}
+
+	GLState(const GLState&) = delete;
+	GLState& operator=(const GLState&) = delete;
+
+	// updates the shadow value and tells if the real call is needed
+	bool check(GLuint& shadow, GLuint value) {
+		if (shadow == value)
+		{
+			current.skipped++;
+			return false;
+		}
+		shadow = value;
+		current.issued++;
+		return true;
+	}
+
+	static int targetIndex(GLenum target) {
+		switch (target)
+		{
+		case GL_TEXTURE_2D: return 0;
+		case GL_TEXTURE_CUBE_MAP: return 1;
+		case GL_TEXTURE_2D_ARRAY: return 2;
+		case GL_TEXTURE_BUFFER: return 3;
+		default: return -1;
+		}
+	}
+
+	static int capIndex(GLenum cap) {
+		switch (cap)
+		{
+		case GL_BLEND: return 0;
+		case GL_DEPTH_TEST: return 1;
+		case GL_STENCIL_TEST: return 2;
+		case GL_CULL_FACE: return 3;
+		case GL_MULTISAMPLE: return 4;
+		case GL_SCISSOR_TEST: return 5;
+		case GL_POLYGON_OFFSET_FILL: return 6;
+		case GL_RASTERIZER_DISCARD: return 7;
+		default: return -1;
+		}
+	}
+
+	void setCap(GLenum cap, bool on) {
+		int i = capIndex(cap);
+		if (i >= 0 && caps[i] == (int)on)
+		{
+			current.skipped++;
+			return;
+		}
+		if (i >= 0)
+		{
+			caps[i] = on;
+		}
+		current.issued++;
+		if (on)
+		{
+			glEnable(cap);
+		}
+		else
+		{
+			glDisable(cap);
+		}
+	}
+
+};
+
+#endif
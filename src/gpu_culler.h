@@ -0,0 +1,207 @@
+#pragma once
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "shader.h"
+#include "frustum.h"
+#include "gl_ext.h"
+#include "gl_state.h"
+#include "hiz_buffer.h"
+
+// GL 4.3 path of the instance culling: assets/shaders/instance_cull.comp tests every instance
+// sphere on the GPU and appends the visible instance records to an instance buffer, counting them straight
+// into DrawElementsIndirectCommand.instanceCount, so the CPU never touches the instances after
+// create(). Only valid when GLExt::get().hasCompute().
+// With a HiZBuffer the cull also rejects instances hidden in last frame's depth; once the survivors
+// are drawn and the pyramid rebuilt, cullDisoccluded() picks up the ones that are visible after all
+// and lateIndirectBuffer() draws them (two-phase occlusion culling).
+class GpuCuller {
+public:
+
+	static const GLuint GROUP_SIZE = 64;
+
+	// binding points of the compute shader's storage blocks
+	enum { SPHERES = 0, INSTANCES = 1, VISIBLE = 2, COMMANDS = 3, OCCLUDED = 4, EARLY_COMMANDS = 5 };
+
+	GpuCuller() : program(NULL), sphereBuffer(0), matrixBuffer(0), visibleBuffer(0), commandBuffer(0), lateCommandBuffer(0), occludedBuffer(0),
+		instanceCount(0), stride(0), occlusionPhase(false) {}
+
+	// uploads the spheres and allocates one record of stride bytes (a multiple of 4, see
+	// InstanceEncoder) per instance, which the caller writes through mapInstances(); visible receives
+	// the survivors and must hold all of them, commands are the per-mesh draws (instanceCount is
+	// rewritten every cull)
+	void create(const std::vector<glm::vec4>& spheres, GLsizei stride, GLuint visible, const std::vector<DrawElementsIndirectCommand>& commands) {
+		program = new ComputeShader("./assets/shaders/instance_cull.comp");
+		instanceCount = (GLuint)spheres.size();
+		this->stride = stride;
+		visibleBuffer = visible;
+		this->commands = commands;
+
+		GLState& state = GLState::get();
+		glGenBuffers(1, &sphereBuffer);
+		state.bindBuffer(GL_SHADER_STORAGE_BUFFER, sphereBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(glm::vec4), spheres.data(), GL_STATIC_DRAW);
+		glGenBuffers(1, &matrixBuffer);
+		state.bindBuffer(GL_SHADER_STORAGE_BUFFER, matrixBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * stride, NULL, GL_STATIC_DRAW);
+		glGenBuffers(1, &commandBuffer);
+		state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+		glGenBuffers(1, &lateCommandBuffer);
+		state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, lateCommandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+		glGenBuffers(1, &occludedBuffer);
+		state.bindBuffer(GL_SHADER_STORAGE_BUFFER, occludedBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+
+		planesLocation = glGetUniformLocation(program->ID, "planes");
+		hiZViewProjectionLocation = glGetUniformLocation(program->ID, "hiZViewProjection");
+		hiZSizeLocation = glGetUniformLocation(program->ID, "hiZSize");
+	}
+
+	// instanceCount records, write them all before unmapInstances()
+	void* mapInstances() {
+		GLState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, matrixBuffer);
+		return glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)instanceCount * stride,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	}
+
+	void unmapInstances() {
+		GLState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, matrixBuffer);
+		glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+	}
+
+	// resets the counts and culls every instance; draws issued afterwards see the results. With a
+	// built hiZ (of the previous frame) the instances it hides are held back for cullDisoccluded()
+	void cull(const Frustum& frustum, const HiZBuffer* hiZ = NULL) {
+		occlusionPhase = hiZ != NULL && hiZ->valid();
+		run(occlusionPhase ? 1 : 0, commandBuffer, frustum, hiZ);
+	}
+
+	// second phase, after the draws of cull() and hiZ rebuilt from their depth: the held back
+	// instances visible in it are appended and counted in lateIndirectBuffer(); false (nothing to
+	// draw) when cull() had no pyramid
+	bool cullDisoccluded(const HiZBuffer& hiZ) {
+		if (!occlusionPhase)
+		{
+			return false;
+		}
+		run(2, lateCommandBuffer, Frustum(), &hiZ);
+		return true;
+	}
+
+	GLuint indirectBuffer() const {
+		return commandBuffer;
+	}
+
+	GLuint lateIndirectBuffer() const {
+		return lateCommandBuffer;
+	}
+
+	// byte offset of the command of one mesh inside indirectBuffer()
+	static GLintptr commandOffset(size_t mesh) {
+		return (GLintptr)(mesh * sizeof(DrawElementsIndirectCommand));
+	}
+
+	// reads the results back, stalls until the GPU is done: only for validation and stats
+	GLuint readVisibleCount() const {
+		DrawElementsIndirectCommand command;
+		GLState::get().bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), &command);
+		return command.instanceCount;
+	}
+
+	// the visible records back to back, stride bytes each
+	void readVisible(std::vector<unsigned char>& out) const {
+		out.resize((size_t)readVisibleCount() * stride);
+		if (!out.empty())
+		{
+			GLState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, out.size(), out.data());
+		}
+	}
+
+	void destroy() {
+		if (program != NULL)
+		{
+			program->deleteShader();
+			delete program;
+			program = NULL;
+		}
+		GLState& state = GLState::get();
+		state.forgetBuffer(sphereBuffer);
+		state.forgetBuffer(matrixBuffer);
+		state.forgetBuffer(commandBuffer);
+		state.forgetBuffer(lateCommandBuffer);
+		state.forgetBuffer(occludedBuffer);
+		glDeleteBuffers(1, &sphereBuffer);
+		glDeleteBuffers(1, &matrixBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+		glDeleteBuffers(1, &lateCommandBuffer);
+		glDeleteBuffers(1, &occludedBuffer);
+		sphereBuffer = matrixBuffer = commandBuffer = lateCommandBuffer = occludedBuffer = 0;
+	}
+
+private:
+
+	ComputeShader* program;
+	GLuint sphereBuffer;
+	GLuint matrixBuffer;
+	GLuint visibleBuffer;
+	GLuint commandBuffer;
+	GLuint lateCommandBuffer;
+	GLuint occludedBuffer;
+	GLuint instanceCount;
+	GLsizei stride;
+	bool occlusionPhase; // the last cull() held instances back
+	GLint planesLocation = -1;
+	GLint hiZViewProjectionLocation = -1;
+	GLint hiZSizeLocation = -1;
+	std::vector<DrawElementsIndirectCommand> commands;
+
+	// one dispatch of instance_cull.comp counting into target
+	void run(GLuint phase, GLuint target, const Frustum& frustum, const HiZBuffer* hiZ) {
+		for (size_t i = 0; i < commands.size(); i++)
+		{
+			commands[i].instanceCount = 0;
+		}
+		GLState& state = GLState::get();
+		state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, target);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+
+		program->use();
+		if (phase != 2)
+		{
+			glUniform4fv(planesLocation, 6, &frustum.planes[0][0]);
+		}
+		program->setUint("numInstances", instanceCount);
+		program->setUint("numCommands", (GLuint)commands.size());
+		program->setUint("instanceWords", (GLuint)stride / 4);
+		program->setUint("phase", phase);
+		if (phase != 0)
+		{
+			glUniformMatrix4fv(hiZViewProjectionLocation, 1, GL_FALSE, &hiZ->getViewProjection()[0][0]);
+			program->setInt("hiZLevels", hiZ->levels());
+			glUniform2i(hiZSizeLocation, hiZ->size().x, hiZ->size().y);
+			state.bindTexture(0, GL_TEXTURE_2D, hiZ->texture());
+		}
+		state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, SPHERES, sphereBuffer);
+		state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES, matrixBuffer);
+		state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE, visibleBuffer);
+		state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS, target);
+		state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUDED, occludedBuffer);
+		state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, EARLY_COMMANDS, commandBuffer);
+		program->dispatch(instanceCount, GROUP_SIZE);
+
+		// the matrices are read as vertex attributes and the counts as draw parameters
+		GLExt::get().memoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+};
+
+#endif
@@ -0,0 +1,108 @@
+#pragma once
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+// GPU time of named sections of a frame (the passes of a RenderGraph). Each section is
+// bracketed by two GL_TIMESTAMP queries, like DynamicResolution's frame, and read back
+// FRAME_LATENCY frames later so the CPU never waits; sections past MAX_SECTIONS are not timed.
+class GpuTimer {
+public:
+
+	static const int FRAME_LATENCY = 4;
+	static const int MAX_SECTIONS = 32;
+
+	struct Section {
+		std::string name;
+		float ms;
+	};
+
+	GpuTimer() : frame(0), open(false), created(false) {}
+
+	// collects the frame from FRAME_LATENCY frames ago when it is ready, then starts a new one
+	void beginFrame() {
+		if (!created)
+		{
+			glGenQueries(FRAME_LATENCY * MAX_SECTIONS * 2, queries);
+			created = true;
+		}
+		Slot& slot = slots[frame % FRAME_LATENCY];
+		if (frame >= FRAME_LATENCY && !slot.names.empty())
+		{
+			GLuint* pair = queries + (frame % FRAME_LATENCY) * MAX_SECTIONS * 2;
+			GLint available = 0;
+			glGetQueryObjectiv(pair[slot.names.size() * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				collected.clear();
+				for (size_t i = 0; i < slot.names.size(); i++)
+				{
+					GLuint64 start, end;
+					glGetQueryObjectui64v(pair[i * 2], GL_QUERY_RESULT, &start);
+					glGetQueryObjectui64v(pair[i * 2 + 1], GL_QUERY_RESULT, &end);
+					Section section = { slot.names[i], (float)((end - start) / 1.0e6) };
+					collected.push_back(section);
+				}
+			}
+		}
+		slot.names.clear();
+	}
+
+	void begin(const std::string& name) {
+		Slot& slot = slots[frame % FRAME_LATENCY];
+		if (!created || (int)slot.names.size() >= MAX_SECTIONS)
+		{
+			return;
+		}
+		glQueryCounter(queries[((frame % FRAME_LATENCY) * MAX_SECTIONS + slot.names.size()) * 2], GL_TIMESTAMP);
+		slot.names.push_back(name);
+		open = true;
+	}
+
+	void end() {
+		if (!open)
+		{
+			return;
+		}
+		Slot& slot = slots[frame % FRAME_LATENCY];
+		glQueryCounter(queries[((frame % FRAME_LATENCY) * MAX_SECTIONS + slot.names.size() - 1) * 2 + 1], GL_TIMESTAMP);
+		open = false;
+	}
+
+	void endFrame() {
+		frame++;
+	}
+
+	// the sections of the last frame read back, in the order they ran
+	const std::vector<Section>& sections() const {
+		return collected;
+	}
+
+	void destroy() {
+		if (created)
+		{
+			glDeleteQueries(FRAME_LATENCY * MAX_SECTIONS * 2, queries);
+			created = false;
+		}
+	}
+
+private:
+
+	struct Slot {
+		std::vector<std::string> names;
+	};
+
+	GLuint queries[FRAME_LATENCY * MAX_SECTIONS * 2];
+	Slot slots[FRAME_LATENCY];
+	std::vector<Section> collected;
+	unsigned int frame;
+	bool open;
+	bool created;
+
+};
+
+#endif
@@ -0,0 +1,158 @@
+#pragma once
+#ifndef HIZ_BUFFER_H
+#define HIZ_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+
+#include "shader.h"
+#include "gl_ext.h"
+#include "gl_state.h"
+
+// Hierarchical depth: a GL_R32F mip chain where level 0 is a copy of a depth texture and each
+// texel of the next levels holds the farthest depth below it, built with
+// assets/shaders/hiz_reduce.comp. A screen rectangle is hidden when its nearest depth is farther
+// than the (at most 2x2) texels covering it at the level where it spans about one texel; the
+// culling side lives in instance_cull.comp. Needs GLExt::get().hasImageStore().
+// The texture is allocated for the largest frame; each build() covers the corner that was
+// rendered (dynamic resolution), and size() tells the culling how much of it is valid.
+class HiZBuffer {
+public:
+
+	static const GLuint GROUP_SIZE = 8;
+
+	HiZBuffer() : program(NULL), pyramid(0), width(0), height(0), levelCount(0), capacity(0), capacityLevels(0), built(false) {}
+
+	// false when the context cannot write images from compute shaders
+	bool create(int width, int height) {
+		if (!GLExt::get().hasImageStore())
+		{
+			return false;
+		}
+		program = new ComputeShader("./assets/shaders/hiz_reduce.comp");
+		glGenTextures(1, &pyramid);
+		resize(width, height);
+		return true;
+	}
+
+	// reallocates every level for frames up to width x height; the pyramid is invalid until rebuilt
+	void resize(int width, int height) {
+		capacity = glm::ivec2(width, height);
+		capacityLevels = levelsFor(capacity);
+		setSize(capacity);
+		built = false;
+
+		GLState::get().bindTexture(0, GL_TEXTURE_2D, pyramid);
+		for (int level = 0; level < capacityLevels; level++)
+		{
+			glm::ivec2 size = glm::max(capacity >> level, glm::ivec2(1));
+			glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, size.x, size.y, 0, GL_RED, GL_FLOAT, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, capacityLevels - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	// rebuilds every level from the lower left size.x x size.y of depthTexture (with
+	// GL_TEXTURE_MIN_FILTER GL_NEAREST), which was rendered with viewProjection; size fits in resize()
+	void build(GLuint depthTexture, const glm::ivec2& size, const glm::mat4& viewProjection) {
+		setSize(glm::min(size, capacity));
+		GLState& state = GLState::get();
+		GLExt& ext = GLExt::get();
+		program->use();
+		GLint sourceLevel = glGetUniformLocation(program->ID, "sourceLevel");
+		GLint sourceSize = glGetUniformLocation(program->ID, "sourceSize");
+		GLint destinationSize = glGetUniformLocation(program->ID, "destinationSize");
+		for (int level = 0; level < levelCount; level++)
+		{
+			glm::ivec2 source = levelSize(std::max(level - 1, 0));
+			glm::ivec2 destination = levelSize(level);
+			state.bindTexture(0, GL_TEXTURE_2D, level == 0 ? depthTexture : pyramid);
+			ext.bindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			glUniform1i(sourceLevel, level - 1);
+			glUniform2i(sourceSize, source.x, source.y);
+			glUniform2i(destinationSize, destination.x, destination.y);
+			ext.dispatchCompute((destination.x + GROUP_SIZE - 1) / GROUP_SIZE, (destination.y + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+			ext.memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+		this->viewProjection = viewProjection;
+		built = true;
+	}
+
+	// the pyramid no longer matches what is on screen (resize, a frame not rendered offscreen)
+	void invalidate() {
+		built = false;
+	}
+
+	bool valid() const {
+		return built;
+	}
+
+	GLuint texture() const {
+		return pyramid;
+	}
+
+	int levels() const {
+		return levelCount;
+	}
+
+	// the part of level 0 covered by the last build()
+	glm::ivec2 size() const {
+		return glm::ivec2(width, height);
+	}
+
+	// the matrix the depth of the last build() was rendered with
+	const glm::mat4& getViewProjection() const {
+		return viewProjection;
+	}
+
+	glm::ivec2 levelSize(int level) const {
+		return glm::max(glm::ivec2(width >> level, height >> level), glm::ivec2(1));
+	}
+
+	void destroy() {
+		if (program != NULL)
+		{
+			program->deleteShader();
+			delete program;
+			program = NULL;
+		}
+		GLState::get().forgetTexture(pyramid);
+		glDeleteTextures(1, &pyramid);
+		pyramid = 0;
+		built = false;
+	}
+
+private:
+
+	static int levelsFor(const glm::ivec2& size) {
+		int levels = 1;
+		while ((std::max(size.x, size.y) >> levels) > 0)
+		{
+			levels++;
+		}
+		return levels;
+	}
+
+	void setSize(const glm::ivec2& size) {
+		width = size.x;
+		height = size.y;
+		levelCount = levelsFor(size);
+	}
+
+	ComputeShader* program;
+	GLuint pyramid;
+	int width, height;
+	int levelCount;
+	glm::ivec2 capacity;
+	int capacityLevels;
+	bool built;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+
+};
+
+#endif
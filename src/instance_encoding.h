@@ -0,0 +1,216 @@
+#pragma once
+#ifndef INSTANCE_ENCODING_H
+#define INSTANCE_ENCODING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// How one instance transform is laid out in the instance buffer. Each encoding has its own vertex
+// shader (assets/shaders/instance_*.vert, decode in instance_common.glsl) reading attributes 3-6:
+//   INSTANCE_MAT4       64 B  the matrix as is                         instance_vertex.vert
+//   INSTANCE_AFFINE     48 B  the three top rows (3x4)                 instance_affine.vert
+//   INSTANCE_QUAT       32 B  position + uniform scale, quaternion     instance_quat.vert
+//   INSTANCE_QUANTIZED  16 B  unorm16 position + scale, snorm16 quat   instance_quantized.vert
+// QUAT and QUANTIZED only hold rigid transforms with a uniform scale (the asteroids); QUANTIZED
+// positions and scales are relative to a QuantizationRange the shader gets as uniforms.
+enum InstanceEncoding {
+	INSTANCE_MAT4 = 0,
+	INSTANCE_AFFINE,
+	INSTANCE_QUAT,
+	INSTANCE_QUANTIZED,
+	INSTANCE_ENCODING_COUNT
+};
+
+struct AffineInstance {
+	glm::vec4 rows[3];
+};
+
+struct QuatInstance {
+	glm::vec4 positionScale;
+	glm::vec4 rotation; // x, y, z, w
+};
+
+struct QuantizedInstance {
+	uint16_t positionScale[4];
+	int16_t rotation[4];
+};
+
+// box the quantized positions live in, and the scale interval
+struct QuantizationRange {
+	glm::vec3 origin = glm::vec3(0.0f);
+	glm::vec3 extent = glm::vec3(1.0f);
+	glm::vec2 scale = glm::vec2(0.0f, 1.0f);
+};
+
+class InstanceEncoder {
+public:
+
+	static GLsizei stride(InstanceEncoding encoding) {
+		static const GLsizei strides[INSTANCE_ENCODING_COUNT] = {
+			sizeof(glm::mat4), sizeof(AffineInstance), sizeof(QuatInstance), sizeof(QuantizedInstance)
+		};
+		return strides[encoding];
+	}
+
+	static const char* name(InstanceEncoding encoding) {
+		static const char* const names[INSTANCE_ENCODING_COUNT] = { "mat4", "affine 3x4", "position+quat+scale", "quantized" };
+		return names[encoding];
+	}
+
+	static const char* vertexShader(InstanceEncoding encoding) {
+		static const char* const paths[INSTANCE_ENCODING_COUNT] = {
+			"./assets/shaders/instance_vertex.vert",
+			"./assets/shaders/instance_affine.vert",
+			"./assets/shaders/instance_quat.vert",
+			"./assets/shaders/instance_quantized.vert"
+		};
+		return paths[encoding];
+	}
+
+	// points attributes 3-6 at the bound GL_ARRAY_BUFFER, the ones the encoding does not use are
+	// disabled; the VAO must be bound
+	static void setAttributes(InstanceEncoding encoding) {
+		GLsizei size = stride(encoding);
+		int used = 0;
+		switch (encoding)
+		{
+		case INSTANCE_MAT4:
+		case INSTANCE_AFFINE:
+			used = encoding == INSTANCE_MAT4 ? 4 : 3;
+			for (int i = 0; i < used; i++)
+			{
+				glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, size, (void*)(i * sizeof(glm::vec4)));
+			}
+			break;
+		case INSTANCE_QUAT:
+			used = 2;
+			glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, size, (void*)0);
+			glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, size, (void*)sizeof(glm::vec4));
+			break;
+		case INSTANCE_QUANTIZED:
+			used = 2;
+			glVertexAttribPointer(3, 4, GL_UNSIGNED_SHORT, GL_TRUE, size, (void*)0);
+			glVertexAttribPointer(4, 4, GL_SHORT, GL_TRUE, size, (void*)offsetof(QuantizedInstance, rotation));
+			break;
+		default:
+			break;
+		}
+		for (int i = 0; i < 4; i++)
+		{
+			if (i < used)
+			{
+				glEnableVertexAttribArray(3 + i);
+				glVertexAttribDivisor(3 + i, 1);
+			}
+			else
+			{
+				glDisableVertexAttribArray(3 + i);
+			}
+		}
+	}
+
+	// bounds of the positions and scales of count matrices
+	static QuantizationRange range(const glm::mat4* matrices, size_t count) {
+		QuantizationRange range;
+		if (count == 0)
+		{
+			return range;
+		}
+		glm::vec3 low(1e30f), high(-1e30f);
+		float lowScale = 1e30f, highScale = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::vec3 position = glm::vec3(matrices[i][3]);
+			low = glm::min(low, position);
+			high = glm::max(high, position);
+			float scale = glm::length(glm::vec3(matrices[i][0]));
+			lowScale = std::min(lowScale, scale);
+			highScale = std::max(highScale, scale);
+		}
+		range.origin = low;
+		range.extent = glm::max(high - low, glm::vec3(1e-6f));
+		range.scale = glm::vec2(lowScale, std::max(highScale, lowScale + 1e-6f));
+		return range;
+	}
+
+	// matrices [0, count) into count records of stride(encoding) bytes at out
+	static void encode(InstanceEncoding encoding, const glm::mat4* matrices, size_t count, const QuantizationRange& range, void* out) {
+		switch (encoding)
+		{
+		case INSTANCE_MAT4:
+			memcpy(out, matrices, count * sizeof(glm::mat4));
+			break;
+		case INSTANCE_AFFINE:
+			for (size_t i = 0; i < count; i++)
+			{
+				const glm::mat4& m = matrices[i];
+				AffineInstance& record = ((AffineInstance*)out)[i];
+				for (int row = 0; row < 3; row++)
+				{
+					record.rows[row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+				}
+			}
+			break;
+		case INSTANCE_QUAT:
+			for (size_t i = 0; i < count; i++)
+			{
+				float scale;
+				glm::vec4 rotation = decompose(matrices[i], scale);
+				QuatInstance& record = ((QuatInstance*)out)[i];
+				record.positionScale = glm::vec4(glm::vec3(matrices[i][3]), scale);
+				record.rotation = rotation;
+			}
+			break;
+		case INSTANCE_QUANTIZED:
+			for (size_t i = 0; i < count; i++)
+			{
+				float scale;
+				glm::vec4 rotation = decompose(matrices[i], scale);
+				glm::vec3 position = (glm::vec3(matrices[i][3]) - range.origin) / range.extent;
+				QuantizedInstance& record = ((QuantizedInstance*)out)[i];
+				for (int k = 0; k < 3; k++)
+				{
+					record.positionScale[k] = unorm16(position[k]);
+				}
+				record.positionScale[3] = unorm16((scale - range.scale.x) / (range.scale.y - range.scale.x));
+				for (int k = 0; k < 4; k++)
+				{
+					record.rotation[k] = snorm16(rotation[k]);
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+private:
+
+	// uniform scale and rotation quaternion (x, y, z, w) of a rigid transform
+	static glm::vec4 decompose(const glm::mat4& m, float& scale) {
+		scale = glm::length(glm::vec3(m[0]));
+		glm::mat3 rotation = glm::mat3(m) / std::max(scale, 1e-12f);
+		glm::quat q = glm::normalize(glm::quat_cast(rotation));
+		// q and -q are the same rotation, keep w positive so the sign never flips between instances
+		float sign = q.w < 0.0f ? -1.0f : 1.0f;
+		return glm::vec4(q.x, q.y, q.z, q.w) * sign;
+	}
+
+	static uint16_t unorm16(float v) {
+		return (uint16_t)std::lround(std::min(std::max(v, 0.0f), 1.0f) * 65535.0f);
+	}
+
+	static int16_t snorm16(float v) {
+		return (int16_t)std::lround(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f);
+	}
+
+};
+
+#endif
@@ -0,0 +1,169 @@
+#pragma once
+#ifndef LIGHT_BUFFER_H
+#define LIGHT_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+#include "shader.h"
+#include "gl_state.h"
+
+// Mirrors of the structs in assets/shaders/lighting.glsl, laid out by hand to match std140:
+// every vec3 is padded to 16 bytes by the float that follows it. Point lights are not in the
+// block but in a texture buffer of LightClusters, 4 texels each, with the range in the last float.
+struct DirLight {
+	glm::vec3 direction;
+	float pad0;
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+
+struct SpotLight {
+	glm::vec3 position;
+	float cutOff;
+	glm::vec3 direction;
+	float outerCutOff;
+	glm::vec3 ambient;
+	float constant;
+	glm::vec3 diffuse;
+	float linear;
+	glm::vec3 specular;
+	float quadratic;
+};
+
+struct PointLight {
+	glm::vec3 position;
+	float constant;
+	glm::vec3 ambient;
+	float linear;
+	glm::vec3 diffuse;
+	float quadratic;
+	glm::vec3 specular;
+	float radius;
+};
+
+static_assert(sizeof(DirLight) == 64 && sizeof(SpotLight) == 80 && sizeof(PointLight) == 64, "light structs must follow std140");
+
+// The directional and spot lights, the light cluster grid and the shadow cascades in one uniform
+// buffer ("Lights" block); the point lights are binned by LightClusters. The setters only touch the CPU copy and
+// grow a dirty byte range; upload() sends that range with a single glBufferSubData.
+class LightBuffer {
+public:
+
+	static const GLuint BINDING = 0;
+	// size of the cascade array of the block (shadowMatrices in lighting.glsl)
+	static const int MAX_CASCADES = 4;
+
+	LightBuffer() : dirtyBegin(0), dirtyEnd(sizeof(Block)) {
+		data.clusterGrid = glm::ivec4(1, 1, 1, 0);
+		data.clusterScale = glm::vec4(0.0f);
+		for (int i = 0; i < MAX_CASCADES; i++)
+		{
+			data.shadowMatrices[i] = glm::mat4(1.0f);
+		}
+		data.shadowTexelSizes = glm::vec4(0.0f);
+		data.shadowCascades = glm::ivec4(0);
+		glGenBuffers(1, &ubo);
+		GLState::get().bindBuffer(GL_UNIFORM_BUFFER, ubo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), NULL, GL_DYNAMIC_DRAW);
+		GLState::get().bindBufferBase(GL_UNIFORM_BUFFER, BINDING, ubo);
+	}
+
+	// points the program's "Lights" block at our binding point
+	void bind(const Shader& shader) const {
+		GLuint index = glGetUniformBlockIndex(shader.ID, "Lights");
+		if (index == GL_INVALID_INDEX)
+		{
+			std::cout << "ERROR::LIGHT_BUFFER:: program " << shader.ID << " has no Lights block" << std::endl;
+			return;
+		}
+		glUniformBlockBinding(shader.ID, index, BINDING);
+	}
+
+	void setDirectionalLight(const DirLight& light) {
+		data.dirLight = light;
+		markDirty(offsetof(Block, dirLight), sizeof(DirLight));
+	}
+
+	const DirLight& directionalLight() const {
+		return data.dirLight;
+	}
+
+	void setSpotLight(const SpotLight& light) {
+		data.spotLight = light;
+		markDirty(offsetof(Block, spotLight), sizeof(SpotLight));
+	}
+
+	// clusters along x, y and z; clusters per pixel in x and y, then scale and bias of the log depth slice
+	void setClusterGrid(const glm::ivec4& grid, const glm::vec4& scale) {
+		if (grid == data.clusterGrid && scale == data.clusterScale)
+		{
+			return;
+		}
+		data.clusterGrid = grid;
+		data.clusterScale = scale;
+		markDirty(offsetof(Block, clusterGrid), sizeof(glm::ivec4) + sizeof(glm::vec4));
+	}
+
+	// world to shadow map matrices (texture coordinates in xy, depth in z) and the world size of a
+	// texel of each cascade; a count of 0 leaves the directional light unshadowed
+	void setShadowCascades(const glm::mat4* matrices, int count, const glm::vec4& texelSizes) {
+		for (int i = 0; i < count; i++)
+		{
+			data.shadowMatrices[i] = matrices[i];
+		}
+		data.shadowTexelSizes = texelSizes;
+		data.shadowCascades = glm::ivec4(count, 0, 0, 0);
+		markDirty(offsetof(Block, shadowMatrices), sizeof(glm::mat4) * MAX_CASCADES + sizeof(glm::vec4) + sizeof(glm::ivec4));
+	}
+
+	// call once per frame after the lights changed, does nothing when nothing is dirty
+	void upload() {
+		if (dirtyBegin >= dirtyEnd)
+		{
+			return;
+		}
+		GLState::get().bindBuffer(GL_UNIFORM_BUFFER, ubo);
+		glBufferSubData(GL_UNIFORM_BUFFER, dirtyBegin, dirtyEnd - dirtyBegin, (const char*)&data + dirtyBegin);
+		dirtyBegin = sizeof(Block);
+		dirtyEnd = 0;
+	}
+
+	void destroy() {
+		GLState::get().forgetBuffer(ubo);
+		glDeleteBuffers(1, &ubo);
+	}
+
+private:
+
+	struct Block {
+		DirLight dirLight;
+		SpotLight spotLight;
+		glm::ivec4 clusterGrid;
+		glm::vec4 clusterScale;
+		glm::mat4 shadowMatrices[MAX_CASCADES];
+		glm::vec4 shadowTexelSizes;
+		glm::ivec4 shadowCascades;
+	};
+
+	Block data;
+	GLuint ubo;
+	size_t dirtyBegin;
+	size_t dirtyEnd;
+
+	void markDirty(size_t offset, size_t size) {
+		dirtyBegin = std::min(dirtyBegin, offset);
+		dirtyEnd = std::max(dirtyEnd, offset + size);
+	}
+
+};
+
+#endif
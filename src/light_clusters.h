@@ -0,0 +1,385 @@
+#pragma once
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "gl_state.h"
+#include "frustum.h"
+#include "parallel.h"
+#include "light_buffer.h"
+
+// Clustered forward shading: the view frustum is cut into GRID_X x GRID_Y screen tiles and
+// GRID_Z depth slices, exponential between the near and far planes so clusters stay roughly
+// cubic, and every fragment only loops over the point lights of its cluster (shade() in
+// lighting.glsl). build() runs on the CPU each frame: the lights are frustum culled 8 (AVX) or
+// 4 (SSE) at a time by FrustumCuller::cullSpheres, then every depth slice, one ThreadPool chunk
+// each, bins the lights that reach it into its tiles using the screen rectangle of the sphere
+// at that slice's depth. Slices are merged in order, so the lists do not depend on the thread
+// count. GL 3.3 has no storage buffers, so the shader reads everything from texture buffers:
+// the lights (4 RGBA32F texels each, the PointLight struct as is), per cluster an offset and a
+// count (RG32UI) and the light indices (R16UI). The grid itself goes in the Lights block.
+class LightClusters {
+public:
+
+	static const int GRID_X = 16;
+	static const int GRID_Y = 9;
+	static const int GRID_Z = 24;
+	static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+	// indices are 16 bit
+	static const int MAX_POINT_LIGHTS = 65535;
+	// texture units of pointLightTexture, clusterTexture and lightIndexTexture
+	static const GLuint LIGHT_UNIT = 13;
+	static const GLuint CLUSTER_UNIT = 14;
+	static const GLuint INDEX_UNIT = 15;
+	static const size_t CHUNK_SIZE = 1024;
+
+	struct Stats {
+		unsigned int lights = 0;
+		unsigned int visible = 0;
+		unsigned int references = 0;        // light indices over all clusters
+		unsigned int maxPerCluster = 0;
+		double assignMs = 0.0;
+	};
+
+	LightClusters() : lightsDirty(true) {
+		buffers[0] = buffers[1] = buffers[2] = 0;
+		textures[0] = textures[1] = textures[2] = 0;
+		capacities[0] = capacities[1] = capacities[2] = 0;
+	}
+
+	void create() {
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+		const GLenum formats[] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+		GLState& state = GLState::get();
+		for (int i = 0; i < 3; i++)
+		{
+			state.bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+			glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+			state.bindTexture(LIGHT_UNIT + i, GL_TEXTURE_BUFFER, textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+		}
+	}
+
+	// returns the index of the new light, or -1 when there are too many; a radius of 0 is
+	// replaced by the distance where the light fades under 1/256
+	int addPointLight(const PointLight& light) {
+		if ((int)lights.size() >= MAX_POINT_LIGHTS)
+		{
+			std::cout << "ERROR::LIGHT_CLUSTERS:: more than " << MAX_POINT_LIGHTS << " point lights" << std::endl;
+			return -1;
+		}
+		lights.push_back(light);
+		setPointLight((int)lights.size() - 1, light);
+		return (int)lights.size() - 1;
+	}
+
+	void setPointLight(int index, const PointLight& light) {
+		lights[index] = light;
+		if (light.radius <= 0.0f)
+		{
+			lights[index].radius = range(light);
+		}
+		lightsDirty = true;
+	}
+
+	void setPointLightPosition(int index, const glm::vec3& position) {
+		lights[index].position = position;
+		lightsDirty = true;
+	}
+
+	void clearPointLights() {
+		lights.clear();
+		lightsDirty = true;
+	}
+
+	int pointLightCount() const {
+		return (int)lights.size();
+	}
+
+	const PointLight& pointLight(int index) const {
+		return lights[index];
+	}
+
+	// bins the lights into the clusters of this view, uploads the lists and writes the grid
+	// into lightBuffer; nearPlane and farPlane must be the ones of projection and of linearizeDepth
+	void build(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane, const glm::ivec2& viewport, LightBuffer& lightBuffer) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		frameStats = Stats();
+		frameStats.lights = (unsigned int)lights.size();
+		float zScale = GRID_Z / std::log(farPlane / nearPlane);
+		float zBias = -std::log(nearPlane) * zScale;
+		lightBuffer.setClusterGrid(glm::ivec4(GRID_X, GRID_Y, GRID_Z, 0),
+			glm::vec4((float)GRID_X / viewport.x, (float)GRID_Y / viewport.y, zScale, zBias));
+
+		cullLights(projection * view);
+		ThreadPool& pool = ThreadPool::get();
+		size_t visibleCount = visible.size();
+		viewLights.resize(visibleCount);
+		pool.parallelFor(visibleCount, CHUNK_SIZE, [&](size_t, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				const PointLight& light = lights[visible[i]];
+				ViewLight& v = viewLights[i];
+				glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+				v.center = glm::vec3(center.x, center.y, -center.z);
+				v.radius = light.radius;
+				v.firstSlice = slice(std::max(v.center.z - v.radius, nearPlane), zScale, zBias);
+				v.lastSlice = slice(std::min(v.center.z + v.radius, farPlane), zScale, zBias);
+			}
+		});
+
+		// each slice fills its own tiles, then the slices are laid out one after the other
+		pool.parallelFor(GRID_Z, 1, [&](size_t z, size_t, size_t) {
+			binSlice((int)z, nearPlane, farPlane, glm::vec2(projection[0][0], projection[1][1]));
+		});
+		uint32_t offset = 0;
+		for (int z = 0; z < GRID_Z; z++)
+		{
+			sliceOffsets[z] = offset;
+			offset += (uint32_t)slices[z].indices.size();
+		}
+		indices.resize(offset);
+		pool.parallelFor(GRID_Z, 1, [&](size_t z, size_t, size_t) {
+			const Slice& s = slices[z];
+			size_t base = (size_t)z * GRID_X * GRID_Y;
+			for (int tile = 0; tile < GRID_X * GRID_Y; tile++)
+			{
+				clusters[(base + tile) * 2] = sliceOffsets[z] + s.offsets[tile];
+				clusters[(base + tile) * 2 + 1] = s.counts[tile];
+			}
+			std::copy(s.indices.begin(), s.indices.end(), indices.begin() + sliceOffsets[z]);
+		});
+		for (int z = 0; z < GRID_Z; z++)
+		{
+			frameStats.maxPerCluster = std::max(frameStats.maxPerCluster, slices[z].maxCount);
+		}
+		frameStats.visible = (unsigned int)visibleCount;
+		frameStats.references = offset;
+		frameStats.assignMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		upload();
+	}
+
+	// the three buffer textures on their units, before drawing anything lit
+	void bindTextures() const {
+		GLState& state = GLState::get();
+		for (int i = 0; i < 3; i++)
+		{
+			state.bindTexture(LIGHT_UNIT + i, GL_TEXTURE_BUFFER, textures[i]);
+		}
+	}
+
+	const Stats& stats() const {
+		return frameStats;
+	}
+
+	// indices of the lights that passed the frustum test in the last build()
+	const std::vector<uint32_t>& visibleLights() const {
+		return visible;
+	}
+
+	void destroy() {
+		GLState& state = GLState::get();
+		for (int i = 0; i < 3; i++)
+		{
+			state.forgetTexture(textures[i]);
+			state.forgetBuffer(buffers[i]);
+		}
+		glDeleteTextures(3, textures);
+		glDeleteBuffers(3, buffers);
+	}
+
+private:
+
+	struct ViewLight {
+		glm::vec3 center;                   // view space, z is the distance in front of the camera
+		float radius;
+		int firstSlice, lastSlice;
+	};
+
+	struct Slice {
+		uint32_t offsets[GRID_X * GRID_Y];
+		uint32_t counts[GRID_X * GRID_Y];
+		std::vector<uint16_t> indices;
+		std::vector<glm::ivec4> rects;      // tiles covered by each light of the slice
+		std::vector<uint16_t> lightsIn;
+		unsigned int maxCount;
+	};
+
+	std::vector<PointLight> lights;
+	bool lightsDirty;
+	std::vector<float> centerX, centerY, centerZ, radii;
+	std::vector<std::vector<uint32_t> > chunkVisible;
+	std::vector<uint32_t> visible;
+	std::vector<ViewLight> viewLights;
+	Slice slices[GRID_Z];
+	uint32_t sliceOffsets[GRID_Z];
+	uint32_t clusters[CLUSTER_COUNT * 2];
+	std::vector<uint16_t> indices;
+	GLuint buffers[3];
+	GLuint textures[3];
+	size_t capacities[3];
+	Stats frameStats;
+
+	// solves constant + linear d + quadratic d^2 = 256 * brightest channel
+	static float range(const PointLight& light) {
+		glm::vec3 peak = glm::max(glm::max(light.ambient, light.diffuse), light.specular);
+		float brightest = std::max(std::max(peak.x, peak.y), peak.z);
+		float c = light.constant - 256.0f * brightest;
+		if (c >= 0.0f)
+		{
+			return 0.0f;
+		}
+		if (light.quadratic <= 0.0f)
+		{
+			return light.linear > 0.0f ? -c / light.linear : 1.0e4f;
+		}
+		return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+	}
+
+	static int slice(float depth, float zScale, float zBias) {
+		return std::min(std::max((int)std::floor(std::log(depth) * zScale + zBias), 0), GRID_Z - 1);
+	}
+
+	void cullLights(const glm::mat4& viewProjection) {
+		size_t count = lights.size();
+		centerX.resize(count);
+		centerY.resize(count);
+		centerZ.resize(count);
+		radii.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			centerX[i] = lights[i].position.x;
+			centerY[i] = lights[i].position.y;
+			centerZ[i] = lights[i].position.z;
+			radii[i] = lights[i].radius;
+		}
+		Frustum frustum(viewProjection);
+		ThreadPool& pool = ThreadPool::get();
+		chunkVisible.resize(ThreadPool::chunkCount(count, CHUNK_SIZE));
+		pool.parallelFor(count, CHUNK_SIZE, [&](size_t chunk, size_t begin, size_t end) {
+			chunkVisible[chunk].clear();
+			FrustumCuller::cullSpheres(frustum, centerX.data(), centerY.data(), centerZ.data(), radii.data(), begin, end - begin, chunkVisible[chunk]);
+		});
+		visible.clear();
+		for (size_t c = 0; c < chunkVisible.size(); c++)
+		{
+			visible.insert(visible.end(), chunkVisible[c].begin(), chunkVisible[c].end());
+		}
+	}
+
+	// counts, then fills, the tiles of slice z with the lights whose sphere reaches it
+	void binSlice(int z, float nearPlane, float farPlane, const glm::vec2& focal) {
+		Slice& s = slices[z];
+		float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float)z / GRID_Z);
+		float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / GRID_Z);
+		s.rects.clear();
+		s.lightsIn.clear();
+		std::fill(s.counts, s.counts + GRID_X * GRID_Y, 0u);
+		for (size_t i = 0; i < viewLights.size(); i++)
+		{
+			const ViewLight& v = viewLights[i];
+			if (z < v.firstSlice || z > v.lastSlice)
+			{
+				continue;
+			}
+			// the widest cross section of the sphere inside the slice, seen from its nearest and farthest depth
+			float zNear = std::max(std::max(sliceNear, v.center.z - v.radius), nearPlane);
+			float zFar = std::min(sliceFar, v.center.z + v.radius);
+			if (zFar < zNear)
+			{
+				continue;
+			}
+			float gap = v.center.z < zNear ? zNear - v.center.z : v.center.z > zFar ? v.center.z - zFar : 0.0f;
+			float r = std::sqrt(std::max(v.radius * v.radius - gap * gap, 0.0f));
+			glm::ivec4 rect(tile(v.center.x - r, zNear, zFar, focal.x, GRID_X, false), tile(v.center.y - r, zNear, zFar, focal.y, GRID_Y, false),
+				tile(v.center.x + r, zNear, zFar, focal.x, GRID_X, true), tile(v.center.y + r, zNear, zFar, focal.y, GRID_Y, true));
+			if (rect.x > rect.z || rect.y > rect.w)
+			{
+				continue;
+			}
+			s.rects.push_back(rect);
+			s.lightsIn.push_back((uint16_t)visible[i]);
+			for (int ty = rect.y; ty <= rect.w; ty++)
+			{
+				for (int tx = rect.x; tx <= rect.z; tx++)
+				{
+					s.counts[ty * GRID_X + tx]++;
+				}
+			}
+		}
+		uint32_t total = 0;
+		s.maxCount = 0;
+		for (int tile = 0; tile < GRID_X * GRID_Y; tile++)
+		{
+			s.offsets[tile] = total;
+			total += s.counts[tile];
+			s.maxCount = std::max(s.maxCount, s.counts[tile]);
+		}
+		s.indices.resize(total);
+		uint32_t cursor[GRID_X * GRID_Y];
+		std::copy(s.offsets, s.offsets + GRID_X * GRID_Y, cursor);
+		for (size_t l = 0; l < s.rects.size(); l++)
+		{
+			const glm::ivec4& rect = s.rects[l];
+			for (int ty = rect.y; ty <= rect.w; ty++)
+			{
+				for (int tx = rect.x; tx <= rect.z; tx++)
+				{
+					s.indices[cursor[ty * GRID_X + tx]++] = s.lightsIn[l];
+				}
+			}
+		}
+	}
+
+	// tile of a view space edge between the depths zNear and zFar: the most outward of its two
+	// projections, so the rectangle covers the whole depth range
+	static int tile(float edge, float zNear, float zFar, float focal, int tiles, bool upper) {
+		float a = edge / zNear;
+		float b = edge / zFar;
+		float ndc = focal * (upper ? std::max(a, b) : std::min(a, b));
+		float t = (ndc * 0.5f + 0.5f) * tiles;
+		if (upper)
+		{
+			return std::min((int)std::floor(t), tiles - 1);
+		}
+		return std::max((int)std::floor(t), 0);
+	}
+
+	// orphans and refills the buffers that changed; they only grow
+	void upload() {
+		if (lightsDirty)
+		{
+			fill(0, lights.size() * sizeof(PointLight), lights.data());
+			lightsDirty = false;
+		}
+		fill(1, sizeof(clusters), clusters);
+		fill(2, indices.size() * sizeof(uint16_t), indices.data());
+	}
+
+	void fill(int i, size_t size, const void* data) {
+		GLState::get().bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		if (size > capacities[i])
+		{
+			capacities[i] = std::max(size, capacities[i] * 2);
+		}
+		glBufferData(GL_TEXTURE_BUFFER, capacities[i], NULL, GL_STREAM_DRAW);
+		if (size > 0)
+		{
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+		}
+	}
+
+};
+
+#endif
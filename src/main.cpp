@@ -1,6 +1,8 @@
 #include <iostream>
 #include <cstdio>
 #include <string>
+#include <cmath>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -13,32 +15,71 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "model.h"
-#include <map>
+#include "shader_watcher.h"
+#include "gl_state.h"
+#include "gl_ext.h"
+#include "light_buffer.h"
+#include "shader_uniforms.h"
+#include "render_queue.h"
+#include "frustum.h"
+#include "asteroid_field.h"
+#include "multi_draw_model.h"
+#include "occlusion_culler.h"
+#include "hiz_buffer.h"
+#include "transparency_pass.h"
+#include "oit_pass.h"
+#include "render_targets.h"
+#include "dynamic_resolution.h"
+#include "post_process.h"
+#include "render_graph.h"
+#include "light_clusters.h"
+#include "deferred_shading.h"
+#include "gpu_timer.h"
+#include "shadow_maps.h"
+#include "simulation.h"
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void displayFps(int* frameTime, double* previousCount);
+// de onde o displayFps tira os contadores, preenchido uma vez antes do loop
+struct DebugStats {
+	const RenderQueue* queue;
+	const FrustumCuller* culler;
+	const OcclusionCuller* occlusion;
+	const TransparencyPass* transparency;
+	const RenderTargets* sceneTargets;
+	const DynamicResolution* resolution;
+	const PostProcessChain* postProcess;
+	const RenderGraph* frameGraph;
+	const LightClusters* lightClusters;
+	const GpuTimer* passTimer;
+	const CascadedShadowMaps* shadowMaps;
+	const Simulation* simulation;
+	const ThreadTiming* renderTiming;
+};
+void displayFps(int* frameTime, double* previousCount, const DebugStats& debug);
+void drawOcclusionBuffer(const OcclusionCuller& culler, const Shader& screenShader, GLuint quadVAO, GLuint texture);
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 unsigned int load_textures(std::string path);
-void setDirectionalLight(Shader& shader);
-void setPointLights(Shader& shader);
-void setSpotLight(Shader& shader);
+void setDirectionalLight(LightBuffer& lights);
+void setPointLights(LightClusters& clusters);
+void addLightField(LightClusters& clusters);
+void lightFieldPositions(std::vector<glm::vec3>& positions, float time);
+void moveLightField(LightClusters& clusters, const std::vector<glm::vec3>& previous, const std::vector<glm::vec3>& positions, float alpha);
+void setSpotLight(LightBuffer& lights, const Camera& camera);
 void drawInitialCubesAndLight(Shader& shader, Shader& lightShader, GLuint diffuseMap, GLuint specularMap, glm::vec3 cubePositions[], GLuint* VAO, GLuint* lightVAO);
 void setUpInitalCubesAndLights(GLuint* VAO, GLuint* VBO, GLuint* lightVAO, float vertices[], int verticesSize);
 GLuint loadCubemap(std::vector<std::string> faces);
-// camera
+// camera: depois do loop comecar, so a thread da simulacao mexe nela
 Camera camera(glm::vec3(0.0f, 1.0f, 4.0f));
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
-
-// timing
-float deltaTime = 0.0f;	// time between current frame and last frame
-float lastFrame = 0.0f;
+// teclado e mouse lidos na thread da janela, entregues a simulacao a cada frame
+InputState input;
 
 glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
 
@@ -50,6 +91,55 @@ glm::vec3 pointLightPositions[] = {
 };
 bool blinn = false;
 bool blinnKeyPressed = false;
+// G alterna o culling dos asteroides entre CPU e compute shader (GL 4.3), V compara os dois
+bool gpuCulling = true;
+bool gpuCullingKeyPressed = false;
+bool validateCulling = false;
+bool validateKeyPressed = false;
+// E troca a codificacao das instancias dos asteroides (64/48/32/16 bytes), K mede todas
+int instanceEncoding = INSTANCE_MAT4;
+bool encodingKeyPressed = false;
+bool benchmarkEncodings = false;
+bool benchmarkKeyPressed = false;
+// O liga/desliga o occlusion culling na CPU (o planeta esconde o que esta atras), P mostra o buffer dele
+bool occlusionCulling = true;
+bool occlusionKeyPressed = false;
+bool showOcclusionBuffer = false;
+bool occlusionViewKeyPressed = false;
+// H liga/desliga o Hi-Z dos asteroides no culling da GPU (profundidade do frame anterior + segunda passada);
+// ligado, a cena e desenhada no framebuffer e copiada pra tela no fim
+bool hiZCulling = true;
+bool hiZKeyPressed = false;
+// C mostra no console, uma vez por segundo, o fps e os contadores de cada parte do frame
+bool showStats = false;
+bool statsKeyPressed = false;
+// T liga/desliga um campo de 100k vidros (teste de carga da passada transparente)
+bool glassField = false;
+bool glassFieldKeyPressed = false;
+// L liga milhares de luzes pontuais no cinturao, pra medir o clustered forward
+bool lightField = false;
+bool lightFieldKeyPressed = false;
+const int LIGHT_FIELD_COUNT = 4096;
+// I troca a passada transparente ordenada pela OIT weighted blended (sem ordenar por profundidade)
+bool oitTransparency = false;
+bool oitKeyPressed = false;
+// M troca o forward dos opacos pelo deferred (G-buffer compacto, luzes pontuais como volumes)
+bool deferredShading = false;
+bool deferredKeyPressed = false;
+// J liga as sombras da luz direcional (cascatas; a parte estatica fica guardada entre frames)
+bool shadowsEnabled = true;
+bool shadowsKeyPressed = false;
+// U alterna o vsync: com a simulacao em passos fixos o desenho pode ficar limitado ao monitor ou livre
+bool vsync = true;
+bool vsyncKeyPressed = false;
+// R liga a resolucao dinamica (a escala da cena segue o tempo de GPU do frame), F alterna a ampliacao bilinear/nitida
+bool dynamicResolution = false;
+bool dynamicResolutionKeyPressed = false;
+bool sharpenUpscale = true;
+bool sharpenKeyPressed = false;
+// 1 blur, 2 bordas (o kernel 3x3 que o framebuffer_fragment.frag calculava e jogava fora), 3 tons de cinza, 4 vinheta
+bool postEffectEnabled[4] = { false, false, false, false };
+bool postEffectKeyPressed[4] = { false, false, false, false };
 
 int main(void)
 {
@@ -61,7 +151,8 @@ int main(void)
 	GLFWwindow* window;
 
 	// DIRETIVAS PARA INICIALIZAR A JANELA
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	// tenta 4.3 (culling por compute shader) e cai para 3.3 se o driver nao tiver
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -77,6 +168,12 @@ int main(void)
 	/* Create a windowed mode window and its OpenGL context */
 	window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Hello World", NULL, NULL);
 	if (window == NULL)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Hello World", NULL, NULL);
+	}
+	if (window == NULL)
 	{
 		std::cout << "Failed to create GLFW window" << std::endl;
 		glfwTerminate();
@@ -98,6 +195,7 @@ int main(void)
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	GLExt::get().load((GLADloadproc)glfwGetProcAddress);
 
 	//faces dos cubos
 	float cubeVertices[] = {
@@ -169,14 +267,14 @@ int main(void)
 	};
 
 	float windowVertices[] = {
-		// positions          // texture Coords
-		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-		 0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+		// positions          // normals         // texture Coords
+		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+		 0.5f, -0.5f, -0.5f,  0.0f, 0.0f, 1.0f,  1.0f, 0.0f,
+		 0.5f,  0.5f, -0.5f,  0.0f, 0.0f, 1.0f,  1.0f, 1.0f,
+
+		 0.5f,  0.5f, -0.5f,  0.0f, 0.0f, 1.0f,  1.0f, 1.0f,
+		-0.5f,  0.5f, -0.5f,  0.0f, 0.0f, 1.0f,  0.0f, 1.0f,
+		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f, 1.0f,  0.0f, 0.0f,
 	};
 
 	float quadVertices[] = { // vertex attributes for a quad that fills the entire screen in Normalized Device Coordinates.
@@ -244,16 +342,90 @@ int main(void)
 	windows.push_back(glm::vec3(0.5f, 0.0f, -0.6f));
 
 
-	glm::vec3 lightPos(0.0f, 0.0f, 0.0f);
-
 	//inicalizando shader
 	Shader shader("./assets/shaders/vertex_shader.vert", "./assets/shaders/fragment_shader.frag", "");
 	Shader instanceShader("./assets/shaders/instance_vertex.vert", "./assets/shaders/fragment_shader.frag", "");
+	Shader instanceAffineShader(InstanceEncoder::vertexShader(INSTANCE_AFFINE), "./assets/shaders/fragment_shader.frag", "");
+	Shader instanceQuatShader(InstanceEncoder::vertexShader(INSTANCE_QUAT), "./assets/shaders/fragment_shader.frag", "");
+	Shader instanceQuantizedShader(InstanceEncoder::vertexShader(INSTANCE_QUANTIZED), "./assets/shaders/fragment_shader.frag", "");
+	Shader multidrawShader("./assets/shaders/multidraw_vertex.vert", "./assets/shaders/multidraw_fragment.frag", "");
+	//um programa por codificacao de instancia, indexado por InstanceEncoding
+	Shader* instanceShaders[INSTANCE_ENCODING_COUNT] = { &instanceShader, &instanceAffineShader, &instanceQuatShader, &instanceQuantizedShader };
 	Shader normalShader("./assets/shaders/normal_vertex.vert", "./assets/shaders/normal_fragment.frag", "./assets/shaders/normal_geometry.geom");
 	Shader lightShader("./assets/shaders/light_vertex.vert", "./assets/shaders/light_fragment.frag", "");
 	Shader outlineShader("./assets/shaders/light_vertex.vert", "./assets/shaders/outline_fragment.frag", "");
 	Shader screenShader("./assets/shaders/framebuffer_vertex.vert", "./assets/shaders/framebuffer_fragment.frag", "");
 	Shader skyboxShader("./assets/shaders/skybox_vertex.vert", "./assets/shaders/skybox_fragment.frag", "");
+	Shader oitShader("./assets/shaders/instance_vertex.vert", "./assets/shaders/oit_fragment.frag", "");
+	//janelas forward: programa proprio, os asteroides podem usar o instanceShader no G-buffer
+	Shader windowShader("./assets/shaders/instance_vertex.vert", "./assets/shaders/fragment_shader.frag", "");
+	Shader compositeShader("./assets/shaders/framebuffer_vertex.vert", "./assets/shaders/oit_composite.frag", "");
+	Shader deferredShader("./assets/shaders/framebuffer_vertex.vert", "./assets/shaders/deferred_lighting.frag", "");
+	Shader volumeShader("./assets/shaders/light_volume.vert", "./assets/shaders/light_volume.frag", "");
+	//so profundidade, vista da luz: o chao, o planeta e as janelas, e os asteroides em cada codificacao
+	Shader shadowShader("./assets/shaders/vertex_shader.vert", "./assets/shaders/shadow_depth.frag", "");
+	Shader shadowInstanceShader("./assets/shaders/instance_vertex.vert", "./assets/shaders/shadow_depth.frag", "");
+	Shader shadowAffineShader(InstanceEncoder::vertexShader(INSTANCE_AFFINE), "./assets/shaders/shadow_depth.frag", "");
+	Shader shadowQuatShader(InstanceEncoder::vertexShader(INSTANCE_QUAT), "./assets/shaders/shadow_depth.frag", "");
+	Shader shadowQuantizedShader(InstanceEncoder::vertexShader(INSTANCE_QUANTIZED), "./assets/shaders/shadow_depth.frag", "");
+	Shader* shadowInstanceShaders[INSTANCE_ENCODING_COUNT] = { &shadowInstanceShader, &shadowAffineShader, &shadowQuatShader, &shadowQuantizedShader };
+
+	//efeitos de tela entre a cena e a janela; a correcao de cor comeca neutra, entao e descartada ate mudar
+	int windowWidth, windowHeight;
+	glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
+	PostProcessChain postProcess;
+	postProcess.create();
+	size_t postEffects[4];
+	postEffects[0] = postProcess.add(POST_BLUR, glm::vec4(6.0f, 0.0f, 0.0f, 0.0f), false);
+	postEffects[1] = postProcess.add(POST_EDGES, glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), false);
+	postProcess.add(POST_GRADE, glm::vec4(1.0f, 1.0f, 1.0f, 0.0f));
+	postEffects[2] = postProcess.add(POST_GRAYSCALE, glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), false);
+	postEffects[3] = postProcess.add(POST_VIGNETTE, glm::vec4(0.6f, 0.0f, 0.0f, 0.0f), false);
+
+	//recompila os shaders quando os arquivos mudam, sem reiniciar
+	ShaderWatcher shaderWatcher;
+	shaderWatcher.watch(shader);
+	for (int i = 0; i < INSTANCE_ENCODING_COUNT; i++)
+	{
+		shaderWatcher.watch(*instanceShaders[i]);
+	}
+	shaderWatcher.watch(multidrawShader);
+	shaderWatcher.watch(normalShader);
+	shaderWatcher.watch(lightShader);
+	shaderWatcher.watch(outlineShader);
+	shaderWatcher.watch(screenShader);
+	shaderWatcher.watch(skyboxShader);
+	shaderWatcher.watch(oitShader);
+	shaderWatcher.watch(windowShader);
+	shaderWatcher.watch(compositeShader);
+	shaderWatcher.watch(deferredShader);
+	shaderWatcher.watch(volumeShader);
+	shaderWatcher.watch(shadowShader);
+	for (int i = 0; i < INSTANCE_ENCODING_COUNT; i++)
+	{
+		shaderWatcher.watch(*shadowInstanceShaders[i]);
+	}
+	shaderWatcher.watch(postProcess.shader());
+	shaderWatcher.start();
+
+	//luz direcional, spot e a grade de clusters num unico uniform buffer, compartilhado pelos programas que usam lighting.glsl
+	LightBuffer lights;
+	lights.bind(shader);
+	for (int i = 0; i < INSTANCE_ENCODING_COUNT; i++)
+	{
+		lights.bind(*instanceShaders[i]);
+	}
+	lights.bind(multidrawShader);
+	lights.bind(oitShader);
+	lights.bind(windowShader);
+	lights.bind(deferredShader);
+	lights.bind(volumeShader);
+	setDirectionalLight(lights);
+	//luzes pontuais: distribuidas em clusters (tiles da tela x fatias de profundidade) a cada frame
+	LightClusters lightClusters;
+	lightClusters.create();
+	setPointLights(lightClusters);
+	bool lightFieldShown = false;
 
 	////VERTEX BUFFER OBJECT, VERTEX ARRAY OBJECT, ELEMENT BUFFER OBJECT
 	GLuint lightVAO;
@@ -293,10 +465,12 @@ int main(void)
 	glBindVertexArray(windowVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, grassVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(windowVertices), &windowVertices, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
 	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+	glEnableVertexAttribArray(2);
 	glBindVertexArray(0);
 	//QUAD VAO
 	glGenVertexArrays(1, &quadVAO);
@@ -320,32 +494,14 @@ int main(void)
 	glBindVertexArray(0);
 
 
-	GLuint framebuffer;
-	glGenFramebuffers(1, &framebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-
-	GLuint textureColorbuffer;
-	glGenTextures(1, &textureColorbuffer);
-	glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 800, 600, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureColorbuffer, 0);
-
-	GLuint rbo;
-	glGenRenderbuffers(1, &rbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, 800, 600);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
-
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	//cena fora da tela: cor e profundidade em texturas (o Hi-Z le a profundidade), do tamanho da janela
+	float aspect = windowHeight > 0 ? (float)windowWidth / (float)windowHeight : (float)SCR_WIDTH / (float)SCR_HEIGHT;
+	RenderTargets sceneTargets;
+	if (!sceneTargets.create(windowWidth, windowHeight))
 	{
 		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	DynamicResolution resolution;
 
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
@@ -366,10 +522,68 @@ int main(void)
 	GLuint windowTexture = load_textures("./assets/sprites/window.png");
 
 
-	shader.use();
-	shader.setInt("material.texture_diffuse1", 0);
-	shader.setFloat("time", glfwGetTime());
-	//shader.setInt("material.texture_specular1", 1);
+	//uniforms tipados, gerados a partir dos shaders (make uniforms)
+	SceneUniforms sceneUniforms;
+	sceneUniforms.material.texture_diffuse1 = 0;
+	sceneUniforms.material.texture_specular1 = 1;
+	InstanceUniforms instanceUniforms;
+	instanceUniforms.material.texture_diffuse1 = 0;
+	instanceUniforms.material.texture_specular1 = 1;
+	MultidrawUniforms multidrawUniforms;
+	multidrawUniforms.materialTextures = 0;
+	InstanceUniforms windowUniforms;
+	windowUniforms.material.texture_diffuse1 = 0;
+	windowUniforms.material.texture_specular1 = 1;
+	OitUniforms oitUniforms;
+	oitUniforms.material.texture_diffuse1 = 0;
+	oitUniforms.material.texture_specular1 = 1;
+	sceneUniforms.pointLightTexture = LightClusters::LIGHT_UNIT;
+	sceneUniforms.clusterTexture = LightClusters::CLUSTER_UNIT;
+	sceneUniforms.lightIndexTexture = LightClusters::INDEX_UNIT;
+	instanceUniforms.pointLightTexture = LightClusters::LIGHT_UNIT;
+	instanceUniforms.clusterTexture = LightClusters::CLUSTER_UNIT;
+	instanceUniforms.lightIndexTexture = LightClusters::INDEX_UNIT;
+	multidrawUniforms.pointLightTexture = LightClusters::LIGHT_UNIT;
+	multidrawUniforms.clusterTexture = LightClusters::CLUSTER_UNIT;
+	multidrawUniforms.lightIndexTexture = LightClusters::INDEX_UNIT;
+	windowUniforms.pointLightTexture = LightClusters::LIGHT_UNIT;
+	windowUniforms.clusterTexture = LightClusters::CLUSTER_UNIT;
+	windowUniforms.lightIndexTexture = LightClusters::INDEX_UNIT;
+	oitUniforms.pointLightTexture = LightClusters::LIGHT_UNIT;
+	oitUniforms.clusterTexture = LightClusters::CLUSTER_UNIT;
+	oitUniforms.lightIndexTexture = LightClusters::INDEX_UNIT;
+	CompositeUniforms compositeUniforms;
+	compositeUniforms.accumTexture = 0;
+	compositeUniforms.weightTexture = 1;
+	//G-buffer nas unidades 0 (albedo), 1 (normal) e 2 (profundidade), a soma das luzes pontuais na 3, ver deferred_shading.h
+	DeferredUniforms deferredUniforms;
+	deferredUniforms.albedoTexture = 0;
+	deferredUniforms.normalTexture = 1;
+	deferredUniforms.depthTexture = 2;
+	deferredUniforms.pointLighting = 3;
+	VolumeUniforms volumeUniforms;
+	volumeUniforms.albedoTexture = 0;
+	volumeUniforms.normalTexture = 1;
+	volumeUniforms.depthTexture = 2;
+	volumeUniforms.pointLightTexture = LightClusters::LIGHT_UNIT;
+	//mapa de sombras (array de cascatas) na unidade 12, ver shadow_maps.h
+	sceneUniforms.shadowMap = CascadedShadowMaps::SHADOW_UNIT;
+	instanceUniforms.shadowMap = CascadedShadowMaps::SHADOW_UNIT;
+	multidrawUniforms.shadowMap = CascadedShadowMaps::SHADOW_UNIT;
+	windowUniforms.shadowMap = CascadedShadowMaps::SHADOW_UNIT;
+	oitUniforms.shadowMap = CascadedShadowMaps::SHADOW_UNIT;
+	deferredUniforms.shadowMap = CascadedShadowMaps::SHADOW_UNIT;
+	ShadowUniforms shadowUniforms;
+	shadowUniforms.casterTexture = 0;
+	ShadowInstanceUniforms shadowInstanceUniforms;
+	shadowInstanceUniforms.casterTexture = 0;
+
+	//os draws do frame sao gravados com uma chave de ordenacao e executados em ordem de estado
+	RenderQueue renderQueue;
+	//so o que esta dentro do frustum entra na fila
+	FrustumCuller frustumCuller;
+	Bounds floorBounds(glm::vec3(-10.0f, -0.5f, -10.0f), glm::vec3(10.0f, -0.5f, 10.0f));
+	Bounds windowBounds(glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, 0.5f, -0.5f));
 	// MODEL = MEU OBJETO, PROJECTION = TIPO DE PERSPECTIVA, VIEW = CAMERA
 	double previousTime = glfwGetTime();
 	int frameCount = 0;
@@ -380,86 +594,248 @@ int main(void)
 	glEnable(GL_STENCIL_TEST);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	unsigned int amount = 1000;
-	glm::mat4* modelMatrices;
-	modelMatrices = new glm::mat4[amount];
-	srand(glfwGetTime());
-	float radius = 15.0f;
-	float offset = 2.5f;
-	for (int i = 0; i < amount; i++)
-	{
-		glm::mat4 model = glm::mat4(1.0f);
-
-		float angle = (float)i / (float)amount * 360.0f;
-		float displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-		float x = sin(angle) * radius + displacement;
-		displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-		float y = cos(angle) * radius + displacement;
-		displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-		float z = cos(angle) * radius + displacement;
-		model = glm::translate(model, glm::vec3(x, rand()%5/3, z));
-
-		float scale = (rand() % 20) / 100.0f + 0.05f;
-		model = glm::scale(model, glm::vec3(scale));
-
-		float rotAngle = (rand() % 360);
-		model = glm::rotate(model, glm::radians(rotAngle), glm::vec3(0.4, 0.6, 0.8));
-
-		modelMatrices[i] = model;
-
-	}
+	//cinturao gerado de forma deterministica (mesma seed, mesmo cinturao) e em paralelo
+	BeltParams belt;
+	belt.seed = 1234;
+	belt.count = 100000;
+	belt.radius = 50.0f;
+	belt.width = 10.0f;
+	belt.height = 1.0f;
+	belt.minScale = 0.05f;
+	belt.maxScale = 0.25f;
 
 
 	 Model planet = Model("./assets/models/planet/planet.obj");
 	 Model asteroid = Model("./assets/models/rock/rock.obj");
 
-	 //instance  buffering for each asteroid - mat4 is divided into 4 vec4 (shader limitaions)
-	 GLuint buffer;
-	 glBindVertexArray(0);
-
-	 glGenBuffers(1, &buffer);
-	 glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	 glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * amount, &modelMatrices[0], GL_STATIC_DRAW);
-	 for (size_t i = 0; i < asteroid.meshes.size(); i++)
+	 //planeta inteiro num unico glMultiDrawElementsIndirect (GL 4.3), senao um draw por mesh
+	 MultiDrawModel planetDraw;
+	 bool planetMultiDraw = planetDraw.create(planet);
+	 std::cout << "planeta: " << planet.meshes.size() << " meshes em " << (planetMultiDraw ? 1 : planet.meshes.size()) << " draw(s)" << std::endl;
+
+	 //o planeta e rasterizado na CPU a cada frame; asteroides e windows atras dele nem entram na fila
+	 glm::mat4 planetModel = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -3.0f, -30.0f)), glm::vec3(4.0f));
+	 OcclusionCuller occlusionCuller;
+	 occlusionCuller.addOccluder(planet, planetModel);
+	 GLuint occlusionTexture;
+	 glGenTextures(1, &occlusionTexture);
+	 glBindTexture(GL_TEXTURE_2D, occlusionTexture);
+	 glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, OcclusionCuller::WIDTH, OcclusionCuller::HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	 //o cinturao inteiro fica na CPU; a cada frame so as instancias visiveis vao pro buffer
+	 AsteroidField asteroidField;
+	 double placementStart = glfwGetTime();
+	 asteroidField.createBelt(belt, asteroid.bounds);
+	 std::cout << belt.count << " asteroides gerados em " << (glfwGetTime() - placementStart) * 1000.0 << " ms" << std::endl;
+	 asteroidField.attach(asteroid);
+	 if (asteroidField.enableGpuCulling(asteroid))
 	 {
-		 GLuint VAO = asteroid.meshes[i].VAO;
-		 glBindVertexArray(VAO);
-
-		 size_t vec4Size = sizeof(glm::vec4);
-		 glEnableVertexAttribArray(3);
-		 glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-		 glEnableVertexAttribArray(4);
-		 glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)));
-		 glEnableVertexAttribArray(5);
-		 glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-		 glEnableVertexAttribArray(6);
-		 glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-		 //skip 1 by 1 in each matrix
-		 glVertexAttribDivisor(3, 1);
-		 glVertexAttribDivisor(4, 1);
-		 glVertexAttribDivisor(5, 1);
-		 glVertexAttribDivisor(6, 1);
-
-		 glBindVertexArray(0);
+		 //confere o compute shader contra o culling da CPU uma vez, da posicao inicial da camera
+		 glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+		 frustumCuller.setFrustum(projection * camera.getViewMatrix());
+		 asteroidField.validateGpuCulling(frustumCuller, camera.position, camera.front, 80.0f);
 	 }
+	 //piramide de profundidade do framebuffer; os asteroides que ela esconde voltam numa segunda fila se reaparecerem
+	 HiZBuffer hiZ;
+	 bool hiZReady = hiZ.create(sceneTargets.size().x, sceneTargets.size().y);
+	 RenderQueue lateQueue;
+
+	 //transparentes: profundidade + radix sort de chaves de 32 bits, um draw instanciado por sequencia de mesmo material
+	 TransparencyPass transparency;
+	 DrawMaterial windowMaterial = { windowTexture, 0, GL_TEXTURE_2D };
+	 uint32_t windowKind = transparency.addKind(windowVAO, windowMaterial, GL_TRIANGLES, 6, false);
+	 std::vector<glm::mat4> glassModels;
+	 for (int i = 0; i < 100000; i++)
+	 {
+		 glm::vec3 position((i % 100) * 2.0f - 100.0f, (i / 10000) * 2.0f + 2.0f, -((i / 100) % 100) * 2.0f);
+		 glassModels.push_back(glm::translate(glm::mat4(1.0f), position));
+	 }
+	 //alternativa sem ordenacao: acumula as camadas transparentes em dois alvos e compoe no framebuffer
+	 WeightedBlendedOIT oit;
+	 //as passadas depois da cena (OIT, depuracao, efeitos) declaradas a cada frame; os alvos intermediarios vem do pool do grafo
+	 RenderGraph frameGraph;
+	 //caminho deferred dos opacos, passadas declaradas no grafo quando ligado
+	 DeferredShading deferred;
+	 deferred.create();
+	 //tempo de GPU de cada passada do grafo, lido alguns frames depois
+	 GpuTimer passTimer;
+	 frameGraph.setTimer(&passTimer);
+	 //sombras da luz direcional; os casters de cada cascata passam por um culler proprio
+	 CascadedShadowMaps shadowMaps;
+	 shadowMaps.create();
+	 FrustumCuller shadowCuller;
+
+	 //simulacao numa thread propria, em passos fixos de 1/120 s: camera, modelos e culling do chao e das windows, luzes que se movem.
+	 //a thread da janela (a do GL) so le a entrada, pega o pacote mais novo e desenha entre os dois ultimos passos
+	 FrustumCuller simulationCuller;
+	 Camera previousCamera = camera;
+	 std::vector<glm::vec3> previousLightPositions, lightPositions;
+	 std::vector<uint32_t> previousVisible;
+	 Simulation simulation;
+	 ThreadTiming renderTiming;
+	 input.aspect = aspect;
+	 simulation.start([&](const InputState& state, double time, float deltaTime) {
+		 previousCamera = camera;
+		 for (int i = 0; i < 6; i++)
+		 {
+			 if (state.move[i])
+			 {
+				 camera.processKeyboard((Camera_Movement)i, deltaTime);
+			 }
+		 }
+		 if (state.look != glm::vec2(0.0f))
+		 {
+			 camera.processMouseMovement(state.look.x, state.look.y);
+		 }
+		 if (state.scroll != 0.0f)
+		 {
+			 camera.ProcessMouseScroll(state.scroll);
+		 }
+		 if (state.movingLights)
+		 {
+			 if (lightPositions.empty())
+			 {
+				 lightFieldPositions(lightPositions, (float)(time - deltaTime));
+			 }
+			 previousLightPositions.swap(lightPositions);
+			 lightFieldPositions(lightPositions, (float)time);
+		 }
+		 else
+		 {
+			 previousLightPositions.clear();
+			 lightPositions.clear();
+		 }
+	 }, [&](FramePacket& packet, const InputState& state) {
+		 packet.previousCamera = previousCamera;
+		 packet.camera = camera;
+		 packet.previousLightPositions = previousLightPositions;
+		 packet.lightPositions = lightPositions;
+		 //floor (indice 0) e windows (1..n) testados num unico lote, contra as cameras dos dois passos:
+		 //a camera desenhada fica entre elas
+		 packet.instances.resize(windows.size());
+		 for (size_t i = 0; i < windows.size(); i++)
+		 {
+			 packet.instances[i] = glm::translate(glm::mat4(1.0f), windows[i]);
+		 }
+		 for (int step = 0; step < 2; step++)
+		 {
+			 Camera& stepCamera = step == 0 ? previousCamera : camera;
+			 simulationCuller.setFrustum(glm::perspective(glm::radians(stepCamera.zoom), state.aspect, 0.1f, 100.0f) * stepCamera.getViewMatrix());
+			 simulationCuller.add(floorBounds, glm::mat4(1.0f));
+			 for (size_t i = 0; i < windows.size(); i++)
+			 {
+				 simulationCuller.add(windowBounds, packet.instances[i]);
+			 }
+			 if (step == 0)
+			 {
+				 previousVisible = simulationCuller.cull();
+			 }
+			 else
+			 {
+				 const std::vector<uint32_t>& visible = simulationCuller.cull();
+				 packet.visible.resize(previousVisible.size() + visible.size());
+				 packet.visible.resize(std::set_union(previousVisible.begin(), previousVisible.end(), visible.begin(), visible.end(),
+					 packet.visible.begin()) - packet.visible.begin());
+			 }
+		 }
+	 }, 120.0f);
+
+	 glfwSwapInterval(1);
+	 bool swapInterval = true;
+
+	DebugStats debugStats;
+	debugStats.queue = &renderQueue;
+	debugStats.culler = &frustumCuller;
+	debugStats.occlusion = &occlusionCuller;
+	debugStats.transparency = &transparency;
+	debugStats.sceneTargets = &sceneTargets;
+	debugStats.resolution = &resolution;
+	debugStats.postProcess = &postProcess;
+	debugStats.frameGraph = &frameGraph;
+	debugStats.lightClusters = &lightClusters;
+	debugStats.passTimer = &passTimer;
+	debugStats.shadowMaps = &shadowMaps;
+	debugStats.simulation = &simulation;
+	debugStats.renderTiming = &renderTiming;
+
+	// everything above talked to GL directly, start the state cache from scratch
+	GLState& glState = GLState::get();
+	glState.invalidate();
 
 	/* Loop until the user closes the window */
 	while (!glfwWindowShouldClose(window))
 	{
-		//displayFps(&frameCount, &previousTime);
+		if (showStats)
+		{
+			displayFps(&frameCount, &previousTime, debugStats);
+		}
+		else
+		{
+			//a contagem recomeca quando o C liga de novo
+			frameCount = 0;
+			previousTime = glfwGetTime();
+		}
 		// per-frame time logic
-		float currentFrame = static_cast<float>(glfwGetTime());
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		double frameStart = glfwGetTime();
 		// input
 		processInput(window);
 
+		// swap in any shader rebuilt since the last frame
+		shaderWatcher.update();
+
 		/* Render here */
 
 		// desenhando no frame
-		//glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		//a janela mudou de tamanho (minimizada fica 0x0 e nao muda nada): as texturas da cena, o Hi-Z e a OIT acompanham
+		glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
+		if (sceneTargets.resize(windowWidth, windowHeight))
+		{
+			aspect = (float)windowWidth / (float)windowHeight;
+			if (hiZReady)
+			{
+				hiZ.resize(windowWidth, windowHeight);
+			}
+		}
+		//entrada pra simulacao, e o pacote mais novo dela; sem pacote novo o anterior e desenhado de novo
+		input.aspect = aspect;
+		input.movingLights = lightField;
+		simulation.setInput(input);
+		input.look = glm::vec2(0.0f);
+		input.scroll = 0.0f;
+		bool freshPacket = simulation.acquire();
+		const FramePacket& packet = simulation.packet();
+		float blend = simulation.interpolation(packet);
+		Camera frameCamera = packet.cameraAt(blend);
+		if (swapInterval != vsync)
+		{
+			glfwSwapInterval(vsync ? 1 : 0);
+			swapInterval = vsync;
+		}
+		resolution.beginFrame();
+		passTimer.beginFrame();
+		if (!dynamicResolution)
+		{
+			resolution.reset();
+		}
+		sceneTargets.setScale(resolution.scale());
+		asteroidField.setGpuCulling(gpuCulling);
+		bool hiZActive = hiZCulling && hiZReady && asteroidField.gpuCulling();
+		bool oitActive = oitTransparency;
+		bool deferredActive = deferredShading;
+		for (int i = 0; i < 4; i++)
+		{
+			postProcess.effect(postEffects[i]).enabled = postEffectEnabled[i];
+		}
+		//Hi-Z, OIT e deferred leem a profundidade do framebuffer, a resolucao dinamica amplia a cena e os efeitos leem a cor,
+		//entao ela e desenhada nele; sem nada disso vai direto pra tela
+		bool offscreen = hiZActive || oitActive || deferredActive || dynamicResolution || postProcess.active();
+		if (!hiZActive)
+		{
+			//a profundidade do framebuffer deixou de ser a da tela
+			hiZ.invalidate();
+		}
 		//glEnable(GL_DEPTH_TEST);
 
 		//DEFININDO O BRILHO MATERIAL DO OBJETO
@@ -468,38 +844,152 @@ int main(void)
 		/*outlineShader.use();
 		outlineShader.setMat4("view", view);
 		outlineShader.setMat4("projection", projection);
-		outlineShader.setVec3("viewPos", camera.position);*/
+		outlineShader.setVec3("viewPos", frameCamera.position);*/
 
 		// PERSPECTIVA DA CAMERA
-		glm::mat4  view = camera.getViewMatrix();
-		glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		shader.use();
-		shader.setMat4("view", view);
-		shader.setMat4("projection", projection);
-		shader.setVec3("viewPos", camera.position);
-		shader.setVec3("lightPos", lightPos);
-		shader.setBool("blinn", blinn);
+		glm::mat4 view = frameCamera.getViewMatrix();
+		glm::mat4 projection = glm::perspective(glm::radians(frameCamera.zoom), aspect, 0.1f, 100.0f);
+		sceneUniforms.view = view;
+		sceneUniforms.projection = projection;
+		sceneUniforms.viewPos = frameCamera.position;
+		sceneUniforms.blinn = blinn;
+		instanceUniforms.view = view;
+		instanceUniforms.projection = projection;
+		instanceUniforms.viewPos = frameCamera.position;
+		instanceUniforms.blinn = blinn;
+		multidrawUniforms.view = view;
+		multidrawUniforms.projection = projection;
+		multidrawUniforms.viewPos = frameCamera.position;
+		multidrawUniforms.blinn = blinn;
+		windowUniforms.view = view;
+		windowUniforms.projection = projection;
+		windowUniforms.viewPos = frameCamera.position;
+		windowUniforms.blinn = blinn;
+		oitUniforms.view = view;
+		oitUniforms.projection = projection;
+		oitUniforms.viewPos = frameCamera.position;
+		oitUniforms.blinn = blinn;
+		//no deferred os opacos so gravam o G-buffer; a luz vem depois, reconstruindo a posicao pela profundidade
+		sceneUniforms.gbufferPass = deferredActive;
+		multidrawUniforms.gbufferPass = deferredActive;
+		deferredUniforms.inverseViewProjection = glm::inverse(projection * view);
+		deferredUniforms.viewportSize = glm::vec2(sceneTargets.renderSize());
+		deferredUniforms.viewPos = frameCamera.position;
+		deferredUniforms.blinn = blinn;
+		volumeUniforms.viewProjection = projection * view;
+		volumeUniforms.inverseViewProjection = glm::inverse(projection * view);
+		volumeUniforms.viewportSize = glm::vec2(sceneTargets.renderSize());
+		volumeUniforms.viewPos = frameCamera.position;
+		volumeUniforms.blinn = blinn;
+		instanceUniforms.instanceOrigin = asteroidField.quantization().origin;
+		instanceUniforms.instanceExtent = asteroidField.quantization().extent;
+		instanceUniforms.instanceScale = asteroidField.quantization().scale;
+		if (benchmarkEncodings)
+		{
+			asteroidField.benchmarkEncodings(asteroid, 10, [&](InstanceEncoding encoding) {
+				instanceShaders[encoding]->use();
+				instanceUniforms.apply(*instanceShaders[encoding]);
+			});
+			benchmarkEncodings = false;
+		}
+		if (asteroidField.instanceEncoding() != instanceEncoding)
+		{
+			asteroidField.setEncoding((InstanceEncoding)instanceEncoding, asteroid);
+			//a codificacao quantizada muda um pouco as posicoes, as cascatas estaticas sao refeitas
+			shadowMaps.invalidateStatic();
+			std::cout << "instancias: " << InstanceEncoder::name(asteroidField.instanceEncoding()) << std::endl;
+		}
+		Shader& asteroidShader = *instanceShaders[asteroidField.instanceEncoding()];
 
+		// the spot light follows the camera, only its range of the buffer is sent
+		setSpotLight(lights, frameCamera);
+		//campo de luzes pro benchmark (L): entra e sai inteiro, depois so as posicoes mudam
+		if (lightField != lightFieldShown)
+		{
+			setPointLights(lightClusters);
+			if (lightField)
+			{
+				addLightField(lightClusters);
+			}
+			lightFieldShown = lightField;
+		}
+		//posicoes calculadas pela simulacao; no frame em que o campo liga ela ainda nao sabe
+		if (lightField && !packet.lightPositions.empty())
+		{
+			moveLightField(lightClusters, packet.previousLightPositions, packet.lightPositions, blend);
+		}
+		lightClusters.build(view, projection, 0.1f, 100.0f, sceneTargets.renderSize(), lights);
+		lightClusters.bindTextures();
+		DrawMaterial floorMaterial = { floorTexture, 0, GL_TEXTURE_2D };
+		//sombras antes do culling da camera: os asteroides de cada cascata usam o mesmo buffer de instancias.
+		//chao, planeta e cinturao sao estaticos (so redesenhados quando a cascata muda), as janelas por cima a cada frame
+		if (shadowsEnabled)
+		{
+			shadowInstanceUniforms.instanceOrigin = asteroidField.quantization().origin;
+			shadowInstanceUniforms.instanceExtent = asteroidField.quantization().extent;
+			shadowInstanceUniforms.instanceScale = asteroidField.quantization().scale;
+			Shader& shadowAsteroidShader = *shadowInstanceShaders[asteroidField.instanceEncoding()];
+			passTimer.begin("shadows");
+			shadowMaps.render(view, projection, lights, [&](RenderQueue& queue, const Frustum& frustum) {
+				if (frustum.containsSphere(floorBounds.center, floorBounds.radius))
+				{
+					queue.submit(PASS_OPAQUE, shadowShader, planeVAO, floorMaterial, GL_TRIANGLES, 6, false, glm::mat4(1.0f));
+				}
+				shadowCuller.setFrustum(frustum);
+				planet.submit(queue, shadowShader, planetModel, shadowCuller);
+				asteroidField.submitShadow(queue, frustum, shadowAsteroidShader, asteroid);
+			}, [&](RenderQueue& queue, const Frustum& frustum) {
+				for (size_t i = 0; i < windows.size(); i++)
+				{
+					if (frustum.containsSphere(windows[i] + windowBounds.center, windowBounds.radius))
+					{
+						queue.submit(PASS_OPAQUE, shadowShader, windowVAO, windowMaterial, GL_TRIANGLES, 6, false,
+							glm::translate(glm::mat4(1.0f), windows[i]));
+					}
+				}
+			}, [&](const glm::mat4& lightView, const glm::mat4& lightProjection) {
+				shadowUniforms.view = lightView;
+				shadowUniforms.projection = lightProjection;
+				shadowShader.use();
+				shadowUniforms.apply(shadowShader);
+				shadowInstanceUniforms.view = lightView;
+				shadowInstanceUniforms.projection = lightProjection;
+				shadowAsteroidShader.use();
+				shadowInstanceUniforms.apply(shadowAsteroidShader);
+			});
+			passTimer.end();
+		}
+		else
+		{
+			shadowMaps.disable(lights);
+		}
+		shadowMaps.bindTexture();
+		lights.upload();
 
-		glm::mat4 model = glm::mat4(1.0f);
-		//model = glm::translate(model, glm::vec3(-10.0f, 0.01f, -1.0f));
-		shader.setMat4("model", model);
-		//planet.draw(shader);
-		/*
-		instanceShader.use();
-		instanceShader.setMat4("view", view);
-		instanceShader.setMat4("projection", projection);	
-		instanceShader.setVec3("viewPos", camera.position);
-		instanceShader.setInt("material.texture_diffuse1", 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, asteroid.texturesLoaded[0].id);
-		for (size_t i = 0; i < asteroid.meshes.size(); i++)
-		{
-			glBindVertexArray(asteroid.meshes[i].VAO);
-			glDrawElementsInstanced(GL_TRIANGLES, asteroid.meshes[i].indices.size(), GL_UNSIGNED_INT, 0, amount);
-			glBindVertexArray(0);
-
-		}*/
+		frustumCuller.setFrustum(projection * view);
+		OcclusionCuller* occlusion = NULL;
+		if (occlusionCulling)
+		{
+			occlusionCuller.render(projection * view);
+			occlusion = &occlusionCuller;
+		}
+		renderQueue.begin(view, 100.0f);
+		if (planetMultiDraw)
+		{
+			planetDraw.submit(renderQueue, multidrawShader, planetModel, frustumCuller.getFrustum());
+		}
+		else
+		{
+			planet.submit(renderQueue, shader, planetModel, frustumCuller);
+		}
+		//asteroides: culling paralelo (ou na GPU), so os sobreviventes sao desenhados
+		if (validateCulling)
+		{
+			asteroidField.validateGpuCulling(frustumCuller, frameCamera.position, frameCamera.front, 80.0f);
+			validateCulling = false;
+		}
+		asteroidField.cull(frustumCuller, frameCamera.position, frameCamera.front, 80.0f, occlusion, hiZActive ? &hiZ : NULL);
+		asteroidField.submit(renderQueue, asteroidShader, asteroid);
 		// then draw model with normal visualizing geometry shader
 		/*normalShader.use();
 		normalShader.setMat4("projection", projection);
@@ -507,14 +997,136 @@ int main(void)
 		normalShader.setMat4("model", model);
 
 		backpack.draw(normalShader);*/
+		//floor (indice 0) e windows (1..n): modelos e culling vem prontos da simulacao
+		const std::vector<glm::mat4>& windowModels = packet.instances;
+		const std::vector<uint32_t>& visible = packet.visible;
+		frustumCuller.addStats((unsigned int)visible.size(), (unsigned int)(windowModels.size() + 1 - visible.size()));
+		transparency.begin(view, 100.0f);
+		unsigned int occluded = 0;
+		for (size_t i = 0; i < visible.size(); i++)
+		{
+			if (occlusion != NULL && !occlusion->testBounds(visible[i] == 0 ? floorBounds : windowBounds,
+				visible[i] == 0 ? glm::mat4(1.0f) : windowModels[visible[i] - 1]))
+			{
+				occluded++;
+				continue;
+			}
+			if (visible[i] == 0)
+			{
+				renderQueue.submit(PASS_OPAQUE, shader, planeVAO, floorMaterial, GL_TRIANGLES, 6, false, glm::mat4(1.0f));
+			}
+			else
+			{
+				//windows, desenhadas de tras pra frente na passada transparente
+				transparency.submit(windowKind, windowModels[visible[i] - 1]);
+			}
+		}
+		if (glassField)
+		{
+			//culling e gravacao em paralelo, um pedaco do campo por thread
+			transparency.submit(windowKind, glassModels.data(), glassModels.size(), frustumCuller.getFrustum(), windowBounds);
+		}
+		if (oitActive)
+		{
+			transparency.sortByKind();
+		}
+		else
+		{
+			transparency.sort();
+		}
+		if (occlusion != NULL)
+		{
+			occlusion->addStats((unsigned int)visible.size(), occluded);
+		}
+
+		//asteroides no G-buffer junto com o resto; as janelas continuam forward no windowShader
+		instanceUniforms.gbufferPass = deferredActive;
+		asteroidShader.use();
+		instanceUniforms.apply(asteroidShader);
+		windowShader.use();
+		windowUniforms.apply(windowShader);
+		multidrawShader.use();
+		multidrawUniforms.apply(multidrawShader);
 		shader.use();
-		 //floor
-		glActiveTexture(GL_TEXTURE0);
-		glBindVertexArray(planeVAO);
-		glBindTexture(GL_TEXTURE_2D, floorTexture);
-		shader.setMat4("model", glm::mat4(1.0f));
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		glBindVertexArray(0);
+		sceneUniforms.apply(shader);
+		renderQueue.sort();
+
+		//o frame pelo grafo: a cena (ou a tela, sem framebuffer) e importada, o grafo cria os alvos intermediarios
+		frameGraph.reset();
+		RenderResource backbuffer = frameGraph.importBackbuffer(windowWidth, windowHeight);
+		TextureDesc sceneColorDesc = { sceneTargets.size().x, sceneTargets.size().y, GL_RGB8, GL_LINEAR };
+		TextureDesc sceneDepthDesc = { sceneTargets.size().x, sceneTargets.size().y, GL_DEPTH24_STENCIL8, GL_NEAREST };
+		RenderResource sceneColor = offscreen ? frameGraph.import("scene color", sceneTargets.colorTexture(), sceneColorDesc) : backbuffer;
+		RenderResource sceneDepth = frameGraph.import("scene depth", sceneTargets.depthTexture(), sceneDepthDesc);
+		glm::ivec2 sceneViewport = sceneTargets.renderSize();
+		//o ceu nao tem superficie pro G-buffer: no deferred ele vai depois da luz, com os transparentes
+		RenderPass lastOpaque = deferredActive ? PASS_OPAQUE : PASS_SKY;
+		std::function<void()> drawOpaque = [&]() {
+			renderQueue.execute(PASS_OPAQUE, lastOpaque);
+			if (hiZActive)
+			{
+				//piramide da profundidade deste frame: segunda passada agora e primeira do proximo frame
+				hiZ.build(sceneTargets.depthTexture(), sceneTargets.renderSize(), projection * view);
+				if (asteroidField.cullDisoccluded(hiZ))
+				{
+					lateQueue.begin(view, 100.0f);
+					asteroidField.submitDisoccluded(lateQueue, asteroidShader, asteroid);
+					lateQueue.sort();
+					lateQueue.execute();
+				}
+			}
+		};
+		if (deferredActive)
+		{
+			deferredShader.use();
+			deferredUniforms.apply(deferredShader);
+			volumeShader.use();
+			volumeUniforms.apply(volumeShader);
+			deferred.addPasses(frameGraph, sceneColor, sceneDepth, sceneViewport, drawOpaque, deferredShader, volumeShader, quadVAO,
+				lightClusters, glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+		}
+		else
+		{
+			frameGraph.addPass("opaque", [&](RenderGraph&) {
+				glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				drawOpaque();
+			}).write(sceneColor).depthStencil(sceneDepth, true).viewport(sceneViewport);
+		}
+		frameGraph.addPass("transparent", [&](RenderGraph&) {
+			renderQueue.execute((RenderPass)(lastOpaque + 1), PASS_TRANSPARENT);
+			if (!oitActive)
+			{
+				transparency.execute(windowShader);
+			}
+		}).write(sceneColor).depthStencil(sceneDepth, false).viewport(sceneViewport);
+		if (oitActive)
+		{
+			oitShader.use();
+			oitUniforms.apply(oitShader);
+			compositeShader.use();
+			compositeUniforms.apply(compositeShader);
+			oit.addPasses(frameGraph, sceneColor, sceneDepth, sceneViewport, [&]() {
+				GLState::get().useProgram(oitShader.ID);
+				transparency.draw(oitShader);
+			}, compositeShader, quadVAO);
+		}
+		if (occlusion != NULL && showOcclusionBuffer)
+		{
+			frameGraph.addPass("occlusion buffer", [&](RenderGraph&) {
+				drawOcclusionBuffer(occlusionCuller, screenShader, quadVAO, occlusionTexture);
+			}).write(sceneColor).sideEffect();
+		}
+		if (offscreen)
+		{
+			//framebuffer pra tela pelos efeitos (a tela e multisample, entao quads em vez de glBlitFramebuffer);
+			//com resolucao dinamica o ultimo passe amplia o canto desenhado, bilinear ou com nitidez
+			postProcess.addPasses(frameGraph, sceneTargets, sceneColor, backbuffer, quadVAO, sharpenUpscale ? 0.5f : 0.0f);
+		}
+		frameGraph.compile();
+		frameGraph.execute();
+		passTimer.endFrame();
+		resolution.endFrame();
 
 
 		//// cube 1
@@ -554,11 +1166,15 @@ int main(void)
 		//glDisable(GL_DEPTH_TEST);
 
 		// Swap the back buffer with the front buffer
+		double swapStart = glfwGetTime();
 		glfwSwapBuffers(window);
 		/* Poll for and process events */
 		glfwPollEvents();
+		glState.endFrame();
+		renderTiming.add(swapStart - frameStart, glfwGetTime() - swapStart, !freshPacket, glfwGetTime());
 
 	}
+	simulation.stop();
 	glDeleteVertexArrays(1, &lightVAO);
 	glDeleteVertexArrays(1, &cubeVAO);
 	glDeleteVertexArrays(1, &planeVAO);
@@ -566,8 +1182,21 @@ int main(void)
 	glDeleteBuffers(1, &cubeVBO);
 	glDeleteBuffers(1, &planeVBO);
 	glDeleteBuffers(1, &quadVBO);
-	glDeleteRenderbuffers(1, &rbo);
-	glDeleteFramebuffers(1, &framebuffer);
+	sceneTargets.destroy();
+	resolution.destroy();
+	glDeleteTextures(1, &occlusionTexture);
+	shaderWatcher.stop();
+	lights.destroy();
+	lightClusters.destroy();
+	asteroidField.destroy();
+	planetDraw.destroy();
+	hiZ.destroy();
+	frameGraph.destroy();
+	deferred.destroy();
+	shadowMaps.destroy();
+	passTimer.destroy();
+	postProcess.destroy();
+	transparency.destroy();
 	shader.deleteShader();
 	lightShader.deleteShader();
 
@@ -586,22 +1215,15 @@ void processInput(GLFWwindow* window)
 
 	glfwSetScrollCallback(window, scroll_callback);
 
-	float cameraSpeed = 2.5f * deltaTime;
-
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		camera.processKeyboard(FORWARD, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		camera.processKeyboard(BACKWARD, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		camera.processKeyboard(LEFT, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		camera.processKeyboard(RIGHT, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-		camera.processKeyboard(UP, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-		camera.processKeyboard(DOWN, deltaTime);
+	//o movimento e aplicado pela simulacao, aqui so as teclas seguradas
+	input.move[FORWARD] = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+	input.move[BACKWARD] = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+	input.move[LEFT] = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+	input.move[RIGHT] = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+	input.move[UP] = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+	input.move[DOWN] = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
 	if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS && !blinnKeyPressed)
 	{
 		blinn = !blinn;
@@ -611,6 +1233,162 @@ void processInput(GLFWwindow* window)
 	{
 		blinnKeyPressed = false;
 	}
+	if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && !gpuCullingKeyPressed)
+	{
+		gpuCulling = !gpuCulling;
+		gpuCullingKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE)
+	{
+		gpuCullingKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS && !validateKeyPressed)
+	{
+		validateCulling = true;
+		validateKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_V) == GLFW_RELEASE)
+	{
+		validateKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS && !encodingKeyPressed)
+	{
+		instanceEncoding = (instanceEncoding + 1) % INSTANCE_ENCODING_COUNT;
+		encodingKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_RELEASE)
+	{
+		encodingKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && !benchmarkKeyPressed)
+	{
+		benchmarkEncodings = true;
+		benchmarkKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_K) == GLFW_RELEASE)
+	{
+		benchmarkKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !occlusionKeyPressed)
+	{
+		occlusionCulling = !occlusionCulling;
+		occlusionKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
+	{
+		occlusionKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !occlusionViewKeyPressed)
+	{
+		showOcclusionBuffer = !showOcclusionBuffer;
+		occlusionViewKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)
+	{
+		occlusionViewKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS && !statsKeyPressed)
+	{
+		showStats = !showStats;
+		statsKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_RELEASE)
+	{
+		statsKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS && !hiZKeyPressed)
+	{
+		hiZCulling = !hiZCulling;
+		hiZKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_H) == GLFW_RELEASE)
+	{
+		hiZKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS && !glassFieldKeyPressed)
+	{
+		glassField = !glassField;
+		glassFieldKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_RELEASE)
+	{
+		glassFieldKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !lightFieldKeyPressed)
+	{
+		lightField = !lightField;
+		lightFieldKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_L) == GLFW_RELEASE)
+	{
+		lightFieldKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && !oitKeyPressed)
+	{
+		oitTransparency = !oitTransparency;
+		oitKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE)
+	{
+		oitKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS && !deferredKeyPressed)
+	{
+		deferredShading = !deferredShading;
+		deferredKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_M) == GLFW_RELEASE)
+	{
+		deferredKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS && !shadowsKeyPressed)
+	{
+		shadowsEnabled = !shadowsEnabled;
+		shadowsKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_J) == GLFW_RELEASE)
+	{
+		shadowsKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS && !vsyncKeyPressed)
+	{
+		vsync = !vsync;
+		vsyncKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_U) == GLFW_RELEASE)
+	{
+		vsyncKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS && !dynamicResolutionKeyPressed)
+	{
+		dynamicResolution = !dynamicResolution;
+		dynamicResolutionKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_RELEASE)
+	{
+		dynamicResolutionKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS && !sharpenKeyPressed)
+	{
+		sharpenUpscale = !sharpenUpscale;
+		sharpenKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_F) == GLFW_RELEASE)
+	{
+		sharpenKeyPressed = false;
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		if (glfwGetKey(window, GLFW_KEY_1 + i) == GLFW_PRESS && !postEffectKeyPressed[i])
+		{
+			postEffectEnabled[i] = !postEffectEnabled[i];
+			postEffectKeyPressed[i] = true;
+		}
+		if (glfwGetKey(window, GLFW_KEY_1 + i) == GLFW_RELEASE)
+		{
+			postEffectKeyPressed[i] = false;
+		}
+	}
 
 
 }
@@ -641,29 +1419,94 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
 	lastX = xpos;
 	lastY = ypos;
 
-	camera.processMouseMovement(xoffset, yoffset);
+	input.look += glm::vec2(xoffset, yoffset);
 
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-	camera.ProcessMouseScroll((float)yoffset);
+	input.scroll += (float)yoffset;
 }
 
-void displayFps(int* frameCount, double* previousTime) {
+void displayFps(int* frameCount, double* previousTime, const DebugStats& debug) {
 	double currentTime = glfwGetTime();
 	*frameCount += 1;
 	// If a second has passed.
 	if (currentTime - *previousTime >= 1.0)
 	{
 		// Display the frame count here any way you want.
-		std::cout << *frameCount << std::endl;
+		const GLState::Stats& stats = GLState::get().frameStats();
+		const RenderQueue::Stats& queueStats = debug.queue->stats();
+		const FrustumCuller::Stats& cullStats = debug.culler->stats();
+		const OcclusionCuller::Stats& occlusionStats = debug.occlusion->stats();
+		const TransparencyPass::Stats& transparentStats = debug.transparency->stats();
+		RenderGraph::Stats graphStats = debug.frameGraph->stats();
+		const LightClusters::Stats& lightStats = debug.lightClusters->stats();
+		const CascadedShadowMaps::Stats& shadowStats = debug.shadowMaps->stats();
+		ThreadTiming simTiming = debug.simulation->timing();
+		const ThreadTiming& renderTiming = *debug.renderTiming;
+		glm::ivec2 sceneSize = debug.sceneTargets->renderSize();
+
+		std::cout << *frameCount << " fps\n"
+			<< "  gl state calls issued: " << stats.issued << " skipped: " << stats.skipped << "\n"
+			<< "  draws: " << queueStats.draws << " state changes unsorted: " << queueStats.stateChangesSubmitted
+			<< " sorted: " << queueStats.stateChangesSorted << "\n"
+			<< "  visible: " << cullStats.visible << " culled: " << cullStats.culled << "\n"
+			<< "  occluders: " << occlusionStats.occluders << " (" << occlusionStats.triangles << " tris, "
+			<< occlusionStats.rasterMs << " ms) occludees: " << occlusionStats.tested << " occluded: " << occlusionStats.occluded << "\n"
+			<< "  transparent: " << transparentStats.items << " in " << transparentStats.batches << " batches ("
+			<< transparentStats.culled << " culled, recorded in " << transparentStats.recordMs << " ms on " << ThreadPool::get().threadCount()
+			<< " threads), sort " << transparentStats.sortMs << " ms\n"
+			<< "  scene " << sceneSize.x << "x" << sceneSize.y << " (gpu " << debug.resolution->gpuMs() << " ms), post passes: "
+			<< debug.postProcess->passCount() << "\n"
+			<< "  graph: " << graphStats.passes << " passes (" << graphStats.culled << " culled), " << graphStats.transients << " transients in "
+			<< graphStats.textures << " textures, " << graphStats.bytes / 1024 << " KB (" << graphStats.unaliasedBytes / 1024 << " KB unaliased)\n"
+			<< "  point lights: " << lightStats.visible << "/" << lightStats.lights << " visible, " << lightStats.references << " in clusters (max "
+			<< lightStats.maxPerCluster << "), " << lightStats.assignMs << " ms\n"
+			<< "  shadow draws (static+dynamic):";
+		for (int i = 0; i < CascadedShadowMaps::CASCADES; i++)
+		{
+			std::cout << " " << shadowStats.staticDraws[i] << "+" << shadowStats.dynamicDraws[i] << " to " << shadowStats.splits[i] << "m"
+				<< (i + 1 < CascadedShadowMaps::CASCADES ? "," : "");
+		}
+		std::cout << ", " << shadowStats.staticRenders << " static layers rendered\n"
+			<< "  sim: " << simTiming.frames << " steps, " << simTiming.workMs << " ms work, " << simTiming.waitMs << " ms idle, "
+			<< simTiming.skipped << " packets never drawn, " << debug.simulation->stepsDropped() << " steps dropped\n"
+			<< "  gl thread: " << renderTiming.workMs << " ms cpu, " << renderTiming.waitMs << " ms swap, " << renderTiming.skipped << " packets drawn again\n"
+			<< "  gpu passes:";
+		const std::vector<GpuTimer::Section>& sections = debug.passTimer->sections();
+		for (size_t i = 0; i < sections.size(); i++)
+		{
+			std::cout << " " << sections[i].name << " " << sections[i].ms << " ms" << (i + 1 < sections.size() ? "," : "");
+		}
+		std::cout << std::endl;
 
 		*frameCount = 0;
 		*previousTime = currentTime;
 	}
 }
 
+//mostra o buffer do occlusion culling no canto inferior esquerdo, um texel por pixel (mais claro = mais perto)
+void drawOcclusionBuffer(const OcclusionCuller& culler, const Shader& screenShader, GLuint quadVAO, GLuint texture) {
+	static std::vector<unsigned char> pixels;
+	culler.debugImage(pixels, 100.0f);
+	GLState& state = GLState::get();
+	state.bindTexture(0, GL_TEXTURE_2D, texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, OcclusionCuller::WIDTH, OcclusionCuller::HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glViewport(0, 0, OcclusionCuller::WIDTH, OcclusionCuller::HEIGHT);
+	state.disable(GL_DEPTH_TEST);
+	state.disable(GL_STENCIL_TEST);
+	state.useProgram(screenShader.ID);
+	state.bindVertexArray(quadVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	state.enable(GL_STENCIL_TEST);
+	state.enable(GL_DEPTH_TEST);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
 unsigned int load_textures(std::string path) {
 	//CARREGANDO TEXTURAS
 	unsigned int textureID;
@@ -744,72 +1587,104 @@ GLuint loadCubemap(std::vector<std::string> faces) {
 
 }
 
-void setDirectionalLight(Shader& shader) {
+void setDirectionalLight(LightBuffer& lights) {
 
-	glm::vec3 dirLightPos = glm::vec3(-0.2f, -1.0f, -0.3f);
 	glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f);
 	glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f);
-	shader.setVec3("dirLight.ambient", ambientColor);
-	shader.setVec3("dirLight.diffuse", diffuseColor); // darken diffuse dirLight a bit
-	shader.setVec3("dirLight.specular", 1.0f, 1.0f, 1.0f);
-	shader.setVec3("dirLight.direction", dirLightPos);
+	DirLight light = {};
+	light.ambient = ambientColor;
+	light.diffuse = diffuseColor; // darken diffuse dirLight a bit
+	light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	light.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+	lights.setDirectionalLight(light);
 
 }
 
-void setPointLights(Shader& shader) {
+void setPointLights(LightClusters& clusters) {
 
 	glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f);
 	glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f);
-	shader.setVec3("pointLights[0].ambient", ambientColor);
-	shader.setVec3("pointLights[0].diffuse", diffuseColor); // darken diffuse pointLights[] a bit
-	shader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-	shader.setFloat("pointLights[0].constant", 1.0f);
-	shader.setFloat("pointLights[0].linear", 0.09f);
-	shader.setFloat("pointLights[0].quadratic", 0.032f);
-	shader.setVec3("pointLights[0].position", pointLightPositions[0]);
-
-	shader.setVec3("pointLights[1].ambient", ambientColor);
-	shader.setVec3("pointLights[1].diffuse", diffuseColor); // darken diffuse pointLights[] a bit
-	shader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-	shader.setFloat("pointLights[1].constant", 1.0f);
-	shader.setFloat("pointLights[1].linear", 0.09f);
-	shader.setFloat("pointLights[1].quadratic", 0.032f);
-	shader.setVec3("pointLights[1].position", pointLightPositions[1]);
-
-	shader.setVec3("pointLights[2].ambient", ambientColor);
-	shader.setVec3("pointLights[2].diffuse", diffuseColor); // darken diffuse pointLights[] a bit
-	shader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-	shader.setFloat("pointLights[2].constant", 1.0f);
-	shader.setFloat("pointLights[2].linear", 0.09f);
-	shader.setFloat("pointLights[2].quadratic", 0.032f);
-	shader.setVec3("pointLights[2].position", pointLightPositions[2]);
-
-	shader.setVec3("pointLights[3].ambient", ambientColor);
-	shader.setVec3("pointLights[3].diffuse", diffuseColor); // darken diffuse pointLights[] a bit
-	shader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-	shader.setFloat("pointLights[3].constant", 1.0f);
-	shader.setFloat("pointLights[3].linear", 0.09f);
-	shader.setFloat("pointLights[3].quadratic", 0.032f);
-	shader.setVec3("pointLights[3].position", pointLightPositions[3]);
+	clusters.clearPointLights();
+	for (const glm::vec3& position : pointLightPositions)
+	{
+		PointLight light = {};
+		light.ambient = ambientColor;
+		light.diffuse = diffuseColor; // darken diffuse pointLights[] a bit
+		light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+		light.constant = 1.0f;
+		light.linear = 0.09f;
+		light.quadratic = 0.032f;
+		light.position = position;
+		clusters.addPointLight(light);
+	}
 
 }
 
-void setSpotLight(Shader& shader) {
+//anel de luzes coloridas de curto alcance no cinturao, posicoes e velocidades deterministicas
+void addLightField(LightClusters& clusters) {
 
-	glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f);
-	glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f);
-	shader.setVec3("spotLight.ambient", 0.1f, 0.1f, 0.1f);
-	shader.setVec3("spotLight.diffuse", 0.8f, 0.8f, 0.8f); // darken diffuse spotLight a bit
-	shader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-	shader.setFloat("spotLight.constant", 1.0f);
-	shader.setFloat("spotLight.linear", 0.09f);
-	shader.setFloat("spotLight.quadratic", 0.032f);
-
-	shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-	shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(17.5f)));
-
-	shader.setVec3("spotLight.position", camera.position);
-	shader.setVec3("spotLight.direction", camera.front);
+	for (int i = 0; i < LIGHT_FIELD_COUNT; i++)
+	{
+		float hue = std::fmod(i * 0.618034f, 1.0f) * 6.0f;
+		glm::vec3 color = glm::clamp(glm::vec3(std::fabs(hue - 3.0f) - 1.0f, 2.0f - std::fabs(hue - 2.0f), 2.0f - std::fabs(hue - 4.0f)), 0.0f, 1.0f);
+		PointLight light = {};
+		light.diffuse = color;
+		light.specular = color * 0.5f;
+		light.constant = 1.0f;
+		light.linear = 0.35f;
+		light.quadratic = 0.44f;
+		light.radius = 3.0f;
+		clusters.addPointLight(light);
+	}
+	std::vector<glm::vec3> positions;
+	lightFieldPositions(positions, 0.0f);
+	moveLightField(clusters, positions, positions, 1.0f);
+
+}
+
+//roda na thread da simulacao, sem tocar no GL
+void lightFieldPositions(std::vector<glm::vec3>& positions, float time) {
+
+	positions.resize(LIGHT_FIELD_COUNT);
+	for (int i = 0; i < LIGHT_FIELD_COUNT; i++)
+	{
+		//raio, altura, fase e velocidade tirados de sequencias de baixa discrepancia do indice
+		float ring = std::fmod(i * 0.7548777f, 1.0f);
+		float height = std::fmod(i * 0.5698403f, 1.0f);
+		float angle = i * 2.3999632f + time * (0.05f + 0.15f * std::fmod(i * 0.4142136f, 1.0f));
+		float radius = 44.0f + 12.0f * ring;
+		positions[i] = glm::vec3(radius * std::cos(angle), (height - 0.5f) * 6.0f, radius * std::sin(angle));
+	}
+
+}
+
+//entre as posicoes de dois passos da simulacao
+void moveLightField(LightClusters& clusters, const std::vector<glm::vec3>& previous, const std::vector<glm::vec3>& positions, float alpha) {
+
+	int first = clusters.pointLightCount() - LIGHT_FIELD_COUNT;
+	for (int i = 0; i < LIGHT_FIELD_COUNT; i++)
+	{
+		clusters.setPointLightPosition(first + i, glm::mix(previous[i], positions[i], alpha));
+	}
+
+}
+
+void setSpotLight(LightBuffer& lights, const Camera& camera) {
+
+	SpotLight light = {};
+	light.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+	light.diffuse = glm::vec3(0.8f, 0.8f, 0.8f); // darken diffuse spotLight a bit
+	light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	light.constant = 1.0f;
+	light.linear = 0.09f;
+	light.quadratic = 0.032f;
+
+	light.cutOff = glm::cos(glm::radians(12.5f));
+	light.outerCutOff = glm::cos(glm::radians(17.5f));
+
+	light.position = camera.position;
+	light.direction = camera.front;
+	lights.setSpotLight(light);
 
 }
 
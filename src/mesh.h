@@ -7,6 +7,9 @@
 #include <string>
 #include <vector>
 #include "shader.h"
+#include "gl_state.h"
+#include "render_queue.h"
+#include "frustum.h"
 
 struct Vertex {
 	glm::vec3 position;
@@ -27,6 +30,7 @@ public:
 	std::vector<Vertex> vertices;
 	std::vector<GLuint> indices;
 	std::vector<Texture> textures;
+	Bounds bounds;
 
 	Mesh(std::vector<Vertex> vertices,
 		std::vector<GLuint> indices,
@@ -42,11 +46,10 @@ public:
 		GLuint diffuseNr = 1;
 		GLuint specularNr = 1;
 
+		GLState& state = GLState::get();
+
 		for (size_t i = 0; i < textures.size(); i++)
 		{
-			//ativa a texture unit
-			glActiveTexture(GL_TEXTURE0 + i);
-
 			std::string number;
 			std::string name = textures[i].type;
 			if (name == "texture_diffuse")
@@ -58,17 +61,42 @@ public:
 			}
 
 			shader.setInt(("material." + name + number).c_str(), i);
-			//binda a textura a sua unidade
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			//binda a textura a sua unidade (o cache pula se ja estiver ligada)
+			state.bindTexture(i, GL_TEXTURE_2D, textures[i].id);
 
 		}
 
 		//drawCall
-		glBindVertexArray(VAO);
+		state.bindVertexArray(VAO);
 		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
 
 	}
+
+	// records the mesh in the queue instead of drawing it
+	void submit(RenderQueue& queue, const Shader& shader, const glm::mat4& model, RenderPass pass = PASS_OPAQUE) const {
+		queue.submit(pass, shader, VAO, material(), GL_TRIANGLES, (GLsizei)indices.size(), true, model);
+	}
+
+	// the first diffuse and specular maps, for units 0 and 1 (material.texture_diffuse1 / texture_specular1)
+	DrawMaterial material() const {
+		DrawMaterial material = { 0, 0, GL_TEXTURE_2D };
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].type == "texture_diffuse" && material.diffuse == 0)
+			{
+				material.diffuse = textures[i].id;
+			}
+			else if (textures[i].type == "texture_specular" && material.specular == 0)
+			{
+				material.specular = textures[i].id;
+			}
+		}
+		if (material.specular == 0)
+		{
+			material.specular = material.diffuse;
+		}
+		return material;
+	}
 private:
 
 
@@ -78,12 +106,13 @@ private:
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
 
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		GLState& state = GLState::get();
+		state.bindVertexArray(VAO);
+		state.bindBuffer(GL_ARRAY_BUFFER, VBO);
 
 		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
 
 		//positions
@@ -97,7 +126,7 @@ private:
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
 
 		//clear VAObind
-		glBindVertexArray(0);
+		state.bindVertexArray(0);
 
 	}
 
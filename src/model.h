@@ -15,6 +15,8 @@ public:
 	std::string directory;
 	std::vector<Mesh> meshes;
 	std::vector<Texture> texturesLoaded;
+	// union of the mesh bounds
+	Bounds bounds;
 	Model(const std::string &path) {
 		loadModel(path);
 	}
@@ -24,6 +26,25 @@ public:
 			meshes[i].draw(shader);
 		}
 	}
+	void submit(RenderQueue& queue, const Shader& shader, const glm::mat4& model, RenderPass pass = PASS_OPAQUE) const {
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			meshes[i].submit(queue, shader, model, pass);
+		}
+	}
+	// same, but only the meshes whose bounds touch the culler's frustum
+	void submit(RenderQueue& queue, const Shader& shader, const glm::mat4& model, FrustumCuller& culler, RenderPass pass = PASS_OPAQUE) const {
+		culler.clear();
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			culler.add(meshes[i].bounds, model);
+		}
+		const std::vector<uint32_t>& visible = culler.cull();
+		for (size_t i = 0; i < visible.size(); i++)
+		{
+			meshes[visible[i]].submit(queue, shader, model, pass);
+		}
+	}
 private:
 
 
@@ -39,6 +60,11 @@ private:
 		directory = path.substr(0, path.find_last_of('/'));
 
 		processNode(scene->mRootNode, scene);
+
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			bounds = i == 0 ? meshes[i].bounds : Bounds(glm::min(bounds.min, meshes[i].bounds.min), glm::max(bounds.max, meshes[i].bounds.max));
+		}
 	}
 	void processNode(aiNode* node, const aiScene* scene) {
 		//process all node meshes
@@ -57,6 +83,8 @@ private:
 		std::vector<Vertex> vertices;
 		std::vector<GLuint> indices;
 		std::vector<Texture> textures;
+		glm::vec3 boundsMin(0.0f);
+		glm::vec3 boundsMax(0.0f);
 
 		for (size_t i = 0; i < mesh->mNumVertices; i++)
 		{
@@ -86,6 +114,9 @@ private:
 			vertex.position = position;
 			vertex.normal = normal;
 			vertices.push_back(vertex);
+
+			boundsMin = i == 0 ? position : glm::min(boundsMin, position);
+			boundsMax = i == 0 ? position : glm::max(boundsMax, position);
 		}
 		//process indices
 		for (size_t i = 0; i < mesh->mNumFaces; i++)
@@ -107,7 +138,9 @@ private:
 			std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
 			textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 		}
-		return Mesh(vertices, indices, textures);
+		Mesh result(vertices, indices, textures);
+		result.bounds = Bounds(boundsMin, boundsMax);
+		return result;
 	}
 
 	std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName) {
@@ -161,7 +194,7 @@ private:
 			else if (nrChannels == 4)
 				format = GL_RGBA;
 
-			glBindTexture(GL_TEXTURE_2D, textureID);
+			GLState::get().bindTexture(0, GL_TEXTURE_2D, textureID);
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 			glGenerateMipmap(GL_TEXTURE_2D);
 			// set the texture wrapping parameters
@@ -0,0 +1,202 @@
+#pragma once
+#ifndef MULTI_DRAW_MODEL_H
+#define MULTI_DRAW_MODEL_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "model.h"
+#include "render_queue.h"
+#include "frustum.h"
+#include "gl_ext.h"
+#include "gl_state.h"
+
+// A Model drawn with one glMultiDrawElementsIndirect instead of one draw per mesh (GL 4.3, see
+// GLExt::hasMultiDrawIndirect). create() copies every mesh into one vertex/index buffer pair and
+// describes mesh i with indirect command i, and resamples the textures of all meshes into the
+// layers of one GL_TEXTURE_2D_ARRAY, so nothing has to be rebound between meshes.
+// The material is picked per draw without gl_DrawID (GL 4.6): command i has baseInstance i and
+// attribute 7 (divisor 1) holds the (diffuse, specular) layers of every mesh, so the draw of mesh i
+// fetches entry i. That uses up baseInstance, so these commands cannot be instanced.
+// Draw with multidraw_vertex.vert / multidraw_fragment.frag.
+class MultiDrawModel {
+public:
+
+	static const GLuint MATERIAL_ATTRIBUTE = 7;
+
+	MultiDrawModel() : VAO(0), VBO(0), EBO(0), layerBuffer(0), commandBuffer(0), textureArray(0), commandCount(0), indexCount(0) {}
+
+	// false when the context has no multi-draw indirect, the Model then has to be drawn per mesh
+	bool create(const Model& model) {
+		if (!GLExt::get().hasMultiDrawIndirect() || model.meshes.empty())
+		{
+			return false;
+		}
+		bounds = model.bounds;
+
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> indices;
+		std::vector<DrawElementsIndirectCommand> commands;
+		std::vector<glm::uvec2> layers;
+		std::vector<GLuint> sources;
+		std::map<GLuint, GLuint> layerOf;
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			const Mesh& mesh = model.meshes[i];
+			DrawElementsIndirectCommand command = { (GLuint)mesh.indices.size(), 1, (GLuint)indices.size(), (GLint)vertices.size(), (GLuint)i };
+			commands.push_back(command);
+			vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+			indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+
+			DrawMaterial material = mesh.material();
+			layers.push_back(glm::uvec2(layer(material.diffuse, sources, layerOf), layer(material.specular, sources, layerOf)));
+		}
+		commandCount = (GLsizei)commands.size();
+		indexCount = (GLsizei)indices.size();
+
+		GLState& state = GLState::get();
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+		glGenBuffers(1, &layerBuffer);
+		glGenBuffers(1, &commandBuffer);
+		state.bindVertexArray(VAO);
+		state.bindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+		state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+		// same layout as Mesh::setupMesh
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+
+		state.bindBuffer(GL_ARRAY_BUFFER, layerBuffer);
+		glBufferData(GL_ARRAY_BUFFER, layers.size() * sizeof(glm::uvec2), layers.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(MATERIAL_ATTRIBUTE);
+		glVertexAttribIPointer(MATERIAL_ATTRIBUTE, 2, GL_UNSIGNED_INT, sizeof(glm::uvec2), (void*)0);
+		glVertexAttribDivisor(MATERIAL_ATTRIBUTE, 1);
+		state.bindVertexArray(0);
+
+		state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+
+		buildTextureArray(sources);
+		return true;
+	}
+
+	// the whole model as one queue item, one draw call whatever the mesh count
+	void submit(RenderQueue& queue, const Shader& shader, const glm::mat4& model, RenderPass pass = PASS_OPAQUE) const {
+		DrawMaterial material = { textureArray, textureArray, GL_TEXTURE_2D_ARRAY };
+		DrawItem item = { shader.ID, VAO, material, GL_TRIANGLES, indexCount, 1, true, model, commandBuffer, 0, commandCount };
+		queue.submit(pass, item, glm::vec3(model * glm::vec4(bounds.center, 1.0f)));
+	}
+
+	// same, skipped when the model bounds are outside the frustum
+	void submit(RenderQueue& queue, const Shader& shader, const glm::mat4& model, const Frustum& frustum, RenderPass pass = PASS_OPAQUE) const {
+		glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+		float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		if (frustum.containsSphere(center, bounds.radius * scale))
+		{
+			submit(queue, shader, model, pass);
+		}
+	}
+
+	// meshes covered by each draw call
+	GLsizei meshCount() const {
+		return commandCount;
+	}
+
+	void destroy() {
+		GLState& state = GLState::get();
+		state.forgetVertexArray(VAO);
+		state.forgetTexture(textureArray);
+		state.forgetBuffer(VBO);
+		state.forgetBuffer(EBO);
+		state.forgetBuffer(layerBuffer);
+		state.forgetBuffer(commandBuffer);
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		glDeleteBuffers(1, &layerBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+		glDeleteTextures(1, &textureArray);
+		VAO = VBO = EBO = layerBuffer = commandBuffer = textureArray = 0;
+	}
+
+private:
+
+	GLuint VAO, VBO, EBO;
+	GLuint layerBuffer;
+	GLuint commandBuffer;
+	GLuint textureArray;
+	GLsizei commandCount;
+	GLsizei indexCount;
+	Bounds bounds;
+
+	// layer of a texture, added the first time it is seen; texture 0 gets a white layer
+	static GLuint layer(GLuint texture, std::vector<GLuint>& sources, std::map<GLuint, GLuint>& layerOf) {
+		std::map<GLuint, GLuint>::iterator it = layerOf.find(texture);
+		if (it == layerOf.end())
+		{
+			it = layerOf.insert(std::make_pair(texture, (GLuint)sources.size())).first;
+			sources.push_back(texture);
+		}
+		return it->second;
+	}
+
+	// every source blitted (scaled) to the size of the largest one, then mipmapped
+	void buildTextureArray(const std::vector<GLuint>& sources) {
+		GLState& state = GLState::get();
+		std::vector<glm::ivec2> sizes(sources.size(), glm::ivec2(1));
+		glm::ivec2 size(1);
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			if (sources[i] != 0)
+			{
+				state.bindTexture(0, GL_TEXTURE_2D, sources[i]);
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &sizes[i].x);
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &sizes[i].y);
+				size = glm::max(size, sizes[i]);
+			}
+		}
+
+		glGenTextures(1, &textureArray);
+		state.bindTexture(0, GL_TEXTURE_2D_ARRAY, textureArray);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size.x, size.y, (GLsizei)sources.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+		GLuint framebuffers[2];
+		glGenFramebuffers(2, framebuffers);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureArray, 0, (GLint)i);
+			if (sources[i] == 0)
+			{
+				const GLfloat white[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+				glClearBufferfv(GL_COLOR, 0, white);
+				continue;
+			}
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sources[i], 0);
+			glBlitFramebuffer(0, 0, sizes[i].x, sizes[i].y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(2, framebuffers);
+
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+};
+
+#endif
@@ -0,0 +1,432 @@
+#pragma once
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+#include "model.h"
+#include "frustum.h"
+#include "parallel.h"
+
+// AVX2 when the compiler targets it (make AVX=1 or /arch:AVX2), SSE2 on every other x86 build
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OCCLUSION_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+// CPU occlusion culling. A few designated occluders (big closed meshes: the planet) are rasterized
+// every frame into a low resolution buffer of 1/w, which interpolates linearly in screen space and
+// grows towards the camera (0 = nothing drawn). Triangles are set up per occluder and binned to
+// screen tiles, then every tile is rasterized on its own thread, 8 (AVX2) or 4 (SSE) pixels per
+// step. Occludees are tested with the screen rectangle of their bounds at their nearest depth: they
+// are hidden when every pixel of the rectangle holds a closer occluder. Each tile also keeps its
+// farthest depth, so fully covered tiles are rejected without reading pixels.
+// Coverage is sampled at pixel centers, so an object peeking past an occluder silhouette by less
+// than a pixel of this buffer can be culled.
+class OcclusionCuller {
+public:
+
+	static const int WIDTH = 256;
+	static const int HEIGHT = 192;
+	static const int TILE_WIDTH = 64; // multiple of 8 so SIMD steps never straddle two tiles
+	static const int TILE_HEIGHT = 32;
+	static const int TILES_X = WIDTH / TILE_WIDTH;
+	static const int TILES_Y = HEIGHT / TILE_HEIGHT;
+
+	struct Stats {
+		unsigned int occluders = 0;
+		unsigned int triangles = 0; // front-facing, on screen, after near clipping
+		unsigned int tested = 0;
+		unsigned int occluded = 0;
+		double rasterMs = 0.0;
+	};
+
+	OcclusionCuller() : bins(TILES_X * TILES_Y), depthBuffer(WIDTH * HEIGHT, 0.0f), tileFarthest(TILES_X * TILES_Y, 0.0f) {}
+
+	// every mesh of the model; the model must outlive the culler, its vertices are read each frame
+	size_t addOccluder(const Model& model, const glm::mat4& transform) {
+		size_t first = occluders.size();
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			addOccluder(model.meshes[i], transform);
+		}
+		return first;
+	}
+
+	size_t addOccluder(const Mesh& mesh, const glm::mat4& transform) {
+		Occluder occluder = { &mesh.vertices, &mesh.indices, transform };
+		occluders.push_back(occluder);
+		return occluders.size() - 1;
+	}
+
+	void setOccluderTransform(size_t occluder, const glm::mat4& transform) {
+		occluders[occluder].transform = transform;
+	}
+
+	void clearOccluders() {
+		occluders.clear();
+	}
+
+	// rasterizes every occluder as seen through viewProjection and resets the counters
+	void render(const glm::mat4& viewProjection) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		this->viewProjection = viewProjection;
+		frameStats = Stats();
+		frameStats.occluders = (unsigned int)occluders.size();
+
+		ThreadPool& pool = ThreadPool::get();
+		triangles.resize(occluders.size());
+		pool.parallelFor(occluders.size(), 1, [&](size_t o, size_t, size_t) {
+			setupOccluder(occluders[o], triangles[o]);
+		});
+
+		for (size_t t = 0; t < bins.size(); t++)
+		{
+			bins[t].clear();
+		}
+		for (size_t o = 0; o < triangles.size(); o++)
+		{
+			for (size_t i = 0; i < triangles[o].size(); i++)
+			{
+				const Triangle& triangle = triangles[o][i];
+				for (int ty = triangle.minY / TILE_HEIGHT; ty <= triangle.maxY / TILE_HEIGHT; ty++)
+				{
+					for (int tx = triangle.minX / TILE_WIDTH; tx <= triangle.maxX / TILE_WIDTH; tx++)
+					{
+						bins[ty * TILES_X + tx].push_back(&triangle);
+					}
+				}
+			}
+			frameStats.triangles += (unsigned int)triangles[o].size();
+		}
+
+		pool.parallelFor(bins.size(), 1, [&](size_t tile, size_t, size_t) {
+			rasterizeTile((int)tile);
+		});
+		frameStats.rasterMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// false when the box, moved by model, is hidden behind the occluders; thread safe after render()
+	bool testBounds(const Bounds& bounds, const glm::mat4& model) const {
+		glm::mat4 transform = viewProjection * model;
+		glm::vec3 corners[2] = { bounds.min, bounds.max };
+		glm::vec2 low(1e30f), high(-1e30f);
+		float nearest = 0.0f;
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec4 clip = transform * glm::vec4(corners[i & 1].x, corners[(i >> 1) & 1].y, corners[(i >> 2) & 1].z, 1.0f);
+			if (clip.w <= 1e-4f || clip.z < -clip.w)
+			{
+				// crosses the near plane, too close to say
+				return true;
+			}
+			float invW = 1.0f / clip.w;
+			glm::vec2 screen = toScreen(clip, invW);
+			low = glm::min(low, screen);
+			high = glm::max(high, screen);
+			nearest = std::max(nearest, invW);
+		}
+		return testRect(low, high, nearest);
+	}
+
+	bool testSphere(const glm::vec3& center, float radius) const {
+		return testBounds(Bounds(center - glm::vec3(radius), center + glm::vec3(radius)), glm::mat4(1.0f));
+	}
+
+	// counters of the occludees tested by the caller (tests run on any thread, stats are not atomic)
+	void addStats(unsigned int tested, unsigned int occluded) {
+		frameStats.tested += tested;
+		frameStats.occluded += occluded;
+	}
+
+	const Stats& stats() const {
+		return frameStats;
+	}
+
+	// 1/w per pixel, row 0 at the bottom of the screen
+	const std::vector<float>& depth() const {
+		return depthBuffer;
+	}
+
+	// the buffer as RGBA8 for the debug view: brighter is closer, black is empty
+	void debugImage(std::vector<unsigned char>& rgba, float farPlane) const {
+		rgba.resize(depthBuffer.size() * 4);
+		for (size_t i = 0; i < depthBuffer.size(); i++)
+		{
+			float closeness = depthBuffer[i] > 0.0f ? 1.0f - std::min(1.0f / (depthBuffer[i] * farPlane), 1.0f) : 0.0f;
+			unsigned char gray = (unsigned char)(closeness * 255.0f);
+			rgba[i * 4] = gray;
+			rgba[i * 4 + 1] = gray;
+			rgba[i * 4 + 2] = gray;
+			rgba[i * 4 + 3] = 255;
+		}
+	}
+
+private:
+
+	struct Occluder {
+		const std::vector<Vertex>* vertices;
+		const std::vector<GLuint>* indices;
+		glm::mat4 transform;
+	};
+
+	// edge functions (inside when all >= 0) and the 1/w plane, in pixels; bbox inclusive
+	struct Triangle {
+		float edgeA[3], edgeB[3], edgeC[3];
+		float depthA, depthB, depthC;
+		int minX, minY, maxX, maxY;
+	};
+
+	std::vector<Occluder> occluders;
+	std::vector<std::vector<Triangle> > triangles;
+	std::vector<std::vector<const Triangle*> > bins;
+	std::vector<float> depthBuffer;
+	std::vector<float> tileFarthest;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	Stats frameStats;
+
+	static glm::vec2 toScreen(const glm::vec4& clip, float invW) {
+		return glm::vec2((clip.x * invW * 0.5f + 0.5f) * WIDTH, (clip.y * invW * 0.5f + 0.5f) * HEIGHT);
+	}
+
+	void setupOccluder(const Occluder& occluder, std::vector<Triangle>& out) const {
+		glm::mat4 transform = viewProjection * occluder.transform;
+		const std::vector<Vertex>& vertices = *occluder.vertices;
+		const std::vector<GLuint>& indices = *occluder.indices;
+		std::vector<glm::vec4> clip(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			clip[i] = transform * glm::vec4(vertices[i].position, 1.0f);
+		}
+		out.clear();
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			glm::vec4 polygon[4];
+			int count = clipNear(clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]], polygon);
+			for (int k = 1; k + 1 < count; k++)
+			{
+				setupTriangle(polygon[0], polygon[k], polygon[k + 1], out);
+			}
+		}
+	}
+
+	// Sutherland-Hodgman against z >= -w: 0, 3 or 4 vertices
+	static int clipNear(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, glm::vec4* out) {
+		const glm::vec4 in[3] = { a, b, c };
+		int count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4& p = in[i];
+			const glm::vec4& q = in[(i + 1) % 3];
+			float dp = p.z + p.w;
+			float dq = q.z + q.w;
+			if (dp >= 0.0f)
+			{
+				out[count++] = p;
+			}
+			if ((dp >= 0.0f) != (dq >= 0.0f))
+			{
+				out[count++] = p + (q - p) * (dp / (dp - dq));
+			}
+		}
+		return count;
+	}
+
+	void setupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, std::vector<Triangle>& out) const {
+		if (c0.w <= 1e-6f || c1.w <= 1e-6f || c2.w <= 1e-6f)
+		{
+			return;
+		}
+		float z[3] = { 1.0f / c0.w, 1.0f / c1.w, 1.0f / c2.w };
+		glm::vec2 v[3] = { toScreen(c0, z[0]), toScreen(c1, z[1]), toScreen(c2, z[2]) };
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+		// back faces (clockwise on screen) of a closed occluder are behind its front faces anyway
+		if (area <= 1e-6f)
+		{
+			return;
+		}
+		Triangle triangle;
+		triangle.minX = std::max(0, (int)std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x))));
+		triangle.minY = std::max(0, (int)std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y))));
+		triangle.maxX = std::min(WIDTH - 1, (int)std::ceil(std::max(v[0].x, std::max(v[1].x, v[2].x))));
+		triangle.maxY = std::min(HEIGHT - 1, (int)std::ceil(std::max(v[0].y, std::max(v[1].y, v[2].y))));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		{
+			return;
+		}
+		// edge k is opposite vertex k: E(p) = (b - a) x (p - a)
+		for (int k = 0; k < 3; k++)
+		{
+			const glm::vec2& a = v[(k + 1) % 3];
+			const glm::vec2& b = v[(k + 2) % 3];
+			triangle.edgeA[k] = a.y - b.y;
+			triangle.edgeB[k] = b.x - a.x;
+			triangle.edgeC[k] = a.x * b.y - a.y * b.x;
+		}
+		// barycentric weight k is E_k / area, so 1/w = sum(E_k * z_k) / area
+		float inverseArea = 1.0f / area;
+		triangle.depthA = (triangle.edgeA[0] * z[0] + triangle.edgeA[1] * z[1] + triangle.edgeA[2] * z[2]) * inverseArea;
+		triangle.depthB = (triangle.edgeB[0] * z[0] + triangle.edgeB[1] * z[1] + triangle.edgeB[2] * z[2]) * inverseArea;
+		triangle.depthC = (triangle.edgeC[0] * z[0] + triangle.edgeC[1] * z[1] + triangle.edgeC[2] * z[2]) * inverseArea;
+		out.push_back(triangle);
+	}
+
+	void rasterizeTile(int tile) {
+		int tileX = (tile % TILES_X) * TILE_WIDTH;
+		int tileY = (tile / TILES_X) * TILE_HEIGHT;
+		for (int y = tileY; y < tileY + TILE_HEIGHT; y++)
+		{
+			std::fill(&depthBuffer[y * WIDTH + tileX], &depthBuffer[y * WIDTH + tileX] + TILE_WIDTH, 0.0f);
+		}
+
+		const std::vector<const Triangle*>& bin = bins[tile];
+		for (size_t i = 0; i < bin.size(); i++)
+		{
+			const Triangle& t = *bin[i];
+			int minY = std::max(t.minY, tileY);
+			int maxY = std::min(t.maxY, tileY + TILE_HEIGHT - 1);
+			int minX = std::max(t.minX, tileX) & ~(LANES - 1);
+			int maxX = std::min(t.maxX, tileX + TILE_WIDTH - 1);
+			for (int y = minY; y <= maxY; y++)
+			{
+				rasterizeSpan(t, y, minX, maxX, &depthBuffer[y * WIDTH]);
+			}
+		}
+
+		float farthest = 1e30f;
+		for (int y = tileY; y < tileY + TILE_HEIGHT; y++)
+		{
+			for (int x = tileX; x < tileX + TILE_WIDTH; x++)
+			{
+				farthest = std::min(farthest, depthBuffer[y * WIDTH + x]);
+			}
+		}
+		tileFarthest[tile] = farthest;
+	}
+
+#if defined(OCCLUSION_AVX2)
+	static const int LANES = 8;
+
+	// pixels [minX, maxX] of row y (minX aligned to LANES), depth written where covered and closer
+	static void rasterizeSpan(const Triangle& t, int y, int minX, int maxX, float* row) {
+		__m256 py = _mm256_set1_ps(y + 0.5f);
+		__m256 steps = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		__m256 e0Row = _mm256_fmadd_ps(_mm256_set1_ps(t.edgeB[0]), py, _mm256_set1_ps(t.edgeC[0]));
+		__m256 e1Row = _mm256_fmadd_ps(_mm256_set1_ps(t.edgeB[1]), py, _mm256_set1_ps(t.edgeC[1]));
+		__m256 e2Row = _mm256_fmadd_ps(_mm256_set1_ps(t.edgeB[2]), py, _mm256_set1_ps(t.edgeC[2]));
+		__m256 zRow = _mm256_fmadd_ps(_mm256_set1_ps(t.depthB), py, _mm256_set1_ps(t.depthC));
+		for (int x = minX; x <= maxX; x += LANES)
+		{
+			__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), steps);
+			__m256 e0 = _mm256_fmadd_ps(_mm256_set1_ps(t.edgeA[0]), px, e0Row);
+			__m256 e1 = _mm256_fmadd_ps(_mm256_set1_ps(t.edgeA[1]), px, e1Row);
+			__m256 e2 = _mm256_fmadd_ps(_mm256_set1_ps(t.edgeA[2]), px, e2Row);
+			// sign bits: a pixel is outside when any edge is negative
+			__m256 outside = _mm256_or_ps(_mm256_or_ps(e0, e1), e2);
+			if (_mm256_movemask_ps(outside) == 0xFF)
+			{
+				continue;
+			}
+			__m256 z = _mm256_fmadd_ps(_mm256_set1_ps(t.depthA), px, zRow);
+			__m256 current = _mm256_loadu_ps(row + x);
+			__m256 closer = _mm256_max_ps(current, z);
+			_mm256_storeu_ps(row + x, _mm256_blendv_ps(closer, current, outside));
+		}
+	}
+#elif defined(OCCLUSION_SSE)
+	static const int LANES = 4;
+
+	static void rasterizeSpan(const Triangle& t, int y, int minX, int maxX, float* row) {
+		__m128 py = _mm_set1_ps(y + 0.5f);
+		__m128 steps = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		__m128 e0Row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeB[0]), py), _mm_set1_ps(t.edgeC[0]));
+		__m128 e1Row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeB[1]), py), _mm_set1_ps(t.edgeC[1]));
+		__m128 e2Row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeB[2]), py), _mm_set1_ps(t.edgeC[2]));
+		__m128 zRow = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.depthB), py), _mm_set1_ps(t.depthC));
+		__m128 zero = _mm_setzero_ps();
+		for (int x = minX; x <= maxX; x += LANES)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), steps);
+			__m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[0]), px), e0Row);
+			__m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[1]), px), e1Row);
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[2]), px), e2Row);
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+			if (_mm_movemask_ps(inside) == 0)
+			{
+				continue;
+			}
+			__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.depthA), px), zRow);
+			__m128 current = _mm_loadu_ps(row + x);
+			__m128 closer = _mm_max_ps(current, z);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, current)));
+		}
+	}
+#else
+	static const int LANES = 1;
+
+	static void rasterizeSpan(const Triangle& t, int y, int minX, int maxX, float* row) {
+		float py = y + 0.5f;
+		for (int x = minX; x <= maxX; x++)
+		{
+			float px = x + 0.5f;
+			float e0 = t.edgeA[0] * px + t.edgeB[0] * py + t.edgeC[0];
+			float e1 = t.edgeA[1] * px + t.edgeB[1] * py + t.edgeC[1];
+			float e2 = t.edgeA[2] * px + t.edgeB[2] * py + t.edgeC[2];
+			if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f)
+			{
+				row[x] = std::max(row[x], t.depthA * px + t.depthB * py + t.depthC);
+			}
+		}
+	}
+#endif
+
+	// visible when some pixel of the rectangle has no occluder closer than nearest
+	bool testRect(const glm::vec2& low, const glm::vec2& high, float nearest) const {
+		int minX = std::max(0, (int)std::floor(low.x));
+		int minY = std::max(0, (int)std::floor(low.y));
+		int maxX = std::min(WIDTH - 1, (int)std::ceil(high.x));
+		int maxY = std::min(HEIGHT - 1, (int)std::ceil(high.y));
+		if (minX > maxX || minY > maxY)
+		{
+			// off screen, that is the frustum's call
+			return true;
+		}
+		for (int ty = minY / TILE_HEIGHT; ty <= maxY / TILE_HEIGHT; ty++)
+		{
+			for (int tx = minX / TILE_WIDTH; tx <= maxX / TILE_WIDTH; tx++)
+			{
+				if (tileFarthest[ty * TILES_X + tx] > nearest)
+				{
+					continue;
+				}
+				int x0 = std::max(minX, tx * TILE_WIDTH), x1 = std::min(maxX, tx * TILE_WIDTH + TILE_WIDTH - 1);
+				int y0 = std::max(minY, ty * TILE_HEIGHT), y1 = std::min(maxY, ty * TILE_HEIGHT + TILE_HEIGHT - 1);
+				for (int y = y0; y <= y1; y++)
+				{
+					const float* row = &depthBuffer[y * WIDTH];
+					for (int x = x0; x <= x1; x++)
+					{
+						if (row[x] <= nearest)
+						{
+							return true;
+						}
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+};
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef OIT_PASS_H
+#define OIT_PASS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <functional>
+
+#include "shader.h"
+#include "gl_state.h"
+#include "render_graph.h"
+
+// Weighted blended order-independent transparency (McGuire and Bavoil, 2013): transparent
+// geometry is drawn in any order into two targets and averaged in one full-screen resolve, so
+// nothing has to be sorted by depth. Target 0 (RGBA16F) sums color * alpha * weight in rgb and
+// multiplies (1 - alpha) into its alpha, the revealage; target 1 (R16F) sums alpha * weight.
+// Both are written with one glBlendFuncSeparate (GL 3.3 has no per-target blend). The depth
+// texture of the scene is shared, tested but not written, so opaque geometry still hides the
+// layers behind it. Draw the layers with oit_fragment.frag and resolve with oit_composite.frag.
+// The targets are transients of a RenderGraph, the size of the scene targets: they only exist
+// between the accumulation and the resolve, and any viewport in their lower left works since
+// the resolve reads pixel for pixel.
+class WeightedBlendedOIT {
+public:
+
+	// accumulates the layers drawn by drawLayers and resolves them over sceneColor;
+	// compositeShader's samplers read units 0 and 1
+	void addPasses(RenderGraph& graph, RenderResource sceneColor, RenderResource sceneDepth, const glm::ivec2& viewport,
+		const std::function<void()>& drawLayers, const Shader& compositeShader, GLuint quadVAO) {
+		TextureDesc scene = graph.desc(sceneColor);
+		TextureDesc accumDesc = { scene.width, scene.height, GL_RGBA16F, GL_NEAREST };
+		TextureDesc weightDesc = { scene.width, scene.height, GL_R16F, GL_NEAREST };
+		RenderResource accum = graph.create("oit accumulation", accumDesc);
+		RenderResource weight = graph.create("oit weight", weightDesc);
+
+		graph.addPass("oit layers", [drawLayers](RenderGraph&) {
+			const GLfloat clearAccum[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			const GLfloat clearWeight[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			glClearBufferfv(GL_COLOR, 0, clearAccum);
+			glClearBufferfv(GL_COLOR, 1, clearWeight);
+
+			GLState& state = GLState::get();
+			state.enable(GL_BLEND);
+			state.blendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+			state.enable(GL_DEPTH_TEST);
+			state.depthFunc(GL_LESS);
+			state.depthMask(GL_FALSE);
+			drawLayers();
+		}).write(accum).write(weight).depthStencil(sceneDepth, false).viewport(viewport);
+
+		const Shader* composite = &compositeShader;
+		graph.addPass("oit resolve", [composite, quadVAO, accum, weight](RenderGraph& graph) {
+			GLState& state = GLState::get();
+			state.disable(GL_DEPTH_TEST);
+			state.enable(GL_BLEND);
+			state.blendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+			state.useProgram(composite->ID);
+			state.bindVertexArray(quadVAO);
+			state.bindTexture(0, GL_TEXTURE_2D, graph.texture(accum));
+			state.bindTexture(1, GL_TEXTURE_2D, graph.texture(weight));
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+			state.enable(GL_DEPTH_TEST);
+			state.depthMask(GL_TRUE);
+		}).read(accum).read(weight).write(sceneColor).viewport(viewport);
+	}
+
+};
+
+#endif
@@ -0,0 +1,162 @@
+#pragma once
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fork-join pool for the per-frame CPU passes (culling, instance writes...). Work is split in
+// fixed chunks so callers can keep one output slot per chunk and merge them in order afterwards,
+// which keeps results deterministic no matter which thread ran what. The calling thread takes
+// chunks too, and parallelFor returns once every chunk is done.
+class ThreadPool {
+public:
+
+	// one worker per core besides the main thread
+	static ThreadPool& get() {
+		static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+		return pool;
+	}
+
+	// threads that run chunks, the caller included
+	unsigned int threadCount() const {
+		return (unsigned int)workers.size() + 1;
+	}
+
+	static size_t chunkCount(size_t count, size_t chunkSize) {
+		return (count + chunkSize - 1) / chunkSize;
+	}
+
+	// fn(chunk, begin, end) for every chunk of [0, count)
+	void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t, size_t)>& fn) {
+		size_t chunks = chunkCount(count, chunkSize);
+		if (chunks <= 1 || workers.empty())
+		{
+			for (size_t c = 0; c < chunks; c++)
+			{
+				fn(c, c * chunkSize, std::min(count, (c + 1) * chunkSize));
+			}
+			return;
+		}
+
+		{
+			// a worker still leaving the previous job must not see the counter reset under it
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this] { return active == 0; });
+			job = &fn;
+			jobCount = count;
+			jobChunkSize = chunkSize;
+			jobChunks = chunks;
+			nextChunk = 0;
+			pending = chunks;
+			generation++;
+		}
+		wake.notify_all();
+		runChunks(fn, count, chunkSize, chunks);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return pending == 0 && active == 0; });
+		job = NULL;
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+private:
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(size_t, size_t, size_t)>* job = NULL;
+	size_t jobCount = 0;
+	size_t jobChunkSize = 0;
+	size_t jobChunks = 0;
+	std::atomic<size_t> nextChunk{ 0 };
+	size_t pending = 0;
+	unsigned int active = 0;
+	unsigned long long generation = 0;
+	bool quit = false;
+
+	explicit ThreadPool(unsigned int count) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void workerLoop() {
+		unsigned long long seen = 0;
+		while (true)
+		{
+			const std::function<void(size_t, size_t, size_t)>* fn;
+			size_t count, chunkSize, chunks;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this, seen] { return quit || generation != seen; });
+				if (quit)
+				{
+					return;
+				}
+				seen = generation;
+				fn = job;
+				count = jobCount;
+				chunkSize = jobChunkSize;
+				chunks = jobChunks;
+				active++;
+			}
+			if (fn != NULL)
+			{
+				runChunks(*fn, count, chunkSize, chunks);
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--active == 0)
+			{
+				done.notify_all();
+			}
+		}
+	}
+
+	void runChunks(const std::function<void(size_t, size_t, size_t)>& fn, size_t count, size_t chunkSize, size_t chunks) {
+		size_t finished = 0;
+		while (true)
+		{
+			size_t c = nextChunk.fetch_add(1);
+			if (c >= chunks)
+			{
+				break;
+			}
+			fn(c, c * chunkSize, std::min(count, (c + 1) * chunkSize));
+			finished++;
+		}
+		if (finished > 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending -= finished;
+			if (pending == 0)
+			{
+				done.notify_all();
+			}
+		}
+	}
+
+};
+
+#endif
@@ -0,0 +1,321 @@
+#pragma once
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "shader.h"
+#include "gl_state.h"
+#include "render_targets.h"
+#include "render_graph.h"
+
+enum PostEffectType {
+	POST_GRADE,       // params: exposure, contrast, saturation; (1, 1, 1) is identity
+	POST_GRAYSCALE,   // params.x: amount
+	POST_INVERT,      // params.x: amount
+	POST_VIGNETTE,    // params.x: amount
+	POST_EDGES,       // params.x: amount of the 3x3 edge kernel
+	POST_BLUR,        // params.x: gaussian radius in pixels, up to PostProcessChain::MAX_BLUR_RADIUS
+};
+
+// what an effect reads, which decides where the chain is cut into passes
+enum PostInput {
+	POST_INPUT_PIXEL,         // its own pixel only: fused into the pass before it
+	POST_INPUT_NEIGHBORHOOD,  // a window around the pixel: needs the previous result in a texture
+	POST_INPUT_SEPARABLE,     // a separable window: two 1D passes
+};
+
+struct PostEffect {
+	PostEffectType type;
+	bool enabled;
+	glm::vec4 params;
+};
+
+// Screen space effects between the scene targets and the window, all drawn with
+// assets/shaders/post_process.frag. Every frame plan() drops the disabled effects and the ones
+// whose parameters do nothing, then cuts the rest into passes by what they read. Pixel effects
+// are fused into the pass before them, up to MAX_EFFECTS per pass. A neighborhood effect starts
+// a new pass, and a separable blur becomes two 1D passes whose taps fall between texel pairs,
+// so bilinear filtering fetches two weights at once. Intermediate passes run at the render
+// size into RenderGraph transients, which the graph aliases onto two textures. The last pass
+// writes the window and doubles as the upscale when the scene was rendered smaller. An extra copy pass is added only when the last
+// effect cannot upscale or there is no effect at all. With nothing left after elision,
+// active() is false and the scene can be drawn straight to the window.
+class PostProcessChain {
+public:
+
+	static const int MAX_EFFECTS = 8;
+	static const int MAX_TAPS = 16;
+	static const int MAX_BLUR_RADIUS = 2 * (MAX_TAPS - 1);
+
+	enum Filter { FILTER_COPY, FILTER_KERNEL, FILTER_BLUR };
+
+	struct Pass {
+		Filter filter;
+		glm::vec2 axis;                 // FILTER_BLUR, 1 along the blurred axis
+		float amount;                   // FILTER_KERNEL
+		int tapCount;                   // FILTER_BLUR
+		float tapOffsets[MAX_TAPS];
+		float tapWeights[MAX_TAPS];
+		int effectCount;
+		GLint effects[MAX_EFFECTS];
+		glm::vec4 effectParams[MAX_EFFECTS];
+	};
+
+	PostProcessChain() : program(NULL), programID(0) {}
+
+	static PostInput inputOf(PostEffectType type) {
+		switch (type)
+		{
+		case POST_EDGES:
+			return POST_INPUT_NEIGHBORHOOD;
+		case POST_BLUR:
+			return POST_INPUT_SEPARABLE;
+		default:
+			return POST_INPUT_PIXEL;
+		}
+	}
+
+	// parameters that leave the image as it is
+	static bool isIdentity(const PostEffect& effect) {
+		switch (effect.type)
+		{
+		case POST_GRADE:
+			return effect.params.x == 1.0f && effect.params.y == 1.0f && effect.params.z == 1.0f;
+		case POST_BLUR:
+			return effect.params.x < 1.0f;
+		default:
+			return effect.params.x == 0.0f;
+		}
+	}
+
+	// effects run in the order they were added
+	size_t add(PostEffectType type, const glm::vec4& params, bool enabled = true) {
+		PostEffect effect = { type, enabled, params };
+		effects.push_back(effect);
+		return effects.size() - 1;
+	}
+
+	PostEffect& effect(size_t index) {
+		return effects[index];
+	}
+
+	void create() {
+		program = new Shader("./assets/shaders/framebuffer_vertex.vert", "./assets/shaders/post_process.frag", "");
+	}
+
+	// the passes the current effects need, without the copy addPasses() may add
+	const std::vector<Pass>& plan() {
+		passes.clear();
+		for (size_t i = 0; i < effects.size(); i++)
+		{
+			const PostEffect& effect = effects[i];
+			if (!effect.enabled || isIdentity(effect))
+			{
+				continue;
+			}
+			switch (inputOf(effect.type))
+			{
+			case POST_INPUT_PIXEL:
+				if (passes.empty() || passes.back().effectCount == MAX_EFFECTS)
+				{
+					passes.push_back(filterPass(FILTER_COPY));
+				}
+				passes.back().effects[passes.back().effectCount] = (GLint)effect.type;
+				passes.back().effectParams[passes.back().effectCount] = effect.params;
+				passes.back().effectCount++;
+				break;
+			case POST_INPUT_NEIGHBORHOOD:
+				passes.push_back(filterPass(FILTER_KERNEL));
+				passes.back().amount = effect.params.x;
+				break;
+			case POST_INPUT_SEPARABLE:
+				passes.push_back(blurPass(effect.params.x, glm::vec2(1.0f, 0.0f)));
+				passes.push_back(blurPass(effect.params.x, glm::vec2(0.0f, 1.0f)));
+				break;
+			}
+		}
+		return passes;
+	}
+
+	// false when every effect was elided: nothing to do between the scene and the window
+	bool active() {
+		return !plan().empty();
+	}
+
+	// adds the chain from sceneColor (the color of scene) to backbuffer; sharpness is used by the
+	// final copy when it upscales. Intermediates are the size of the scene targets, drawn at its
+	// render size, so a changing render scale does not reallocate them.
+	void addPasses(RenderGraph& graph, const RenderTargets& scene, RenderResource sceneColor, RenderResource backbuffer, GLuint quadVAO, float sharpness) {
+		plan();
+		glm::ivec2 renderSize = scene.renderSize();
+		TextureDesc window = graph.desc(backbuffer);
+		bool upscale = renderSize != glm::ivec2(window.width, window.height);
+		if (passes.empty() || (upscale && passes.back().filter != FILTER_COPY))
+		{
+			passes.push_back(filterPass(FILTER_COPY));
+		}
+		TextureDesc intermediate = { scene.size().x, scene.size().y, GL_RGB8, GL_LINEAR };
+		glm::vec2 inputScale = scene.uvScale();
+		glm::vec2 texel = 1.0f / glm::vec2(scene.size());
+
+		RenderResource input = sceneColor;
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			bool last = i + 1 == passes.size();
+			RenderResource output = last ? backbuffer : graph.create("post", intermediate);
+			float passSharpness = last && upscale ? sharpness : 0.0f;
+			graph.addPass("post", [this, i, input, quadVAO, inputScale, texel, passSharpness](RenderGraph& graph) {
+				draw(passes[i], graph.texture(input), quadVAO, inputScale, texel, passSharpness);
+			}).read(input).write(output).viewport(last ? glm::ivec2(window.width, window.height) : renderSize);
+			input = output;
+		}
+		frameStats.passes = (unsigned int)passes.size();
+	}
+
+	// passes added by the last addPasses(), final copy included
+	unsigned int passCount() const {
+		return frameStats.passes;
+	}
+
+	// for the hot reload; the uniform locations follow a rebuilt program
+	Shader& shader() {
+		return *program;
+	}
+
+	void destroy() {
+		if (program != NULL)
+		{
+			program->deleteShader();
+			delete program;
+			program = NULL;
+		}
+	}
+
+private:
+
+	struct Locations {
+		GLint inputTexture, inputScale, texelSize, filterMode, sharpness, kernel, kernelAmount;
+		GLint blurAxis, tapCount, tapOffsets, tapWeights, effectCount, effects, effectParams;
+	};
+
+	struct Stats {
+		unsigned int passes = 0;
+	};
+
+	Shader* program;
+	GLuint programID;
+	Locations locations;
+	std::vector<PostEffect> effects;
+	std::vector<Pass> passes;
+	Stats frameStats;
+
+	static Pass filterPass(Filter filter) {
+		Pass pass;
+		pass.filter = filter;
+		pass.axis = glm::vec2(0.0f);
+		pass.amount = 0.0f;
+		pass.tapCount = 0;
+		pass.effectCount = 0;
+		return pass;
+	}
+
+	// gaussian with sigma = radius / 2 folded into taps between texel pairs: texels i and i + 1
+	// with weights a and b are one bilinear fetch at i + b / (a + b) with weight a + b
+	static Pass blurPass(float radius, const glm::vec2& axis) {
+		Pass pass = filterPass(FILTER_BLUR);
+		pass.axis = axis;
+		int texels = std::min((int)std::ceil(radius), MAX_BLUR_RADIUS);
+		float sigma = std::max(radius * 0.5f, 0.5f);
+		float weights[MAX_BLUR_RADIUS + 2];
+		float sum = 0.0f;
+		for (int i = 0; i <= texels + 1; i++)
+		{
+			weights[i] = i <= texels ? std::exp(-0.5f * (i * i) / (sigma * sigma)) : 0.0f;
+			sum += i == 0 ? weights[i] : 2.0f * weights[i];
+		}
+		pass.tapOffsets[0] = 0.0f;
+		pass.tapWeights[0] = weights[0] / sum;
+		pass.tapCount = 1;
+		for (int i = 1; i <= texels; i += 2)
+		{
+			float weight = weights[i] + weights[i + 1];
+			pass.tapOffsets[pass.tapCount] = i + weights[i + 1] / weight;
+			pass.tapWeights[pass.tapCount] = weight / sum;
+			pass.tapCount++;
+		}
+		return pass;
+	}
+
+	void resolveLocations() {
+		GLuint id = program->ID;
+		locations.inputTexture = glGetUniformLocation(id, "inputTexture");
+		locations.inputScale = glGetUniformLocation(id, "inputScale");
+		locations.texelSize = glGetUniformLocation(id, "texelSize");
+		locations.filterMode = glGetUniformLocation(id, "filterMode");
+		locations.sharpness = glGetUniformLocation(id, "sharpness");
+		locations.kernel = glGetUniformLocation(id, "kernel");
+		locations.kernelAmount = glGetUniformLocation(id, "kernelAmount");
+		locations.blurAxis = glGetUniformLocation(id, "blurAxis");
+		locations.tapCount = glGetUniformLocation(id, "tapCount");
+		locations.tapOffsets = glGetUniformLocation(id, "tapOffsets");
+		locations.tapWeights = glGetUniformLocation(id, "tapWeights");
+		locations.effectCount = glGetUniformLocation(id, "effectCount");
+		locations.effects = glGetUniformLocation(id, "effects");
+		locations.effectParams = glGetUniformLocation(id, "effectParams");
+		programID = id;
+
+		// edge detection, the kernel framebuffer_fragment.frag used to compute and throw away
+		const glm::mat3 edges(1.0f, 1.0f, 1.0f, 1.0f, -8.0f, 1.0f, 1.0f, 1.0f, 1.0f);
+		glUniformMatrix3fv(locations.kernel, 1, GL_FALSE, &edges[0][0]);
+	}
+
+	void draw(const Pass& pass, GLuint input, GLuint quadVAO, const glm::vec2& inputScale, const glm::vec2& texel, float sharpness) {
+		GLState& state = GLState::get();
+		state.disable(GL_DEPTH_TEST);
+		state.disable(GL_STENCIL_TEST);
+		state.disable(GL_BLEND);
+		state.useProgram(program->ID);
+		state.bindVertexArray(quadVAO);
+		if (programID != program->ID)
+		{
+			resolveLocations();
+		}
+		state.bindTexture(0, GL_TEXTURE_2D, input);
+		glUniform1i(locations.inputTexture, 0);
+		glUniform2fv(locations.inputScale, 1, &inputScale[0]);
+		glUniform2fv(locations.texelSize, 1, &texel[0]);
+
+		glUniform1i(locations.filterMode, (GLint)pass.filter);
+		glUniform1f(locations.sharpness, sharpness);
+		glUniform1i(locations.effectCount, pass.effectCount);
+		if (pass.effectCount > 0)
+		{
+			glUniform1iv(locations.effects, pass.effectCount, pass.effects);
+			glUniform4fv(locations.effectParams, pass.effectCount, &pass.effectParams[0][0]);
+		}
+		if (pass.filter == FILTER_KERNEL)
+		{
+			glUniform1f(locations.kernelAmount, pass.amount);
+		}
+		else if (pass.filter == FILTER_BLUR)
+		{
+			glm::vec2 axis = pass.axis * texel;
+			glUniform2fv(locations.blurAxis, 1, &axis[0]);
+			glUniform1i(locations.tapCount, pass.tapCount);
+			glUniform1fv(locations.tapOffsets, pass.tapCount, pass.tapOffsets);
+			glUniform1fv(locations.tapWeights, pass.tapCount, pass.tapWeights);
+		}
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+		state.enable(GL_STENCIL_TEST);
+		state.enable(GL_DEPTH_TEST);
+	}
+
+};
+
+#endif
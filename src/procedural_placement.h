@@ -0,0 +1,203 @@
+#pragma once
+#ifndef PROCEDURAL_PLACEMENT_H
+#define PROCEDURAL_PLACEMENT_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#define PLACEMENT_SSE
+#endif
+
+// Counter-based random numbers: the value is a pure function of (seed, counter), so instance i
+// gets the same numbers whichever thread builds it and in whatever order.
+struct CounterRng {
+	// splitmix64 finalizer over the seed mixed with the counter
+	static uint64_t bits(uint64_t seed, uint64_t counter) {
+		uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ull;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	// uniform in [0, 1), 24 bits so every value is exact in a float
+	static float uniform(uint64_t seed, uint64_t counter) {
+		return (float)(bits(seed, counter) >> 40) * (1.0f / 16777216.0f);
+	}
+};
+
+// A ring of instances around center in the XZ plane (the asteroid belt): each instance sits at
+// radius +/- width on a random point of the ring, +/- height above it, uniformly scaled between
+// minScale and maxScale and spun around rotationAxis. Same seed, same belt.
+struct BeltParams {
+	uint64_t seed = 1;
+	size_t count = 0;
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 50.0f;
+	float width = 10.0f;
+	float height = 2.0f;
+	float minScale = 0.05f;
+	float maxScale = 0.25f;
+	glm::vec3 rotationAxis = glm::vec3(0.4f, 0.6f, 0.8f);
+};
+
+// Builds the model matrices of a belt, 4 instances per SSE batch (sin/cos included) and the batches
+// spread over the ThreadPool. Every instance goes through the same batch code, also the ones of a
+// partial last batch, so the output is bit-identical for any thread count or chunk split and can be
+// regenerated straight into mapped GPU memory instead of being copied.
+class ProceduralPlacement {
+public:
+
+	static const size_t CHUNK_SIZE = 16384; // multiple of the batch size
+
+	// random numbers drawn per instance
+	enum { RING_ANGLE, OFFSET_X, OFFSET_Y, OFFSET_Z, SCALE, SPIN, STREAMS };
+
+	// all params.count matrices into out, in parallel
+	static void buildBelt(const BeltParams& params, glm::mat4* out) {
+		ThreadPool::get().parallelFor(params.count, CHUNK_SIZE, [&](size_t, size_t begin, size_t end) {
+			buildBelt(params, out, begin, end);
+		});
+	}
+
+	// matrices [begin, end) into out[begin, end)
+	static void buildBelt(const BeltParams& params, glm::mat4* out, size_t begin, size_t end) {
+		glm::vec3 axis = glm::normalize(params.rotationAxis);
+		for (size_t i = begin; i < end; i += 4)
+		{
+			size_t lanes = std::min<size_t>(4, end - i);
+			float u[STREAMS][4];
+			for (size_t lane = 0; lane < 4; lane++)
+			{
+				// lanes past the end repeat the last instance and are not stored
+				uint64_t index = i + std::min(lane, lanes - 1);
+				for (int k = 0; k < STREAMS; k++)
+				{
+					u[k][lane] = CounterRng::uniform(params.seed, index * STREAMS + k);
+				}
+			}
+			glm::mat4 batch[4];
+			buildBatch(params, axis, u, batch);
+			memcpy(out + i, batch, lanes * sizeof(glm::mat4));
+		}
+	}
+
+private:
+
+	static constexpr float TWO_PI = 6.28318530718f;
+
+#if defined(PLACEMENT_SSE)
+	static __m128 select(__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// sin of x in [-pi, pi]: folded into [-pi/2, pi/2], then the odd Taylor series to x^11
+	// (error below 1e-7 there)
+	static __m128 sinReduced(__m128 x) {
+		const __m128 halfPi = _mm_set1_ps(1.57079632679f);
+		const __m128 pi = _mm_set1_ps(3.14159265359f);
+		x = select(_mm_cmpgt_ps(x, halfPi), _mm_sub_ps(pi, x), x);
+		x = select(_mm_cmplt_ps(x, _mm_sub_ps(_mm_setzero_ps(), halfPi)), _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), pi), x), x);
+		__m128 x2 = _mm_mul_ps(x, x);
+		__m128 p = _mm_set1_ps(-2.5052108e-8f);
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(2.7557319e-6f));
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.9841270e-4f));
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(8.3333333e-3f));
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.6666667e-1f));
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.0f));
+		return _mm_mul_ps(p, x);
+	}
+
+	// angles in [0, 2pi)
+	static void sinCos(__m128 angle, __m128& s, __m128& c) {
+		const __m128 pi = _mm_set1_ps(3.14159265359f);
+		const __m128 twoPi = _mm_set1_ps(TWO_PI);
+		__m128 x = select(_mm_cmpgt_ps(angle, pi), _mm_sub_ps(angle, twoPi), angle);
+		s = sinReduced(x);
+		// cos(x) = sin(x + pi/2), wrapped back into [-pi, pi]
+		__m128 y = _mm_add_ps(x, _mm_set1_ps(1.57079632679f));
+		y = select(_mm_cmpgt_ps(y, pi), _mm_sub_ps(y, twoPi), y);
+		c = sinReduced(y);
+	}
+
+	static __m128 lerp(const float* u, float a, float b) {
+		return _mm_add_ps(_mm_set1_ps(a), _mm_mul_ps(_mm_loadu_ps(u), _mm_set1_ps(b - a)));
+	}
+
+	// M = T(position) * S(scale) * R(axis, spin), the same product as translate/scale/rotate
+	static void buildBatch(const BeltParams& params, const glm::vec3& axis, const float u[STREAMS][4], glm::mat4* out) {
+		__m128 ringSin, ringCos;
+		sinCos(_mm_mul_ps(_mm_loadu_ps(u[RING_ANGLE]), _mm_set1_ps(TWO_PI)), ringSin, ringCos);
+		__m128 radius = _mm_set1_ps(params.radius);
+		__m128 px = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ringSin, radius), lerp(u[OFFSET_X], -params.width, params.width)), _mm_set1_ps(params.center.x));
+		__m128 py = _mm_add_ps(lerp(u[OFFSET_Y], -params.height, params.height), _mm_set1_ps(params.center.y));
+		__m128 pz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ringCos, radius), lerp(u[OFFSET_Z], -params.width, params.width)), _mm_set1_ps(params.center.z));
+		__m128 scale = lerp(u[SCALE], params.minScale, params.maxScale);
+
+		__m128 sn, c;
+		sinCos(_mm_mul_ps(_mm_loadu_ps(u[SPIN]), _mm_set1_ps(TWO_PI)), sn, c);
+		__m128 t = _mm_sub_ps(_mm_set1_ps(1.0f), c);
+		__m128 ax = _mm_set1_ps(axis.x), ay = _mm_set1_ps(axis.y), az = _mm_set1_ps(axis.z);
+		__m128 tx = _mm_mul_ps(t, ax), ty = _mm_mul_ps(t, ay), tz = _mm_mul_ps(t, az);
+		__m128 sx = _mm_mul_ps(sn, ax), sy = _mm_mul_ps(sn, ay), sz = _mm_mul_ps(sn, az);
+
+		// columns of the rotation (glm::rotate layout), each element scaled
+		__m128 m[4][4];
+		m[0][0] = _mm_mul_ps(scale, _mm_add_ps(_mm_mul_ps(tx, ax), c));
+		m[0][1] = _mm_mul_ps(scale, _mm_add_ps(_mm_mul_ps(tx, ay), sz));
+		m[0][2] = _mm_mul_ps(scale, _mm_sub_ps(_mm_mul_ps(tx, az), sy));
+		m[1][0] = _mm_mul_ps(scale, _mm_sub_ps(_mm_mul_ps(ty, ax), sz));
+		m[1][1] = _mm_mul_ps(scale, _mm_add_ps(_mm_mul_ps(ty, ay), c));
+		m[1][2] = _mm_mul_ps(scale, _mm_add_ps(_mm_mul_ps(ty, az), sx));
+		m[2][0] = _mm_mul_ps(scale, _mm_add_ps(_mm_mul_ps(tz, ax), sy));
+		m[2][1] = _mm_mul_ps(scale, _mm_sub_ps(_mm_mul_ps(tz, ay), sx));
+		m[2][2] = _mm_mul_ps(scale, _mm_add_ps(_mm_mul_ps(tz, az), c));
+		m[0][3] = m[1][3] = m[2][3] = _mm_setzero_ps();
+		m[3][0] = px;
+		m[3][1] = py;
+		m[3][2] = pz;
+		m[3][3] = _mm_set1_ps(1.0f);
+
+		// element-major to matrix-major: one 4x4 transpose per column
+		for (int col = 0; col < 4; col++)
+		{
+			__m128 r0 = m[col][0], r1 = m[col][1], r2 = m[col][2], r3 = m[col][3];
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(&out[0][col][0], r0);
+			_mm_storeu_ps(&out[1][col][0], r1);
+			_mm_storeu_ps(&out[2][col][0], r2);
+			_mm_storeu_ps(&out[3][col][0], r3);
+		}
+	}
+#else
+	static void buildBatch(const BeltParams& params, const glm::vec3& axis, const float u[STREAMS][4], glm::mat4* out) {
+		for (int lane = 0; lane < 4; lane++)
+		{
+			float ring = u[RING_ANGLE][lane] * TWO_PI;
+			float spin = u[SPIN][lane] * TWO_PI;
+			float scale = params.minScale + u[SCALE][lane] * (params.maxScale - params.minScale);
+			glm::vec3 position = params.center + glm::vec3(
+				std::sin(ring) * params.radius + (u[OFFSET_X][lane] * 2.0f - 1.0f) * params.width,
+				(u[OFFSET_Y][lane] * 2.0f - 1.0f) * params.height,
+				std::cos(ring) * params.radius + (u[OFFSET_Z][lane] * 2.0f - 1.0f) * params.width);
+			float c = std::cos(spin), s = std::sin(spin), t = 1.0f - c;
+			glm::mat4& m = out[lane];
+			m[0] = glm::vec4(scale * (t * axis.x * axis.x + c), scale * (t * axis.x * axis.y + s * axis.z), scale * (t * axis.x * axis.z - s * axis.y), 0.0f);
+			m[1] = glm::vec4(scale * (t * axis.y * axis.x - s * axis.z), scale * (t * axis.y * axis.y + c), scale * (t * axis.y * axis.z + s * axis.x), 0.0f);
+			m[2] = glm::vec4(scale * (t * axis.z * axis.x + s * axis.y), scale * (t * axis.z * axis.y - s * axis.x), scale * (t * axis.z * axis.z + c), 0.0f);
+			m[3] = glm::vec4(position, 1.0f);
+		}
+	}
+#endif
+
+};
+
+#endif
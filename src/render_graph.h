@@ -0,0 +1,556 @@
+#pragma once
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gl_state.h"
+#include "gpu_timer.h"
+
+// size, format and filter of a texture; transients with equal descriptions can share one
+struct TextureDesc {
+	int width, height;
+	GLenum internalFormat;
+	GLenum filter;
+
+	bool operator==(const TextureDesc& other) const {
+		return width == other.width && height == other.height && internalFormat == other.internalFormat && filter == other.filter;
+	}
+
+	bool operator!=(const TextureDesc& other) const {
+		return !(*this == other);
+	}
+};
+
+// a texture of the graph, valid until the next RenderGraph::reset()
+typedef int RenderResource;
+
+const RenderResource NO_RESOURCE = -1;
+
+// The passes of a frame, declared with what they read and write instead of hand made
+// framebuffers. compile() keeps a pass only when it has a side effect, writes an imported
+// resource (the scene targets, the window) or writes something a kept pass after it reads;
+// passes run in declaration order, which is already an order where every read comes after
+// its writes. Transient textures live from the first to the last kept pass that touches them
+// and come from a pool: one whose lifetime is over is handed to the next transient with the
+// same description, so a chain of passes aliases its intermediates onto two textures. GL 3.3
+// has no placement of textures in shared memory, so aliasing is reuse of the texture object.
+// Pooled textures survive frames and are deleted after MAX_IDLE_FRAMES without use, or at once
+// when the same format is requested at another size (a resize). Framebuffers are cached by
+// their attachments. With a GpuTimer attached, every pass that runs is timed under its name.
+class RenderGraph {
+public:
+
+	static const unsigned int MAX_IDLE_FRAMES = 8;
+
+	typedef std::function<void(RenderGraph&)> Execute;
+
+	struct Stats {
+		unsigned int passes = 0;
+		unsigned int culled = 0;
+		unsigned int transients = 0;
+		unsigned int textures = 0;          // pooled textures behind the transients
+		size_t bytes = 0;                   // of those textures
+		size_t unaliasedBytes = 0;          // one texture per transient
+	};
+
+	// declares what one pass touches; every call returns the builder so they chain
+	class PassBuilder {
+	public:
+
+		PassBuilder(RenderGraph& graph, size_t pass) : graph(graph), pass(pass) {}
+
+		// sampled by the pass
+		PassBuilder& read(RenderResource resource) {
+			graph.passes[pass].reads.push_back(resource);
+			return *this;
+		}
+
+		// the next color attachment
+		PassBuilder& write(RenderResource resource) {
+			graph.passes[pass].colors.push_back(resource);
+			return *this;
+		}
+
+		// depth (stencil) attachment; only tested when write is false
+		PassBuilder& depthStencil(RenderResource resource, bool write) {
+			graph.passes[pass].depth = resource;
+			graph.passes[pass].depthWrite = write;
+			return *this;
+		}
+
+		// defaults to the size of the first attachment
+		PassBuilder& viewport(const glm::ivec2& size) {
+			graph.passes[pass].viewport = size;
+			return *this;
+		}
+
+		// kept even when nothing reads what it writes
+		PassBuilder& sideEffect() {
+			graph.passes[pass].sideEffect = true;
+			return *this;
+		}
+
+	private:
+
+		RenderGraph& graph;
+		size_t pass;
+
+	};
+
+	RenderGraph() : frame(0), timer(NULL) {}
+
+	// starts the declaration of a frame; the pool and the framebuffers are kept
+	void reset() {
+		resources.clear();
+		passes.clear();
+	}
+
+	// a texture owned outside the graph, e.g. by RenderTargets
+	RenderResource import(const std::string& name, GLuint texture, const TextureDesc& desc) {
+		Resource resource = { name, desc, texture, true, false, -1, -1 };
+		resources.push_back(resource);
+		return (RenderResource)resources.size() - 1;
+	}
+
+	// the default framebuffer; a pass writing it has no other attachment
+	RenderResource importBackbuffer(int width, int height) {
+		TextureDesc desc = { width, height, GL_RGBA8, GL_NEAREST };
+		Resource resource = { "backbuffer", desc, 0, true, true, -1, -1 };
+		resources.push_back(resource);
+		return (RenderResource)resources.size() - 1;
+	}
+
+	// a texture that only lives inside this frame's graph
+	RenderResource create(const std::string& name, const TextureDesc& desc) {
+		Resource resource = { name, desc, 0, false, false, -1, -1 };
+		resources.push_back(resource);
+		return (RenderResource)resources.size() - 1;
+	}
+
+	PassBuilder addPass(const std::string& name, const Execute& execute) {
+		Pass pass;
+		pass.name = name;
+		pass.execute = execute;
+		pass.depth = NO_RESOURCE;
+		pass.depthWrite = false;
+		pass.viewport = glm::ivec2(0);
+		pass.sideEffect = false;
+		pass.culled = false;
+		pass.framebuffer = 0;
+		passes.push_back(pass);
+		return PassBuilder(*this, passes.size() - 1);
+	}
+
+	// culls the passes, assigns pooled textures to the transients and finds the framebuffers
+	void compile() {
+		frame++;
+		frameStats = Stats();
+		frameStats.passes = (unsigned int)passes.size();
+
+		std::vector<bool> live(resources.size(), false);
+		for (size_t i = passes.size(); i-- > 0;)
+		{
+			Pass& pass = passes[i];
+			bool needed = pass.sideEffect;
+			for (size_t c = 0; c < pass.colors.size(); c++)
+			{
+				needed = needed || resources[pass.colors[c]].imported || live[pass.colors[c]];
+			}
+			if (pass.depth != NO_RESOURCE && pass.depthWrite)
+			{
+				needed = needed || resources[pass.depth].imported || live[pass.depth];
+			}
+			pass.culled = !needed;
+			if (pass.culled)
+			{
+				frameStats.culled++;
+				continue;
+			}
+			for (size_t r = 0; r < pass.reads.size(); r++)
+			{
+				live[pass.reads[r]] = true;
+			}
+			if (pass.depth != NO_RESOURCE)
+			{
+				live[pass.depth] = true;
+			}
+		}
+
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			if (!passes[i].culled)
+			{
+				touch(passes[i], (int)i);
+			}
+		}
+		for (size_t p = 0; p < pool.size(); p++)
+		{
+			pool[p].busy = false;
+		}
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			// acquired before the ones ending here are released, so a pass never reads what it writes
+			for (size_t r = 0; r < resources.size(); r++)
+			{
+				if (!resources[r].imported && resources[r].first == (int)i)
+				{
+					resources[r].texture = acquire(resources[r].desc);
+					frameStats.transients++;
+					frameStats.unaliasedBytes += bytes(resources[r].desc);
+				}
+			}
+			for (size_t r = 0; r < resources.size(); r++)
+			{
+				if (!resources[r].imported && resources[r].last == (int)i)
+				{
+					release(resources[r].texture);
+				}
+			}
+		}
+		trimPool();
+
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			if (!passes[i].culled)
+			{
+				prepare(passes[i]);
+			}
+		}
+	}
+
+	// times every pass from now on, NULL to stop; beginFrame() and endFrame() are the caller's
+	void setTimer(GpuTimer* gpuTimer) {
+		timer = gpuTimer;
+	}
+
+	// runs the kept passes, each with its framebuffer and viewport bound; leaves the window bound
+	void execute() {
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			const Pass& pass = passes[i];
+			if (pass.culled)
+			{
+				continue;
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+			glViewport(0, 0, pass.viewport.x, pass.viewport.y);
+			if (timer != NULL)
+			{
+				timer->begin(pass.name);
+			}
+			pass.execute(*this);
+			if (timer != NULL)
+			{
+				timer->end();
+			}
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// the GL texture behind a resource, for the passes that sample it
+	GLuint texture(RenderResource resource) const {
+		return resources[resource].texture;
+	}
+
+	const TextureDesc& desc(RenderResource resource) const {
+		return resources[resource].desc;
+	}
+
+	Stats stats() const {
+		return frameStats;
+	}
+
+	void destroy() {
+		GLState& state = GLState::get();
+		for (size_t p = 0; p < pool.size(); p++)
+		{
+			state.forgetTexture(pool[p].texture);
+			glDeleteTextures(1, &pool[p].texture);
+		}
+		pool.clear();
+		for (std::map<std::vector<GLuint>, CachedFramebuffer>::iterator it = framebuffers.begin(); it != framebuffers.end(); ++it)
+		{
+			glDeleteFramebuffers(1, &it->second.id);
+		}
+		framebuffers.clear();
+		reset();
+	}
+
+private:
+
+	struct Resource {
+		std::string name;
+		TextureDesc desc;
+		GLuint texture;
+		bool imported;
+		bool backbuffer;
+		int first, last;                    // kept passes that touch it, transients only
+	};
+
+	struct Pass {
+		std::string name;
+		Execute execute;
+		std::vector<RenderResource> reads;
+		std::vector<RenderResource> colors;
+		RenderResource depth;
+		bool depthWrite;
+		glm::ivec2 viewport;
+		bool sideEffect;
+		bool culled;
+		GLuint framebuffer;
+	};
+
+	struct PooledTexture {
+		TextureDesc desc;
+		GLuint texture;
+		unsigned int lastFrame;
+		bool busy;
+	};
+
+	struct CachedFramebuffer {
+		GLuint id;
+		bool complete;
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<PooledTexture> pool;
+	std::map<std::vector<GLuint>, CachedFramebuffer> framebuffers;
+	unsigned int frame;
+	GpuTimer* timer;
+	Stats frameStats;
+
+	static void pixelFormat(GLenum internalFormat, GLenum& format, GLenum& type, size_t& size) {
+		switch (internalFormat)
+		{
+		case GL_RGB8:
+			format = GL_RGB; type = GL_UNSIGNED_BYTE; size = 3;
+			break;
+		case GL_RGB16F:
+			format = GL_RGB; type = GL_HALF_FLOAT; size = 6;
+			break;
+		case GL_RGBA16F:
+			format = GL_RGBA; type = GL_HALF_FLOAT; size = 8;
+			break;
+		case GL_RG16:
+			format = GL_RG; type = GL_UNSIGNED_SHORT; size = 4;
+			break;
+		case GL_R16F:
+			format = GL_RED; type = GL_HALF_FLOAT; size = 2;
+			break;
+		case GL_R32F:
+			format = GL_RED; type = GL_FLOAT; size = 4;
+			break;
+		case GL_DEPTH24_STENCIL8:
+			format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; size = 4;
+			break;
+		case GL_DEPTH_COMPONENT32F:
+			format = GL_DEPTH_COMPONENT; type = GL_FLOAT; size = 4;
+			break;
+		default:
+			format = GL_RGBA; type = GL_UNSIGNED_BYTE; size = 4;
+			break;
+		}
+	}
+
+	static size_t bytes(const TextureDesc& desc) {
+		GLenum format, type;
+		size_t size;
+		pixelFormat(desc.internalFormat, format, type, size);
+		return size * desc.width * desc.height;
+	}
+
+	void touch(const Pass& pass, int index) {
+		for (size_t r = 0; r < pass.reads.size(); r++)
+		{
+			extend(pass.reads[r], index);
+		}
+		for (size_t c = 0; c < pass.colors.size(); c++)
+		{
+			extend(pass.colors[c], index);
+		}
+		if (pass.depth != NO_RESOURCE)
+		{
+			extend(pass.depth, index);
+		}
+	}
+
+	void extend(RenderResource resource, int index) {
+		Resource& r = resources[resource];
+		if (r.first < 0)
+		{
+			r.first = index;
+		}
+		r.last = index;
+	}
+
+	GLuint acquire(const TextureDesc& desc) {
+		for (size_t p = 0; p < pool.size(); p++)
+		{
+			if (!pool[p].busy && pool[p].desc == desc)
+			{
+				return use(pool[p]);
+			}
+		}
+		PooledTexture pooled = { desc, 0, 0, false };
+		glGenTextures(1, &pooled.texture);
+		GLState::get().bindTexture(0, GL_TEXTURE_2D, pooled.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		GLenum format, type;
+		size_t size;
+		pixelFormat(desc.internalFormat, format, type, size);
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+		pool.push_back(pooled);
+		return use(pool.back());
+	}
+
+	GLuint use(PooledTexture& pooled) {
+		if (pooled.lastFrame != frame)
+		{
+			frameStats.textures++;
+			frameStats.bytes += bytes(pooled.desc);
+		}
+		pooled.busy = true;
+		pooled.lastFrame = frame;
+		return pooled.texture;
+	}
+
+	void release(GLuint texture) {
+		for (size_t p = 0; p < pool.size(); p++)
+		{
+			if (pool[p].texture == texture)
+			{
+				pool[p].busy = false;
+			}
+		}
+	}
+
+	// drops what was not used this frame and is either stale or the wrong size for this frame
+	void trimPool() {
+		GLState& state = GLState::get();
+		for (size_t p = pool.size(); p-- > 0;)
+		{
+			const PooledTexture& pooled = pool[p];
+			if (pooled.lastFrame == frame)
+			{
+				continue;
+			}
+			bool resized = false;
+			for (size_t r = 0; r < resources.size() && !resized; r++)
+			{
+				const TextureDesc& desc = resources[r].desc;
+				resized = !resources[r].imported && resources[r].first >= 0 && desc.internalFormat == pooled.desc.internalFormat
+					&& desc.filter == pooled.desc.filter && (desc.width != pooled.desc.width || desc.height != pooled.desc.height);
+			}
+			if (!resized && frame - pooled.lastFrame <= MAX_IDLE_FRAMES)
+			{
+				continue;
+			}
+			forgetFramebuffers(pooled.texture);
+			state.forgetTexture(pooled.texture);
+			glDeleteTextures(1, &pooled.texture);
+			pool.erase(pool.begin() + p);
+		}
+	}
+
+	void forgetFramebuffers(GLuint texture) {
+		std::map<std::vector<GLuint>, CachedFramebuffer>::iterator it = framebuffers.begin();
+		while (it != framebuffers.end())
+		{
+			bool attached = false;
+			for (size_t i = 0; i < it->first.size(); i++)
+			{
+				attached = attached || it->first[i] == texture;
+			}
+			if (attached)
+			{
+				glDeleteFramebuffers(1, &it->second.id);
+				it = framebuffers.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	// the framebuffer of the attachments (the window when it writes the backbuffer) and the viewport
+	void prepare(Pass& pass) {
+		RenderResource first = !pass.colors.empty() ? pass.colors[0] : pass.depth;
+		if (pass.viewport == glm::ivec2(0) && first != NO_RESOURCE)
+		{
+			pass.viewport = glm::ivec2(resources[first].desc.width, resources[first].desc.height);
+		}
+		if (first == NO_RESOURCE || resources[first].backbuffer)
+		{
+			pass.framebuffer = 0;
+			return;
+		}
+
+		// colors, then the depth attachment (0 for none)
+		std::vector<GLuint> key;
+		for (size_t c = 0; c < pass.colors.size(); c++)
+		{
+			key.push_back(resources[pass.colors[c]].texture);
+		}
+		key.push_back(pass.depth != NO_RESOURCE ? resources[pass.depth].texture : 0);
+		std::map<std::vector<GLuint>, CachedFramebuffer>::iterator it = framebuffers.find(key);
+		if (it == framebuffers.end())
+		{
+			it = framebuffers.insert(std::make_pair(key, createFramebuffer(pass))).first;
+		}
+		if (!it->second.complete)
+		{
+			pass.culled = true;
+			return;
+		}
+		pass.framebuffer = it->second.id;
+	}
+
+	CachedFramebuffer createFramebuffer(const Pass& pass) {
+		CachedFramebuffer framebuffer;
+		glGenFramebuffers(1, &framebuffer.id);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id);
+		std::vector<GLenum> buffers;
+		for (size_t c = 0; c < pass.colors.size(); c++)
+		{
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)c, GL_TEXTURE_2D, resources[pass.colors[c]].texture, 0);
+			buffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)c);
+		}
+		if (pass.depth != NO_RESOURCE)
+		{
+			GLenum format = resources[pass.depth].desc.internalFormat;
+			GLenum attachment = format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, resources[pass.depth].texture, 0);
+		}
+		if (buffers.empty())
+		{
+			glDrawBuffer(GL_NONE);
+		}
+		else
+		{
+			glDrawBuffers((GLsizei)buffers.size(), buffers.data());
+		}
+		framebuffer.complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (!framebuffer.complete)
+		{
+			std::cout << "ERROR::RENDER_GRAPH::FRAMEBUFFER_INCOMPLETE " << pass.name << std::endl;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return framebuffer;
+	}
+
+};
+
+#endif
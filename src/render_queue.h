@@ -0,0 +1,316 @@
+#pragma once
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "shader.h"
+#include "gl_state.h"
+#include "gl_ext.h"
+
+// Passes run in this order; the pass is the top of the sort key.
+enum RenderPass {
+	PASS_OPAQUE = 0,
+	PASS_SKY = 1,
+	PASS_TRANSPARENT = 2
+};
+
+// Texture set of a draw: diffuse on unit 0, specular on unit 1 (the "material" sampler convention
+// of fragment_shader.frag). A zero specular reuses the diffuse texture.
+struct DrawMaterial {
+	GLuint diffuse;
+	GLuint specular;
+	GLenum target; // 0 is GL_TEXTURE_2D; GL_TEXTURE_2D_ARRAY for MultiDrawModel
+};
+
+// Everything needed to replay one draw call.
+struct DrawItem {
+	GLuint program;
+	GLuint vao;
+	DrawMaterial material;
+	GLenum mode;
+	GLsizei count;      // vertices (arrays) or indices (elements)
+	GLsizei instances;  // 1 for a plain draw
+	bool indexed;
+	glm::mat4 model;
+	// when set, count/instances come from the drawCount DrawElementsIndirectCommands starting at
+	// this offset, issued as one glMultiDrawElementsIndirect (GL 4.3)
+	GLuint indirectBuffer;
+	GLintptr indirectOffset;
+	GLsizei drawCount;
+};
+
+// Records draws as 64-bit sort keys plus a payload, radix sorts the keys every frame and replays
+// them with as few state changes as possible:
+//
+//   opaque/sky:  pass:2 | program:10 | material:14 | vao:14 | depth:24   (state first, front-to-back)
+//   transparent: pass:2 | ~depth:24  | program:10  | material:14 | vao:14 (back-to-front first)
+//
+// Programs, materials and VAOs are mapped to small dense ids the first time they are seen in a frame.
+class RenderQueue {
+public:
+
+	struct Stats {
+		unsigned int draws = 0;
+		// program + material + VAO switches if the draws ran in submission order vs sorted order
+		unsigned int stateChangesSubmitted = 0;
+		unsigned int stateChangesSorted = 0;
+	};
+
+	// the view is used to compute the depth part of the keys
+	void begin(const glm::mat4& view, float farPlane) {
+		this->view = view;
+		this->farPlane = farPlane;
+		items.clear();
+		entries.clear();
+		// dense ids only order the draws of one frame, so they start over and never outgrow their key bits
+		programIds.clear();
+		materialIds.clear();
+		vaoIds.clear();
+	}
+
+	void submit(RenderPass pass, const Shader& shader, GLuint vao, DrawMaterial material, GLenum mode, GLsizei count,
+		bool indexed, const glm::mat4& model, GLsizei instances = 1) {
+		if (material.specular == 0)
+		{
+			material.specular = material.diffuse;
+		}
+		DrawItem item = { shader.ID, vao, material, mode, count, instances, indexed, model, 0, 0, 1 };
+		submit(pass, item, glm::vec3(model[3]));
+	}
+
+	// center is the world position used for depth ordering (object origin or bounds center)
+	void submit(RenderPass pass, const DrawItem& item, const glm::vec3& center) {
+		float viewDepth = -(view * glm::vec4(center, 1.0f)).z;
+		uint64_t depth = (uint64_t)(glm::clamp(viewDepth / farPlane, 0.0f, 1.0f) * 0xFFFFFF);
+		uint64_t program = denseId(programIds, item.program, 0x3FF);
+		uint64_t material = denseId(materialIds, ((uint64_t)item.material.diffuse << 32) | item.material.specular, 0x3FFF);
+		uint64_t vao = denseId(vaoIds, item.vao, 0x3FFF);
+
+		uint64_t key = (uint64_t)pass << 62;
+		if (pass == PASS_TRANSPARENT)
+		{
+			key |= ((0xFFFFFF - depth) << 38) | (program << 28) | (material << 14) | vao;
+		}
+		else
+		{
+			key |= (program << 52) | (material << 38) | (vao << 24) | depth;
+		}
+
+		Entry entry = { key, (uint32_t)items.size() };
+		entries.push_back(entry);
+		items.push_back(item);
+	}
+
+	void sort() {
+		frameStats = Stats();
+		frameStats.draws = (unsigned int)entries.size();
+		frameStats.stateChangesSubmitted = countStateChanges(entries);
+		radixSort(entries, scratch);
+		frameStats.stateChangesSorted = countStateChanges(entries);
+	}
+
+	// replays the sorted draws of passes [first, last]; per-program uniforms (view, projection...)
+	// must already be set. Splitting the passes lets work run between them (Hi-Z after the opaque
+	// geometry).
+	void execute(RenderPass first = PASS_OPAQUE, RenderPass last = PASS_TRANSPARENT) {
+		GLState& state = GLState::get();
+		int currentPass = -1;
+		GLuint currentProgram = 0;
+		GLint modelLocation = -1;
+		// a deleted program name may come back as another program
+		if (state.programDeletions() != locationDeletions)
+		{
+			modelLocations.clear();
+			locationDeletions = state.programDeletions();
+		}
+
+		for (const Entry& entry : entries)
+		{
+			const DrawItem& item = items[entry.index];
+			int pass = (int)(entry.key >> 62);
+			if (pass < first || pass > last)
+			{
+				continue;
+			}
+			if (pass != currentPass)
+			{
+				beginPass(pass);
+				currentPass = pass;
+			}
+			if (item.program != currentProgram)
+			{
+				state.useProgram(item.program);
+				modelLocation = modelLocationOf(item.program);
+				currentProgram = item.program;
+			}
+			GLenum target = item.material.target != 0 ? item.material.target : GL_TEXTURE_2D;
+			state.bindTexture(0, target, item.material.diffuse);
+			state.bindTexture(1, target, item.material.specular);
+			state.bindVertexArray(item.vao);
+			glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(item.model));
+
+			if (item.indirectBuffer != 0)
+			{
+				state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, item.indirectBuffer);
+				GLExt::get().multiDrawElementsIndirect(item.mode, GL_UNSIGNED_INT, (const void*)item.indirectOffset, item.drawCount, 0);
+			}
+			else if (item.indexed)
+			{
+				glDrawElementsInstanced(item.mode, item.count, GL_UNSIGNED_INT, 0, item.instances);
+			}
+			else
+			{
+				glDrawArraysInstanced(item.mode, 0, item.count, item.instances);
+			}
+		}
+		// back to the defaults the rest of main.cpp expects
+		state.depthMask(GL_TRUE);
+		state.depthFunc(GL_LESS);
+	}
+
+	const Stats& stats() const {
+		return frameStats;
+	}
+
+private:
+
+	struct Entry {
+		uint64_t key;
+		uint32_t index;
+	};
+
+	std::vector<DrawItem> items;
+	std::vector<Entry> entries;
+	std::vector<Entry> scratch;
+	std::map<uint64_t, uint32_t> programIds;
+	std::map<uint64_t, uint32_t> materialIds;
+	std::map<uint64_t, uint32_t> vaoIds;
+	std::map<GLuint, GLint> modelLocations;
+	unsigned int locationDeletions = 0;     // GLState::programDeletions() when modelLocations was filled
+	glm::mat4 view = glm::mat4(1.0f);
+	float farPlane = 100.0f;
+	Stats frameStats;
+
+	static uint64_t denseId(std::map<uint64_t, uint32_t>& ids, uint64_t name, uint32_t mask) {
+		std::map<uint64_t, uint32_t>::iterator it = ids.find(name);
+		if (it == ids.end())
+		{
+			it = ids.insert(std::make_pair(name, (uint32_t)ids.size())).first;
+		}
+		return it->second & mask;
+	}
+
+	// looked up once per program rather than on every program switch
+	GLint modelLocationOf(GLuint program) {
+		std::map<GLuint, GLint>::iterator it = modelLocations.find(program);
+		if (it == modelLocations.end())
+		{
+			it = modelLocations.insert(std::make_pair(program, glGetUniformLocation(program, "model"))).first;
+		}
+		return it->second;
+	}
+
+	static void beginPass(int pass) {
+		GLState& state = GLState::get();
+		switch (pass)
+		{
+		case PASS_OPAQUE:
+			state.disable(GL_BLEND);
+			state.depthMask(GL_TRUE);
+			state.depthFunc(GL_LESS);
+			break;
+		case PASS_SKY:
+			// the skybox writes depth 1.0, drawn after the opaque geometry it only fills the gaps
+			state.depthFunc(GL_LEQUAL);
+			break;
+		case PASS_TRANSPARENT:
+			state.enable(GL_BLEND);
+			state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			state.depthFunc(GL_LESS);
+			state.depthMask(GL_FALSE);
+			break;
+		}
+	}
+
+	unsigned int countStateChanges(const std::vector<Entry>& order) const {
+		unsigned int changes = 0;
+		const DrawItem* previous = NULL;
+		for (const Entry& entry : order)
+		{
+			const DrawItem& item = items[entry.index];
+			if (previous == NULL || previous->program != item.program)
+			{
+				changes++;
+			}
+			if (previous == NULL || previous->material.diffuse != item.material.diffuse || previous->material.specular != item.material.specular)
+			{
+				changes++;
+			}
+			if (previous == NULL || previous->vao != item.vao)
+			{
+				changes++;
+			}
+			previous = &item;
+		}
+		return changes;
+	}
+
+	// LSD radix sort on the 64-bit keys, 8 bits per pass; bytes that are the same for every key
+	// (most of them on small frames) are skipped
+	static void radixSort(std::vector<Entry>& entries, std::vector<Entry>& scratch) {
+		size_t n = entries.size();
+		if (n < 2)
+		{
+			return;
+		}
+		uint32_t histograms[8][256];
+		memset(histograms, 0, sizeof(histograms));
+		for (const Entry& entry : entries)
+		{
+			for (int b = 0; b < 8; b++)
+			{
+				histograms[b][(entry.key >> (b * 8)) & 0xFF]++;
+			}
+		}
+
+		scratch.resize(n);
+		std::vector<Entry>* src = &entries;
+		std::vector<Entry>* dst = &scratch;
+		for (int b = 0; b < 8; b++)
+		{
+			uint32_t* histogram = histograms[b];
+			if (histogram[((*src)[0].key >> (b * 8)) & 0xFF] == n)
+			{
+				continue;
+			}
+			uint32_t offsets[256];
+			uint32_t sum = 0;
+			for (int i = 0; i < 256; i++)
+			{
+				offsets[i] = sum;
+				sum += histogram[i];
+			}
+			for (const Entry& entry : *src)
+			{
+				(*dst)[offsets[(entry.key >> (b * 8)) & 0xFF]++] = entry;
+			}
+			std::swap(src, dst);
+		}
+		if (src != &entries)
+		{
+			entries.swap(scratch);
+		}
+	}
+
+};
+
+#endif
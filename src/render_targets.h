@@ -0,0 +1,124 @@
+#pragma once
+#ifndef RENDER_TARGETS_H
+#define RENDER_TARGETS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include "gl_state.h"
+
+// The offscreen scene framebuffer: a color texture (linear filtered, for the upscale to the
+// window) and a depth stencil texture (read by HiZBuffer, shared by WeightedBlendedOIT). The
+// attachments follow the window through resize() and keep their names, so framebuffers that
+// share them stay complete. With a render scale below 1 only the lower left renderSize() is
+// drawn into (bind() sets that viewport) and uvScale() tells the upscale how much to read.
+class RenderTargets {
+public:
+
+	RenderTargets() : fbo(0), colorBuffer(0), depthStencilBuffer(0), width(0), height(0), renderScale(1.0f) {}
+
+	bool create(int width, int height) {
+		glGenFramebuffers(1, &fbo);
+		glGenTextures(1, &colorBuffer);
+		glGenTextures(1, &depthStencilBuffer);
+		GLState& state = GLState::get();
+		state.bindTexture(0, GL_TEXTURE_2D, colorBuffer);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		state.bindTexture(0, GL_TEXTURE_2D, depthStencilBuffer);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		resize(width, height);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffer, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthStencilBuffer, 0);
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return complete;
+	}
+
+	// false when nothing changed, or for a minimized (0 x 0) window
+	bool resize(int width, int height) {
+		if (width <= 0 || height <= 0 || (width == this->width && height == this->height))
+		{
+			return false;
+		}
+		this->width = width;
+		this->height = height;
+		GLState& state = GLState::get();
+		state.bindTexture(0, GL_TEXTURE_2D, colorBuffer);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		state.bindTexture(0, GL_TEXTURE_2D, depthStencilBuffer);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+		return true;
+	}
+
+	// fraction of each axis rendered, clamped to (0, 1]
+	void setScale(float scale) {
+		renderScale = std::min(std::max(scale, 0.05f), 1.0f);
+	}
+
+	float scale() const {
+		return renderScale;
+	}
+
+	glm::ivec2 size() const {
+		return glm::ivec2(width, height);
+	}
+
+	glm::ivec2 renderSize() const {
+		return glm::max(glm::ivec2(std::lround(width * renderScale), std::lround(height * renderScale)), glm::ivec2(1));
+	}
+
+	// texture coordinates of the upper right corner of what was rendered
+	glm::vec2 uvScale() const {
+		return glm::vec2(renderSize()) / glm::vec2(size());
+	}
+
+	// the framebuffer with the viewport of renderSize()
+	void bind() const {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glm::ivec2 render = renderSize();
+		glViewport(0, 0, render.x, render.y);
+	}
+
+	GLuint framebuffer() const {
+		return fbo;
+	}
+
+	GLuint colorTexture() const {
+		return colorBuffer;
+	}
+
+	GLuint depthTexture() const {
+		return depthStencilBuffer;
+	}
+
+	void destroy() {
+		GLState& state = GLState::get();
+		state.forgetTexture(colorBuffer);
+		state.forgetTexture(depthStencilBuffer);
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(1, &colorBuffer);
+		glDeleteTextures(1, &depthStencilBuffer);
+		fbo = colorBuffer = depthStencilBuffer = 0;
+		width = height = 0;
+	}
+
+private:
+
+	GLuint fbo;
+	GLuint colorBuffer;
+	GLuint depthStencilBuffer;
+	int width, height;
+	float renderScale;
+
+};
+
+#endif
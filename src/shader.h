@@ -8,11 +8,22 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "gl_state.h"
+#include "gl_ext.h"
+
+// release builds bake the preprocessed shaders into the binary (see tools/shader_embed.cpp and the
+// Makefile); without SHADER_EMBED the loose files under assets/shaders are read, which is what the
+// hot reload needs
+#ifdef SHADER_EMBED
+#include "embedded_shaders.h"
+#endif
+
 
 class Shader {
 
@@ -20,103 +31,106 @@ public:
 	GLuint ID;
 
 
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath) {
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::string geometryCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::string geometryPath;
+	// files pulled in through #include by any stage, the hot reload watches them too
+	std::vector<std::string> includes;
 
-		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
-		try
-		{
-			std::stringstream vShaderStream, fShaderStream, gShaderStream;
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
+		: vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath) {
 
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			if (strcmp(geometryPath, "") != 0)
-			{
-				gShaderFile.open(geometryPath);
-				gShaderStream << gShaderFile.rdbuf();
-				geometryCode = gShaderStream.str();
-				gShaderFile.close();
+		GLuint vertex, fragment, geometry = 0;
+		this->ID = beginBuild(vertex, fragment, geometry);
 
-			}
+		checkCompileErrors(vertex, "VERTEX");
+		checkCompileErrors(fragment, "FRAGMENT");
+		if (geometry != 0)
+		{
+			checkCompileErrors(geometry, "GEOMETRY");
+		}
+		checkCompileErrors(ID, "PROGRAM");
 
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
+		// delete the shaders as they're linked into our program now and no longer necessary
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		//glDeleteShader(geometry);
 
-		}
-		catch (std::ifstream::failure e)
+	};
+
+	// reads every stage from disk again and issues compile + link without waiting for the result,
+	// so drivers with parallel compilation can build it in the background (used by the hot reload)
+	GLuint beginBuild(GLuint& vertex, GLuint& fragment, GLuint& geometry) {
+		includes.clear();
+		std::string vertexCode = readSource(vertexPath, includes);
+		std::string fragmentCode = readSource(fragmentPath, includes);
+		std::string geometryCode;
+		if (!geometryPath.empty())
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			geometryCode = readSource(geometryPath, includes);
 		}
 
 		const char* vShaderCode = vertexCode.c_str();
 		const char* fShaderCode = fragmentCode.c_str();
 
-		GLuint vertex, fragment, geometry = 0;
-
-		if (strcmp(geometryPath, "") != 0)
+		geometry = 0;
+		if (!geometryPath.empty())
 		{
 			const char* gShaderCode = geometryCode.c_str();
 			//COMPILANDO O GEOMETRY SHADER NA GPU
 			geometry = glCreateShader(GL_GEOMETRY_SHADER);
 			glShaderSource(geometry, 1, &gShaderCode, NULL);
 			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
 		}
 
-		//createShaders
-
 		//COMPILANDO O VERTEX SHADER NA GPU
 		vertex = glCreateShader(GL_VERTEX_SHADER);
 		glShaderSource(vertex, 1, &vShaderCode, NULL);
 		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
 
 		//COMPILANDO O FRAGMENT SHADER NA GPU
 		fragment = glCreateShader(GL_FRAGMENT_SHADER);
 		glShaderSource(fragment, 1, &fShaderCode, NULL);
 		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
 
 
 		//JUNTANDO OS SHADERS EM UM PROGRAMA
-		this->ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		if (strcmp(geometryPath, "") != 0)
+		GLuint program = glCreateProgram();
+		glAttachShader(program, vertex);
+		glAttachShader(program, fragment);
+		if (geometry != 0)
 		{
-			glAttachShader(ID, geometry);
+			glAttachShader(program, geometry);
 		}
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
+		glLinkProgram(program);
 
-		// delete the shaders as they're linked into our program now and no longer necessary
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-		//glDeleteShader(geometry);
+		return program;
+	}
+
+	// true when one of the stages of this program was loaded from the given file
+	bool usesFile(const std::string& path) const {
+		if (path == vertexPath || path == fragmentPath || (!geometryPath.empty() && path == geometryPath))
+		{
+			return true;
+		}
+		for (const std::string& include : includes)
+		{
+			if (path == include)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
 
-	};
 	//use active shader
 	void use() {
-		glUseProgram(ID);
+		GLState::get().useProgram(ID);
 	};
 
 	void deleteShader() {
+		GLState::get().forgetProgram(ID);
 		glDeleteProgram(ID);
 	}
 	//utility func
@@ -175,10 +189,9 @@ public:
 		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
 	}
 
-private:
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
-	void checkCompileErrors(unsigned int shader, std::string type)
+	static bool checkCompileErrors(unsigned int shader, std::string type)
 	{
 		int success;
 		char infoLog[1024];
@@ -200,8 +213,121 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 			}
 		}
+		return success != 0;
+	}
+
+protected:
+
+	Shader() : ID(0) {}
+
+	static std::string readSource(const std::string& path, std::vector<std::string>& includes)
+	{
+#ifdef SHADER_EMBED
+		std::string key = path;
+		while (key.compare(0, 2, "./") == 0)
+		{
+			key.erase(0, 2);
+		}
+		for (int i = 0; i < EMBEDDED_SHADER_COUNT; i++)
+		{
+			if (key == EMBEDDED_SHADERS[i].path)
+			{
+				return EMBEDDED_SHADERS[i].source;
+			}
+		}
+		std::cout << "ERROR::SHADER::NOT_EMBEDDED " << path << ", reading it from disk" << std::endl;
+#endif
+		return resolveIncludes(path, readFile(path), includes);
+	}
+
+	// same #include "file" rule as tools/shader_embed.cpp, so loose files and embedded ones match
+	static std::string resolveIncludes(const std::string& path, const std::string& source, std::vector<std::string>& includes)
+	{
+		if (source.find("#include") == std::string::npos)
+		{
+			return source;
+		}
+		std::string directory = path.substr(0, path.find_last_of('/'));
+		std::istringstream lines(source);
+		std::string result;
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			size_t start = line.find_first_not_of(" \t");
+			if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+			{
+				size_t open = line.find('"');
+				size_t close = line.find('"', open + 1);
+				if (open != std::string::npos && close != std::string::npos)
+				{
+					std::string included = directory + "/" + line.substr(open + 1, close - open - 1);
+					includes.push_back(included);
+					result += resolveIncludes(included, readFile(included), includes);
+					continue;
+				}
+			}
+			result += line;
+			result += '\n';
+		}
+		return result;
+	}
+
+	static std::string readFile(const std::string& path)
+	{
+		std::ifstream shaderFile;
+		// ensure ifstream objects can throw exceptions:
+		shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		try
+		{
+			std::stringstream shaderStream;
+			shaderFile.open(path);
+			// read file's buffer contents into streams
+			shaderStream << shaderFile.rdbuf();
+			// close file handlers
+			shaderFile.close();
+			// convert stream into string
+			return shaderStream.str();
+		}
+		catch (std::ifstream::failure& e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+		}
+		return "";
+	}
+
+};
+
+// Program with a single compute stage (GL 4.3+, see GLExt::hasCompute). Shares the source loading,
+// embedding and uniform setters of Shader; not hot reloaded.
+class ComputeShader : public Shader {
+public:
+	std::string computePath;
+
+	explicit ComputeShader(const char* computePath) : computePath(computePath) {
+		std::string code = readSource(this->computePath, includes);
+		const char* cShaderCode = code.c_str();
+
+		GLuint compute = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(compute, 1, &cShaderCode, NULL);
+		glCompileShader(compute);
+		checkCompileErrors(compute, "COMPUTE");
+
+		ID = glCreateProgram();
+		glAttachShader(ID, compute);
+		glLinkProgram(ID);
+		checkCompileErrors(ID, "PROGRAM");
+		glDeleteShader(compute);
+	}
+
+	void setUint(const std::string& name, GLuint value) const
+	{
+		glUniform1ui(glGetUniformLocation(ID, name.c_str()), value);
 	}
 
+	// enough groups of groupSize invocations to cover count items
+	void dispatch(GLuint count, GLuint groupSize) const {
+		GLExt::get().dispatchCompute((count + groupSize - 1) / groupSize, 1, 1);
+	}
 };
 
 #endif
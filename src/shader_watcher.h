@@ -0,0 +1,398 @@
+#pragma once
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "shader.h"
+#include "gl_state.h"
+
+// GL_KHR_parallel_shader_compile / GL_ARB_parallel_shader_compile (not part of our 3.3 glad)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+// Watches the directories of the registered shaders with inotify and rebuilds only the programs
+// that use a changed .vert/.frag/.geom file (or a .glsl file they #include). The inotify thread only records which files changed;
+// every GL call happens in update(), which must be called on the GL thread between frames.
+// A program that fails to compile or link is thrown away and the old one stays in use.
+class ShaderWatcher {
+public:
+
+	ShaderWatcher() : running(false), parallelCompile(false), fd(-1) {}
+
+	~ShaderWatcher() {
+		stop();
+	}
+
+	void watch(Shader& shader) {
+		shaders.push_back(&shader);
+		addDirectory(directoryOf(shader.vertexPath));
+		addDirectory(directoryOf(shader.fragmentPath));
+		if (!shader.geometryPath.empty())
+		{
+			addDirectory(directoryOf(shader.geometryPath));
+		}
+		for (const std::string& include : shader.includes)
+		{
+			addDirectory(directoryOf(include));
+		}
+	}
+
+	void start() {
+#if defined(SHADER_EMBED)
+		std::cout << "SHADER_WATCHER:: shaders are embedded in this build, hot reload disabled (make DEV=1)" << std::endl;
+#elif defined(__linux__)
+		if (running)
+		{
+			return;
+		}
+		fd = inotify_init1(IN_NONBLOCK);
+		if (fd < 0)
+		{
+			std::cout << "ERROR::SHADER_WATCHER:: inotify_init failed, hot reload disabled" << std::endl;
+			return;
+		}
+		for (const std::string& dir : directories)
+		{
+			int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (wd < 0)
+			{
+				std::cout << "ERROR::SHADER_WATCHER:: cannot watch " << dir << std::endl;
+				continue;
+			}
+			watchDescriptors[wd] = dir;
+		}
+
+		enableParallelCompile();
+
+		running = true;
+		thread = std::thread(&ShaderWatcher::run, this);
+#else
+		std::cout << "SHADER_WATCHER:: hot reload is only available on linux" << std::endl;
+#endif
+	}
+
+	void stop() {
+		if (!running)
+		{
+			return;
+		}
+		running = false;
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+#ifdef __linux__
+		close(fd);
+		fd = -1;
+#endif
+		for (PendingBuild& build : pending)
+		{
+			discard(build);
+		}
+		pending.clear();
+	}
+
+	// call once per frame, before anything is drawn
+	void update() {
+		std::set<std::string> files;
+		{
+			std::lock_guard<std::mutex> lock(changedMutex);
+			files.swap(changed);
+		}
+
+		for (const std::string& file : files)
+		{
+			for (Shader* shader : shaders)
+			{
+				if (shader->usesFile(file) && !isPending(shader))
+				{
+					std::cout << "SHADER_WATCHER:: recompiling program " << shader->ID << " (" << file << ")" << std::endl;
+					PendingBuild build;
+					build.shader = shader;
+					build.program = shader->beginBuild(build.vertex, build.fragment, build.geometry);
+					pending.push_back(build);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < pending.size();)
+		{
+			if (!isComplete(pending[i].program))
+			{
+				i++;
+				continue;
+			}
+			finish(pending[i]);
+			pending.erase(pending.begin() + i);
+		}
+	}
+
+private:
+
+	struct PendingBuild {
+		Shader* shader;
+		GLuint program;
+		GLuint vertex;
+		GLuint fragment;
+		GLuint geometry;
+	};
+
+	std::vector<Shader*> shaders;
+	std::vector<std::string> directories;
+	std::map<int, std::string> watchDescriptors;
+	std::vector<PendingBuild> pending;
+
+	std::set<std::string> changed;
+	std::mutex changedMutex;
+
+	std::atomic<bool> running;
+	std::thread thread;
+	bool parallelCompile;
+	int fd;
+
+	static std::string directoryOf(const std::string& path) {
+		size_t slash = path.find_last_of('/');
+		return slash == std::string::npos ? "." : path.substr(0, slash);
+	}
+
+	void addDirectory(const std::string& dir) {
+		for (const std::string& d : directories)
+		{
+			if (d == dir)
+			{
+				return;
+			}
+		}
+		directories.push_back(dir);
+	}
+
+	static bool isShaderFile(const std::string& name) {
+		size_t dot = name.find_last_of('.');
+		if (dot == std::string::npos)
+		{
+			return false;
+		}
+		std::string ext = name.substr(dot);
+		return ext == ".vert" || ext == ".frag" || ext == ".geom" || ext == ".glsl";
+	}
+
+	void run() {
+#ifdef __linux__
+		alignas(struct inotify_event) char buffer[4096];
+		pollfd pfd = { fd, POLLIN, 0 };
+		while (running)
+		{
+			if (poll(&pfd, 1, 100) <= 0)
+			{
+				continue;
+			}
+			ssize_t length = read(fd, buffer, sizeof(buffer));
+			for (ssize_t offset = 0; offset < length;)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				offset += sizeof(inotify_event) + event->len;
+				if (event->len == 0 || !isShaderFile(event->name))
+				{
+					continue;
+				}
+				std::map<int, std::string>::const_iterator dir = watchDescriptors.find(event->wd);
+				if (dir == watchDescriptors.end())
+				{
+					continue;
+				}
+				std::lock_guard<std::mutex> lock(changedMutex);
+				changed.insert(dir->second + "/" + event->name);
+			}
+		}
+#endif
+	}
+
+	bool isPending(const Shader* shader) const {
+		for (const PendingBuild& build : pending)
+		{
+			if (build.shader == shader)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void enableParallelCompile() {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+			{
+				parallelCompile = true;
+				PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress(
+					strcmp(name, "GL_KHR_parallel_shader_compile") == 0 ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB");
+				if (maxThreads)
+				{
+					// 0xFFFFFFFF lets the driver pick how many threads to use
+					maxThreads(0xFFFFFFFF);
+				}
+				break;
+			}
+		}
+	}
+
+	bool isComplete(GLuint program) const {
+		if (!parallelCompile)
+		{
+			// without the extension the first status query simply blocks until the link is done
+			return true;
+		}
+		GLint done = GL_FALSE;
+		glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+		return done == GL_TRUE;
+	}
+
+	void finish(PendingBuild& build) {
+		bool ok = Shader::checkCompileErrors(build.vertex, "VERTEX");
+		ok = Shader::checkCompileErrors(build.fragment, "FRAGMENT") && ok;
+		if (build.geometry != 0)
+		{
+			ok = Shader::checkCompileErrors(build.geometry, "GEOMETRY") && ok;
+		}
+		ok = ok && Shader::checkCompileErrors(build.program, "PROGRAM");
+
+		if (!ok)
+		{
+			std::cout << "SHADER_WATCHER:: keeping previous program " << build.shader->ID << std::endl;
+			discard(build);
+			return;
+		}
+
+		copyUniforms(build.shader->ID, build.program);
+		copyBlockBindings(build.shader->ID, build.program);
+
+		GLuint old = build.shader->ID;
+		build.shader->ID = build.program;
+		glDeleteShader(build.vertex);
+		glDeleteShader(build.fragment);
+		glDeleteShader(build.geometry);
+		GLState::get().forgetProgram(old);
+		glDeleteProgram(old);
+
+		std::cout << "SHADER_WATCHER:: program " << old << " replaced by " << build.program << std::endl;
+	}
+
+	static void discard(PendingBuild& build) {
+		glDeleteShader(build.vertex);
+		glDeleteShader(build.fragment);
+		glDeleteShader(build.geometry);
+		glDeleteProgram(build.program);
+	}
+
+	// carries every default-block uniform of the old program over to the new one, matched by name
+	static void copyUniforms(GLuint from, GLuint to) {
+		GLint count = 0;
+		glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+		// leaves the new program bound, the state cache knows about it
+		GLState::get().useProgram(to);
+
+		for (GLint i = 0; i < count; i++)
+		{
+			char name[256];
+			GLsizei nameLength = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(from, (GLuint)i, sizeof(name), &nameLength, &size, &type, name);
+
+			GLint block = -1;
+			GLuint index = (GLuint)i;
+			glGetActiveUniformsiv(from, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block);
+			if (block != -1)
+			{
+				continue;
+			}
+
+			// arrays are reported as "name[0]", every element has its own location
+			std::string base(name, nameLength);
+			bool isArray = base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0;
+			if (isArray)
+			{
+				base.erase(base.size() - 3);
+			}
+			for (GLint element = 0; element < size; element++)
+			{
+				std::string elementName = isArray ? base + "[" + std::to_string(element) + "]" : base;
+				GLint src = glGetUniformLocation(from, elementName.c_str());
+				GLint dst = glGetUniformLocation(to, elementName.c_str());
+				if (src != -1 && dst != -1)
+				{
+					copyUniform(from, src, dst, type);
+				}
+			}
+		}
+	}
+
+	// uniform block bindings are program state too (LightBuffer::bind sets them once), matched by block name
+	static void copyBlockBindings(GLuint from, GLuint to) {
+		GLint count = 0;
+		glGetProgramiv(from, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			char name[256];
+			GLsizei nameLength = 0;
+			glGetActiveUniformBlockName(from, (GLuint)i, sizeof(name), &nameLength, name);
+			GLint binding = 0;
+			glGetActiveUniformBlockiv(from, (GLuint)i, GL_UNIFORM_BLOCK_BINDING, &binding);
+			GLuint index = glGetUniformBlockIndex(to, name);
+			if (index != GL_INVALID_INDEX)
+			{
+				glUniformBlockBinding(to, index, (GLuint)binding);
+			}
+		}
+	}
+
+	static void copyUniform(GLuint from, GLint src, GLint dst, GLenum type) {
+		GLfloat f[16];
+		GLint v[4];
+		switch (type)
+		{
+		case GL_FLOAT: glGetUniformfv(from, src, f); glUniform1fv(dst, 1, f); break;
+		case GL_FLOAT_VEC2: glGetUniformfv(from, src, f); glUniform2fv(dst, 1, f); break;
+		case GL_FLOAT_VEC3: glGetUniformfv(from, src, f); glUniform3fv(dst, 1, f); break;
+		case GL_FLOAT_VEC4: glGetUniformfv(from, src, f); glUniform4fv(dst, 1, f); break;
+		case GL_FLOAT_MAT2: glGetUniformfv(from, src, f); glUniformMatrix2fv(dst, 1, GL_FALSE, f); break;
+		case GL_FLOAT_MAT3: glGetUniformfv(from, src, f); glUniformMatrix3fv(dst, 1, GL_FALSE, f); break;
+		case GL_FLOAT_MAT4: glGetUniformfv(from, src, f); glUniformMatrix4fv(dst, 1, GL_FALSE, f); break;
+		case GL_INT_VEC2: case GL_BOOL_VEC2: glGetUniformiv(from, src, v); glUniform2iv(dst, 1, v); break;
+		case GL_INT_VEC3: case GL_BOOL_VEC3: glGetUniformiv(from, src, v); glUniform3iv(dst, 1, v); break;
+		case GL_INT_VEC4: case GL_BOOL_VEC4: glGetUniformiv(from, src, v); glUniform4iv(dst, 1, v); break;
+		case GL_UNSIGNED_INT: glGetUniformuiv(from, src, (GLuint*)v); glUniform1uiv(dst, 1, (GLuint*)v); break;
+		default:
+			// int, bool and every sampler type
+			glGetUniformiv(from, src, v);
+			glUniform1iv(dst, 1, v);
+			break;
+		}
+	}
+
+};
+
+#endif
@@ -0,0 +1,280 @@
+#pragma once
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+#include "gl_state.h"
+#include "frustum.h"
+#include "render_queue.h"
+#include "light_buffer.h"
+
+// Cascaded shadow maps of the directional light. The view out to the shadow distance is split
+// into CASCADES slices (practical split: mostly logarithmic), each covered by one layer of a
+// depth texture array. Stable fitting: a cascade is the box around the bounding sphere of its
+// slice, so its size only changes with the projection, and its center moves in whole steps of
+// MARGIN texels in light space, so the texel grid never slides under the scene (no shimmering).
+// The box is widened by MARGIN texels on each side, which keeps the sphere inside while the
+// camera moves within one step: the fit, and the light matrix, stay the same for many frames.
+// Static casters are rendered into a second array, per cascade, only when its light matrix,
+// the light or the static set changed; every frame that layer is copied into the shadow map
+// and the dynamic casters are drawn over it, and with no dynamic casters even the copy is skipped.
+class CascadedShadowMaps {
+public:
+
+	static const int CASCADES = LightBuffer::MAX_CASCADES;
+	static const int SIZE = 1024;
+	static const int MARGIN = SIZE / 8;
+	static const GLuint SHADOW_UNIT = 12;
+
+	struct Stats {
+		unsigned int staticDraws[CASCADES];     // draws of each static layer when it was last rendered
+		unsigned int dynamicDraws[CASCADES];    // draws of this frame over each cascade
+		unsigned int staticRenders = 0;         // static layers rendered this frame (cache misses)
+		float splits[CASCADES];                 // far end of each slice, view distance
+	};
+
+	// submits the casters touching frustum (the light volume of one cascade) as PASS_OPAQUE items
+	typedef std::function<void(RenderQueue& queue, const Frustum& frustum)> SubmitCasters;
+	// sets the view and projection uniforms of the caster programs to those of a cascade
+	typedef std::function<void(const glm::mat4& view, const glm::mat4& projection)> SetCamera;
+
+	CascadedShadowMaps() : shadowTexture(0), staticTexture(0), shadowDistance(60.0f), casterDistance(100.0f), staticVersion(0) {
+		for (int i = 0; i < CASCADES; i++)
+		{
+			layers[i].staticVersion = ~0u;
+			layers[i].composited = false;
+			layers[i].dynamic = false;
+			frameStats.staticDraws[i] = 0;
+			frameStats.dynamicDraws[i] = 0;
+			frameStats.splits[i] = 0.0f;
+		}
+	}
+
+	void create() {
+		shadowTexture = createArray(true);
+		staticTexture = createArray(false);
+		glGenFramebuffers(CASCADES, shadowFbos);
+		glGenFramebuffers(CASCADES, staticFbos);
+		for (int i = 0; i < CASCADES; i++)
+		{
+			attachLayer(shadowFbos[i], shadowTexture, i);
+			attachLayer(staticFbos[i], staticTexture, i);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// view distance the cascades cover; casters up to casterDistance toward the light still
+	// shadow it. Both refit every cascade.
+	void setDistances(float shadow, float caster) {
+		shadowDistance = shadow;
+		casterDistance = caster;
+	}
+
+	// the static casters changed (added, removed or moved): every static layer is rendered again
+	void invalidateStatic() {
+		staticVersion++;
+	}
+
+	// fits the cascades to the camera, brings the shadow map up to date and writes the cascades
+	// into lights; leaves the window framebuffer bound with the viewport to be restored
+	void render(const glm::mat4& view, const glm::mat4& projection, LightBuffer& lights,
+		const SubmitCasters& staticCasters, const SubmitCasters& dynamicCasters, const SetCamera& setCamera) {
+		frameStats.staticRenders = 0;
+		glm::vec3 direction = glm::normalize(lights.directionalLight().direction);
+		glm::mat4 inverseView = glm::inverse(view);
+		glm::vec3 eye = glm::vec3(inverseView[3]);
+		glm::vec3 front = -glm::vec3(inverseView[2]);
+		float tanX = 1.0f / projection[0][0];
+		float tanY = 1.0f / projection[1][1];
+		float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+
+		// rotation of light space, the same for every cascade
+		glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+		glm::mat4 inverseRotation = glm::transpose(lightRotation);
+
+		GLState& state = GLState::get();
+		state.enable(GL_DEPTH_TEST);
+		// blits and clears are clipped by the scissor
+		state.disable(GL_SCISSOR_TEST);
+		glViewport(0, 0, SIZE, SIZE);
+		state.enable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.0f, 4.0f);
+
+		glm::mat4 matrices[CASCADES];
+		glm::vec4 texelSizes(0.0f);
+		float sliceNear = nearPlane;
+		for (int i = 0; i < CASCADES; i++)
+		{
+			// practical split: 3/4 logarithmic, 1/4 uniform
+			float t = (float)(i + 1) / CASCADES;
+			float sliceFar = glm::mix(nearPlane + (shadowDistance - nearPlane) * t, nearPlane * std::pow(shadowDistance / nearPlane, t), 0.75f);
+			frameStats.splits[i] = sliceFar;
+
+			// bounding sphere of the slice, centered on the view axis: depends on the projection only
+			float k = tanX * tanX + tanY * tanY;
+			float center = 0.5f * (sliceNear + sliceFar) * (1.0f + k);
+			float radius;
+			if (center >= sliceFar)
+			{
+				center = sliceFar;
+				radius = sliceFar * std::sqrt(k);
+			}
+			else
+			{
+				radius = std::sqrt(sliceFar * sliceFar * k + (sliceFar - center) * (sliceFar - center));
+			}
+			// quantized so float noise in the inputs does not change the fit
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+			float halfExtent = radius * SIZE / (SIZE - 2 * MARGIN);
+			float texel = 2.0f * halfExtent / SIZE;
+			float step = MARGIN * texel;
+
+			// the center snapped to whole steps in light space
+			glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(eye + front * center, 1.0f));
+			lightCenter = glm::floor(lightCenter / step + 0.5f) * step;
+			glm::vec3 worldCenter = glm::vec3(inverseRotation * glm::vec4(lightCenter, 1.0f));
+			glm::mat4 lightView = glm::lookAt(worldCenter - direction * (halfExtent + casterDistance), worldCenter, up);
+			glm::mat4 lightProjection = glm::ortho(-halfExtent, halfExtent, -halfExtent, halfExtent, 0.0f, 2.0f * halfExtent + casterDistance);
+			glm::mat4 viewProjection = lightProjection * lightView;
+			Frustum frustum(viewProjection);
+
+			Layer& layer = layers[i];
+			bool staticChanged = layer.staticVersion != staticVersion || layer.viewProjection != viewProjection;
+			if (staticChanged)
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER, staticFbos[i]);
+				frameStats.staticDraws[i] = drawCasters(staticCasters, frustum, lightView, lightProjection, halfExtent, setCamera);
+				layer.viewProjection = viewProjection;
+				layer.staticVersion = staticVersion;
+				layer.composited = false;
+				frameStats.staticRenders++;
+			}
+
+			queue.begin(lightView, 2.0f * halfExtent + casterDistance);
+			dynamicCasters(queue, frustum);
+			queue.sort();
+			frameStats.dynamicDraws[i] = queue.stats().draws;
+			bool dynamic = queue.stats().draws > 0;
+			// the shadow layer already equals the static one when nothing was drawn over it since
+			if (!layer.composited || dynamic || layer.dynamic)
+			{
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFbos[i]);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowFbos[i]);
+				glBlitFramebuffer(0, 0, SIZE, SIZE, 0, 0, SIZE, SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+				layer.composited = true;
+			}
+			if (dynamic)
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER, shadowFbos[i]);
+				setCamera(lightView, lightProjection);
+				queue.execute();
+			}
+			layer.dynamic = dynamic;
+
+			// world to texture space: [-1, 1] to [0, 1] on every axis
+			glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+			matrices[i] = bias * viewProjection;
+			texelSizes[i] = texel;
+			sliceNear = sliceFar;
+		}
+
+		state.disable(GL_POLYGON_OFFSET_FILL);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		lights.setShadowCascades(matrices, CASCADES, texelSizes);
+	}
+
+	// the directional light unshadowed, nothing is rendered
+	void disable(LightBuffer& lights) const {
+		lights.setShadowCascades(NULL, 0, glm::vec4(0.0f));
+	}
+
+	void bindTexture() const {
+		GLState::get().bindTexture(SHADOW_UNIT, GL_TEXTURE_2D_ARRAY, shadowTexture);
+	}
+
+	const Stats& stats() const {
+		return frameStats;
+	}
+
+	void destroy() {
+		GLState& state = GLState::get();
+		state.forgetTexture(shadowTexture);
+		state.forgetTexture(staticTexture);
+		glDeleteFramebuffers(CASCADES, shadowFbos);
+		glDeleteFramebuffers(CASCADES, staticFbos);
+		glDeleteTextures(1, &shadowTexture);
+		glDeleteTextures(1, &staticTexture);
+	}
+
+private:
+
+	struct Layer {
+		glm::mat4 viewProjection;   // of the static layer as rendered
+		unsigned int staticVersion;
+		bool composited;            // the shadow layer holds the static layer
+		bool dynamic;               // and dynamic casters were drawn over it last frame
+	};
+
+	GLuint shadowTexture, staticTexture;
+	GLuint shadowFbos[CASCADES], staticFbos[CASCADES];
+	Layer layers[CASCADES];
+	RenderQueue queue;
+	float shadowDistance, casterDistance;
+	unsigned int staticVersion;
+	Stats frameStats;
+
+	// clears the bound layer and draws the casters into it; returns the draw count
+	unsigned int drawCasters(const SubmitCasters& casters, const Frustum& frustum, const glm::mat4& lightView, const glm::mat4& lightProjection,
+		float halfExtent, const SetCamera& setCamera) {
+		const GLfloat clearDepth = 1.0f;
+		GLState::get().depthMask(GL_TRUE);
+		glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+		queue.begin(lightView, 2.0f * halfExtent + casterDistance);
+		casters(queue, frustum);
+		queue.sort();
+		setCamera(lightView, lightProjection);
+		queue.execute();
+		return queue.stats().draws;
+	}
+
+	// the shadow map compares in hardware with bilinear filtering; the static cache is only copied
+	static GLuint createArray(bool compare) {
+		GLuint texture;
+		glGenTextures(1, &texture);
+		GLState::get().bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SIZE, SIZE, CASCADES, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		GLint filter = compare ? GL_LINEAR : GL_NEAREST;
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		if (compare)
+		{
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+		return texture;
+	}
+
+	static void attachLayer(GLuint fbo, GLuint texture, int layer) {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "ERROR::SHADOW_MAPS::FRAMEBUFFER_INCOMPLETE layer " << layer << std::endl;
+		}
+	}
+
+};
+
+#endif
@@ -0,0 +1,279 @@
+#pragma once
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+#include "triple_buffer.h"
+
+// What the window thread saw since the simulation last read it. GLFW input can only be polled
+// on the thread that made the window, so that thread fills this and hands it over every frame.
+struct InputState {
+	bool move[6];           // the keys held, indexed by Camera_Movement
+	glm::vec2 look;         // mouse offset, summed until read
+	float scroll;           // summed until read
+	float aspect;           // of the framebuffer
+	bool movingLights;      // the simulation moves the light field
+
+	InputState() : look(0.0f), scroll(0.0f), aspect(1.0f), movingLights(false) {
+		for (int i = 0; i < 6; i++)
+		{
+			move[i] = false;
+		}
+	}
+};
+
+// Everything the GL thread needs of the simulation, written once and then only read. It holds
+// the state after the last step and the one before, the GL thread draws in between them.
+struct FramePacket {
+	unsigned long long tick;                        // steps so far
+	double time;                                    // simulation clock after the last step, seconds
+	double due;                                     // when the last step is drawn unblended, Simulation clock
+	float deltaTime;                                // the fixed step
+	Camera previousCamera;
+	Camera camera;
+	std::vector<glm::mat4> instances;               // model matrices of the scene objects
+	std::vector<uint32_t> visible;                  // the objects inside the view frustum of either step
+	std::vector<glm::vec3> previousLightPositions;  // the moving lights, empty when they are off
+	std::vector<glm::vec3> lightPositions;
+
+	FramePacket() : tick(0), time(0.0), due(0.0), deltaTime(0.0f) {}
+
+	// the camera a fraction alpha of the way from the previous step to the last one
+	Camera cameraAt(float alpha) const {
+		float yaw = camera.yaw - previousCamera.yaw;
+		// yaw wraps at 360, take the short way round
+		if (yaw > 180.0f)
+		{
+			yaw -= 360.0f;
+		}
+		else if (yaw < -180.0f)
+		{
+			yaw += 360.0f;
+		}
+		Camera blended(glm::mix(previousCamera.position, camera.position, alpha), camera.worldUp,
+			previousCamera.yaw + yaw * alpha, glm::mix(previousCamera.pitch, camera.pitch, alpha));
+		blended.zoom = glm::mix(previousCamera.zoom, camera.zoom, alpha);
+		return blended;
+	}
+};
+
+// Time a thread spends per frame working and waiting (sleeping, blocked in the swap), and frames
+// where it had nothing new to do, averaged over one-second windows.
+struct ThreadTiming {
+	float workMs;
+	float waitMs;
+	unsigned int frames;    // in the last window
+	unsigned int skipped;   // simulation: packets overwritten before drawn; GL: packets drawn again
+
+	ThreadTiming() : workMs(0.0f), waitMs(0.0f), frames(0), skipped(0), sumWork(0.0), sumWait(0.0), count(0), skips(0), windowStart(-1.0) {}
+
+	// work and wait of one frame ending at now, all in seconds
+	void add(double work, double wait, bool skip, double now) {
+		if (windowStart < 0.0)
+		{
+			windowStart = now;
+		}
+		sumWork += work;
+		sumWait += wait;
+		count++;
+		skips += skip ? 1 : 0;
+		if (now - windowStart >= 1.0)
+		{
+			workMs = (float)(sumWork * 1000.0 / count);
+			waitMs = (float)(sumWait * 1000.0 / count);
+			frames = count;
+			skipped = skips;
+			sumWork = sumWait = 0.0;
+			count = skips = 0;
+			windowStart = now;
+		}
+	}
+
+private:
+
+	double sumWork, sumWait;
+	unsigned int count, skips;
+	double windowStart;
+};
+
+// Runs the simulation (input, camera, per-object state) on its own thread in fixed steps and
+// publishes a FramePacket through a TripleBuffer: the GL thread draws the newest packet and never
+// waits for a step, the simulation never waits for a swap. Real time is banked in an accumulator
+// and spent in whole steps, so the simulation advances the same at any frame rate; after a stall,
+// more than MAX_STEPS steps of debt are dropped rather than caught up (the spiral of death: steps
+// that take longer than they simulate). The GL thread draws one step behind, blending the last two
+// states by interpolation(), so motion is smooth whether it runs faster or slower than the steps.
+class Simulation {
+public:
+
+	static const int MAX_STEPS = 5;
+
+	// advances the state by deltaTime, to time; the look and scroll of the input go to the first step
+	typedef std::function<void(const InputState& input, double time, float deltaTime)> Step;
+	// writes the whole packet from the state, after the steps of one wake-up
+	typedef std::function<void(FramePacket& packet, const InputState& input)> Snapshot;
+
+	Simulation() : running(false), droppedSteps(0) {}
+
+	~Simulation() {
+		stop();
+	}
+
+	// writes the first packet on the calling thread, so one is ready, then steps rate times a second
+	void start(const Step& stepFunction, const Snapshot& snapshotFunction, float rate) {
+		step = stepFunction;
+		snapshot = snapshotFunction;
+		deltaTime = 1.0 / rate;
+		startTime = Clock::now();
+		simulated = 0.0;
+		dropped = 0.0;
+		tick = 0;
+		publish(readInput());
+		packets.acquire();
+		running = true;
+		worker = std::thread(&Simulation::run, this);
+	}
+
+	void stop() {
+		if (running)
+		{
+			running = false;
+			worker.join();
+		}
+	}
+
+	// GL thread: the held keys and aspect replace the previous ones, look and scroll add up
+	void setInput(const InputState& state) {
+		std::lock_guard<std::mutex> lock(inputMutex);
+		glm::vec2 look = input.look + state.look;
+		float scroll = input.scroll + state.scroll;
+		input = state;
+		input.look = look;
+		input.scroll = scroll;
+	}
+
+	// GL thread: switches to the newest packet; false when it is the one already drawn
+	bool acquire() {
+		return packets.acquire();
+	}
+
+	const FramePacket& packet() const {
+		return packets.front();
+	}
+
+	// GL thread: how far the present moment is from the previous state of packet to its last one
+	float interpolation(const FramePacket& packet) const {
+		double alpha = (seconds(Clock::now()) - packet.due) / packet.deltaTime + 1.0;
+		return (float)std::min(std::max(alpha, 0.0), 1.0);
+	}
+
+	// steps given up to stay real time since start()
+	unsigned long long stepsDropped() const {
+		return droppedSteps.load();
+	}
+
+	ThreadTiming timing() const {
+		std::lock_guard<std::mutex> lock(timingMutex);
+		return published;
+	}
+
+private:
+
+	typedef std::chrono::steady_clock Clock;
+
+	TripleBuffer<FramePacket> packets;
+	Step step;
+	Snapshot snapshot;
+	double deltaTime;
+	Clock::time_point startTime;
+	double simulated;               // simulation clock
+	double dropped;                 // real time not simulated, the simulation clock lags by this
+	unsigned long long tick;
+	std::thread worker;
+	std::atomic<bool> running;
+	std::atomic<unsigned long long> droppedSteps;
+
+	std::mutex inputMutex;
+	InputState input;
+
+	mutable std::mutex timingMutex;
+	ThreadTiming timingWindow;      // simulation thread only
+	ThreadTiming published;
+
+	double seconds(Clock::time_point time) const {
+		return std::chrono::duration<double>(time - startTime).count();
+	}
+
+	void run() {
+		while (running)
+		{
+			Clock::time_point now = Clock::now();
+			double accumulator = seconds(now) - dropped - simulated;
+			if (accumulator > MAX_STEPS * deltaTime)
+			{
+				double behind = accumulator - MAX_STEPS * deltaTime;
+				droppedSteps += (unsigned long long)(behind / deltaTime);
+				dropped += behind;
+				accumulator -= behind;
+			}
+			bool skipped = false;
+			if (accumulator >= deltaTime)
+			{
+				InputState input = readInput();
+				while (accumulator >= deltaTime)
+				{
+					simulated += deltaTime;
+					accumulator -= deltaTime;
+					tick++;
+					step(input, simulated, (float)deltaTime);
+					input.look = glm::vec2(0.0f);
+					input.scroll = 0.0f;
+				}
+				skipped = !publish(input);
+			}
+			Clock::time_point worked = Clock::now();
+			// wakes when the next step is due
+			std::this_thread::sleep_until(startTime + std::chrono::duration_cast<Clock::duration>(
+				std::chrono::duration<double>(dropped + simulated + deltaTime)));
+			Clock::time_point woke = Clock::now();
+
+			timingWindow.add(std::chrono::duration<double>(worked - now).count(), std::chrono::duration<double>(woke - worked).count(), skipped,
+				seconds(woke));
+			std::lock_guard<std::mutex> lock(timingMutex);
+			published = timingWindow;
+		}
+	}
+
+	InputState readInput() {
+		std::lock_guard<std::mutex> lock(inputMutex);
+		InputState state = input;
+		input.look = glm::vec2(0.0f);
+		input.scroll = 0.0f;
+		return state;
+	}
+
+	// the state into the back slot; returns false if the packet it replaced was never drawn
+	bool publish(const InputState& input) {
+		FramePacket& packet = packets.back();
+		packet.tick = tick;
+		packet.time = simulated;
+		packet.due = simulated + dropped + deltaTime;
+		packet.deltaTime = (float)deltaTime;
+		snapshot(packet, input);
+		return packets.publish();
+	}
+
+};
+
+#endif
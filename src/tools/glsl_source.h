@@ -0,0 +1,364 @@
+#pragma once
+#ifndef GLSL_SOURCE_H
+#define GLSL_SOURCE_H
+
+// GLSL preprocessing shared by the build tools (shader_embed, uniform_gen): #include resolution,
+// comment / #if 0 stripping, dead function removal and a basic sanity check.
+
+#include <cctype>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+inline bool readFile(const std::string& path, std::string& out) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	std::stringstream stream;
+	stream << file.rdbuf();
+	out = stream.str();
+	return true;
+}
+
+inline std::string directoryOf(const std::string& path) {
+	size_t slash = path.find_last_of('/');
+	return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+inline std::string normalizePath(std::string path) {
+	while (path.compare(0, 2, "./") == 0)
+	{
+		path.erase(0, 2);
+	}
+	return path;
+}
+
+inline std::string trim(const std::string& s) {
+	size_t begin = s.find_first_not_of(" \t\r");
+	if (begin == std::string::npos)
+	{
+		return "";
+	}
+	size_t end = s.find_last_not_of(" \t\r");
+	return s.substr(begin, end - begin + 1);
+}
+
+// replaces comments with a single space (keeping newlines so line numbers in errors stay close)
+inline std::string stripComments(const std::string& src) {
+	std::string out;
+	out.reserve(src.size());
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		if (src.compare(i, 2, "//") == 0)
+		{
+			while (i < src.size() && src[i] != '\n')
+			{
+				i++;
+			}
+			if (i < src.size())
+			{
+				out += '\n';
+			}
+		}
+		else if (src.compare(i, 2, "/*") == 0)
+		{
+			size_t end = src.find("*/", i + 2);
+			if (end == std::string::npos)
+			{
+				end = src.size();
+			}
+			for (size_t j = i; j < end; j++)
+			{
+				if (src[j] == '\n')
+				{
+					out += '\n';
+				}
+			}
+			out += ' ';
+			i = end + 1;
+		}
+		else
+		{
+			out += src[i];
+		}
+	}
+	return out;
+}
+
+inline bool preprocess(const std::string& path, std::set<std::string>& stack, std::string& out, std::string& error) {
+	std::string src;
+	if (!readFile(path, src))
+	{
+		error = "cannot read " + path;
+		return false;
+	}
+	if (stack.count(path))
+	{
+		error = "include cycle through " + path;
+		return false;
+	}
+	stack.insert(path);
+
+	std::istringstream lines(stripComments(src));
+	std::string line;
+	int skipDepth = 0;
+	// one entry per #if open in the kept text, true when it is the #else of an #if 0 whose
+	// #endif was already dropped with the #if
+	std::vector<bool> openConditionals;
+	while (std::getline(lines, line))
+	{
+		std::string t = trim(line);
+		if (skipDepth > 0)
+		{
+			if (t.compare(0, 3, "#if") == 0)
+			{
+				skipDepth++;
+			}
+			else if (t.compare(0, 6, "#endif") == 0)
+			{
+				skipDepth--;
+			}
+			else if (skipDepth == 1 && t.compare(0, 5, "#else") == 0)
+			{
+				// the rest of the #if 0 is kept, its #endif goes with it
+				skipDepth = 0;
+				openConditionals.push_back(true);
+			}
+			else if (skipDepth == 1 && t.compare(0, 5, "#elif") == 0)
+			{
+				// #if 0 ... #elif X is #if X from here on, the compiler evaluates it
+				skipDepth = 0;
+				openConditionals.push_back(false);
+				out += "#if" + t.substr(5);
+				out += '\n';
+			}
+			continue;
+		}
+		if (t == "#if 0")
+		{
+			skipDepth = 1;
+			continue;
+		}
+		if (t.compare(0, 3, "#if") == 0)
+		{
+			openConditionals.push_back(false);
+		}
+		else if (t.compare(0, 6, "#endif") == 0 && !openConditionals.empty())
+		{
+			bool dropped = openConditionals.back();
+			openConditionals.pop_back();
+			if (dropped)
+			{
+				continue;
+			}
+		}
+		if (t.compare(0, 8, "#include") == 0)
+		{
+			size_t open = t.find('"');
+			size_t close = t.find('"', open + 1);
+			if (open == std::string::npos || close == std::string::npos)
+			{
+				error = path + ": malformed " + t;
+				return false;
+			}
+			std::string included = directoryOf(path) + "/" + t.substr(open + 1, close - open - 1);
+			if (!preprocess(included, stack, out, error))
+			{
+				return false;
+			}
+			continue;
+		}
+		if (t.empty())
+		{
+			continue;
+		}
+		// an included file must not repeat the #version of the shader that includes it
+		if (t.compare(0, 8, "#version") == 0 && !out.empty())
+		{
+			continue;
+		}
+		out += t;
+		out += '\n';
+	}
+	stack.erase(path);
+	return true;
+}
+
+inline bool isIdentChar(char c) {
+	return std::isalnum((unsigned char)c) || c == '_';
+}
+
+inline size_t countIdentifier(const std::string& src, const std::string& name) {
+	size_t count = 0;
+	for (size_t pos = src.find(name); pos != std::string::npos; pos = src.find(name, pos + 1))
+	{
+		bool startOk = pos == 0 || !isIdentChar(src[pos - 1]);
+		bool endOk = pos + name.size() >= src.size() || !isIdentChar(src[pos + name.size()]);
+		if (startOk && endOk)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+struct FunctionSpan {
+	std::string name;
+	size_t begin;
+	size_t end;
+};
+
+// finds top level "type name(args) { ... }" definitions and "type name(args);" prototypes
+inline std::vector<FunctionSpan> findFunctions(const std::string& src) {
+	std::vector<FunctionSpan> functions;
+	int depth = 0;
+	size_t lineBegin = 0;
+	while (lineBegin < src.size())
+	{
+		size_t lineEnd = src.find('\n', lineBegin);
+		if (lineEnd == std::string::npos)
+		{
+			lineEnd = src.size();
+		}
+		std::string line = src.substr(lineBegin, lineEnd - lineBegin);
+		size_t next = lineEnd + 1;
+
+		size_t paren = line.find('(');
+		bool candidate = depth == 0 && paren != std::string::npos && line[0] != '#'
+			&& line.find('=') > paren && line.compare(0, 6, "layout") != 0;
+		size_t nameEnd = paren;
+		while (candidate && nameEnd > 0 && line[nameEnd - 1] == ' ')
+		{
+			nameEnd--;
+		}
+		size_t nameBegin = nameEnd;
+		while (candidate && nameBegin > 0 && isIdentChar(line[nameBegin - 1]))
+		{
+			nameBegin--;
+		}
+		// needs a return type in front of the name
+		candidate = candidate && nameBegin > 0 && nameBegin != nameEnd;
+
+		if (candidate)
+		{
+			FunctionSpan f;
+			f.name = line.substr(nameBegin, nameEnd - nameBegin);
+			f.begin = lineBegin;
+			if (line[line.size() - 1] == ';')
+			{
+				f.end = next;
+				functions.push_back(f);
+			}
+			else
+			{
+				// definition: runs until the matching closing brace
+				size_t open = src.find('{', lineBegin);
+				if (open != std::string::npos)
+				{
+					int d = 0;
+					size_t j = open;
+					for (; j < src.size(); j++)
+					{
+						if (src[j] == '{')
+						{
+							d++;
+						}
+						else if (src[j] == '}' && --d == 0)
+						{
+							break;
+						}
+					}
+					size_t nl = src.find('\n', j);
+					f.end = nl == std::string::npos ? src.size() : nl + 1;
+					functions.push_back(f);
+					lineBegin = f.end;
+					continue;
+				}
+			}
+		}
+
+		for (char c : line)
+		{
+			depth += c == '{' ? 1 : c == '}' ? -1 : 0;
+		}
+		lineBegin = next;
+	}
+	return functions;
+}
+
+// drops functions (and their prototypes) that nothing calls, repeating until nothing changes
+inline std::string stripDeadFunctions(std::string src) {
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		std::vector<FunctionSpan> functions = findFunctions(src);
+		for (size_t i = functions.size(); i-- > 0;)
+		{
+			const FunctionSpan& f = functions[i];
+			if (f.name == "main")
+			{
+				continue;
+			}
+			size_t uses = countIdentifier(src, f.name);
+			size_t declarations = 0;
+			for (const FunctionSpan& g : functions)
+			{
+				if (g.name == f.name)
+				{
+					declarations++;
+				}
+			}
+			// recursion is not allowed in GLSL, so any extra occurrence is a real call
+			if (uses == declarations)
+			{
+				for (size_t j = functions.size(); j-- > 0;)
+				{
+					if (functions[j].name == f.name)
+					{
+						src.erase(functions[j].begin, functions[j].end - functions[j].begin);
+					}
+				}
+				changed = true;
+				break;
+			}
+		}
+	}
+	return src;
+}
+
+inline bool validate(const std::string& path, const std::string& src, std::string& error) {
+	if (src.compare(0, 8, "#version") != 0)
+	{
+		error = path + ": #version must be the first statement";
+		return false;
+	}
+	int braces = 0;
+	int parens = 0;
+	for (char c : src)
+	{
+		braces += c == '{' ? 1 : c == '}' ? -1 : 0;
+		parens += c == '(' ? 1 : c == ')' ? -1 : 0;
+		if (braces < 0 || parens < 0)
+		{
+			break;
+		}
+	}
+	if (braces != 0 || parens != 0)
+	{
+		error = path + ": unbalanced braces or parentheses";
+		return false;
+	}
+	if (countIdentifier(src, "main") == 0)
+	{
+		error = path + ": no main()";
+		return false;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,101 @@
+// Build step that bakes the GLSL under assets/shaders into the executable.
+//
+//   shader_embed <output.h> [--dump <dir>] <shader files...>
+//
+// Every shader is preprocessed (#include "file" resolved relative to the including file,
+// comments and #if 0 blocks stripped, functions nobody calls removed), validated and written
+// into <output.h> as a constexpr table that shader.h looks up by path when SHADER_EMBED is set.
+// With --dump the preprocessed sources are also written to <dir> so an external validator
+// (glslangValidator) can check exactly what the driver will receive.
+
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glsl_source.h"
+
+static std::string identifierFor(const std::string& path) {
+	std::string id;
+	for (char c : path)
+	{
+		id += isIdentChar(c) ? c : '_';
+	}
+	return id;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3)
+	{
+		std::cerr << "usage: shader_embed <output.h> [--dump <dir>] <shader files...>" << std::endl;
+		return 1;
+	}
+	std::string output = argv[1];
+	std::string dumpDir;
+	std::vector<std::string> inputs;
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--dump" && i + 1 < argc)
+		{
+			dumpDir = argv[++i];
+		}
+		else
+		{
+			inputs.push_back(arg);
+		}
+	}
+
+	std::ostringstream header;
+	header << "// generated by tools/shader_embed.cpp from assets/shaders, do not edit\n"
+		<< "#pragma once\n\n"
+		<< "struct EmbeddedShader {\n\tconst char* path;\n\tconst char* source;\n};\n\n";
+
+	std::vector<std::string> paths;
+	size_t totalBytes = 0;
+	for (const std::string& input : inputs)
+	{
+		std::string path = normalizePath(input);
+		std::string source;
+		std::string error;
+		std::set<std::string> stack;
+		if (!preprocess(path, stack, source, error) || !validate(path, source = stripDeadFunctions(source), error))
+		{
+			std::cerr << "shader_embed: " << error << std::endl;
+			return 1;
+		}
+		if (!dumpDir.empty())
+		{
+			std::ofstream dump(dumpDir + "/" + path.substr(path.find_last_of('/') + 1), std::ios::binary);
+			dump << source;
+		}
+
+		// MSVC caps a single string literal at 16KB, so long shaders are split into adjacent literals
+		header << "constexpr const char " << identifierFor(path) << "[] =\n";
+		for (size_t offset = 0; offset < source.size(); offset += 8192)
+		{
+			header << "R\"glsl(" << source.substr(offset, 8192) << ")glsl\"\n";
+		}
+		header << ";\n\n";
+		paths.push_back(path);
+		totalBytes += source.size();
+	}
+
+	header << "constexpr EmbeddedShader EMBEDDED_SHADERS[] = {\n";
+	for (const std::string& path : paths)
+	{
+		header << "\t{ \"" << path << "\", " << identifierFor(path) << " },\n";
+	}
+	header << "};\n\nconstexpr int EMBEDDED_SHADER_COUNT = " << paths.size() << ";\n";
+
+	std::ofstream out(output, std::ios::binary);
+	if (!(out << header.str()))
+	{
+		std::cerr << "shader_embed: cannot write " << output << std::endl;
+		return 1;
+	}
+	std::cout << "shader_embed: " << paths.size() << " shaders, " << totalBytes << " bytes -> " << output << std::endl;
+	return 0;
+}
@@ -0,0 +1,430 @@
+// Build step that turns the uniforms declared in the bundled shaders into C++ structs.
+//
+//   uniform_gen <output.h> <programs.txt>
+//
+// programs.txt lists every program as "name vertex fragment [geometry]" (paths relative to the
+// manifest). For each program the stages are preprocessed like shader_embed does, the default-block
+// uniforms (structs and arrays expanded, uniform blocks skipped) are collected and a struct
+// <Name>Uniforms is emitted with one typed Uniform<T> per GLSL uniform, a name table resolved once
+// per program and apply(), which uploads every dirty field in a single pass.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glsl_source.h"
+
+struct Field {
+	std::string type;
+	std::string name;
+	int arraySize; // 0 when not an array
+};
+
+struct Program {
+	std::string name;
+	std::vector<std::string> stages;
+	std::vector<Field> uniforms;
+};
+
+static std::map<std::string, std::vector<Field> > structs;
+
+static std::vector<std::string> tokenize(const std::string& src, std::map<std::string, std::string>& defines) {
+	std::vector<std::string> tokens;
+	std::istringstream lines(src);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		if (line.compare(0, 7, "#define") == 0)
+		{
+			std::istringstream define(line.substr(7));
+			std::string name, value;
+			define >> name >> value;
+			defines[name] = value;
+			continue;
+		}
+		if (!line.empty() && line[0] == '#')
+		{
+			continue;
+		}
+		for (size_t i = 0; i < line.size();)
+		{
+			if (isIdentChar(line[i]))
+			{
+				size_t j = i;
+				while (j < line.size() && (isIdentChar(line[j]) || line[j] == '.'))
+				{
+					j++;
+				}
+				tokens.push_back(line.substr(i, j - i));
+				i = j;
+			}
+			else if (line[i] == ' ' || line[i] == '\t')
+			{
+				i++;
+			}
+			else
+			{
+				tokens.push_back(std::string(1, line[i]));
+				i++;
+			}
+		}
+	}
+	return tokens;
+}
+
+static size_t skipBraces(const std::vector<std::string>& tokens, size_t i) {
+	int depth = 0;
+	for (; i < tokens.size(); i++)
+	{
+		if (tokens[i] == "{")
+		{
+			depth++;
+		}
+		else if (tokens[i] == "}" && --depth == 0)
+		{
+			return i + 1;
+		}
+	}
+	return i;
+}
+
+static int arraySize(const std::string& token, const std::map<std::string, std::string>& defines) {
+	std::map<std::string, std::string>::const_iterator define = defines.find(token);
+	return std::atoi(define != defines.end() ? define->second.c_str() : token.c_str());
+}
+
+// reads "type name[N], name2;" starting at i, returns the index after the ';'
+static size_t parseDeclaration(const std::vector<std::string>& tokens, size_t i, const std::map<std::string, std::string>& defines, std::vector<Field>& out) {
+	static const std::set<std::string> qualifiers = { "highp", "mediump", "lowp", "const", "flat", "smooth" };
+	while (i < tokens.size() && qualifiers.count(tokens[i]))
+	{
+		i++;
+	}
+	std::string type = tokens[i++];
+	while (i < tokens.size() && tokens[i] != ";")
+	{
+		Field field;
+		field.type = type;
+		field.name = tokens[i++];
+		field.arraySize = 0;
+		if (i + 2 < tokens.size() && tokens[i] == "[")
+		{
+			field.arraySize = arraySize(tokens[i + 1], defines);
+			i += 3;
+		}
+		out.push_back(field);
+		if (tokens[i] == ",")
+		{
+			i++;
+		}
+	}
+	return i + 1;
+}
+
+static void collect(const std::string& source, std::vector<Field>& uniforms) {
+	std::map<std::string, std::string> defines;
+	std::vector<std::string> tokens = tokenize(source, defines);
+	for (size_t i = 0; i < tokens.size();)
+	{
+		const std::string& t = tokens[i];
+		if (t == "struct")
+		{
+			std::string name = tokens[i + 1];
+			std::vector<Field> members;
+			size_t j = i + 3;
+			while (j < tokens.size() && tokens[j] != "}")
+			{
+				j = parseDeclaration(tokens, j, defines, members);
+			}
+			structs[name] = members;
+			i = j + 1;
+			if (i < tokens.size() && tokens[i] == ";")
+			{
+				i++;
+			}
+		}
+		else if (t == "layout")
+		{
+			// layout(...) qualifier, the declaration follows
+			i = i + 1;
+			int depth = 0;
+			do
+			{
+				depth += tokens[i] == "(" ? 1 : tokens[i] == ")" ? -1 : 0;
+				i++;
+			} while (depth > 0 && i < tokens.size());
+		}
+		else if (t == "uniform")
+		{
+			if (i + 2 < tokens.size() && tokens[i + 2] == "{")
+			{
+				// uniform block, fed by a buffer (see light_buffer.h)
+				i = skipBraces(tokens, i + 2);
+				while (i < tokens.size() && tokens[i] != ";")
+				{
+					i++;
+				}
+				i++;
+				continue;
+			}
+			std::vector<Field> declared;
+			i = parseDeclaration(tokens, i + 1, defines, declared);
+			for (const Field& field : declared)
+			{
+				bool seen = false;
+				for (const Field& existing : uniforms)
+				{
+					seen = seen || existing.name == field.name;
+				}
+				if (!seen)
+				{
+					uniforms.push_back(field);
+				}
+			}
+		}
+		else if (t == "{")
+		{
+			// function bodies and interface blocks
+			i = skipBraces(tokens, i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+static bool isSampler(const std::string& type) {
+	return type.find("sampler") != std::string::npos;
+}
+
+static std::string cppType(const std::string& type) {
+	static const std::map<std::string, std::string> types = {
+		{ "float", "Uniform<GLfloat>" }, { "int", "Uniform<GLint>" }, { "uint", "Uniform<GLuint>" },
+		{ "bool", "Uniform<bool>" },
+		{ "vec2", "Uniform<glm::vec2>" }, { "vec3", "Uniform<glm::vec3>" }, { "vec4", "Uniform<glm::vec4>" },
+		{ "mat2", "Uniform<glm::mat2>" }, { "mat3", "Uniform<glm::mat3>" }, { "mat4", "Uniform<glm::mat4>" },
+	};
+	if (isSampler(type))
+	{
+		return "SamplerUniform";
+	}
+	std::map<std::string, std::string>::const_iterator it = types.find(type);
+	if (it != types.end())
+	{
+		return it->second;
+	}
+	if (structs.count(type))
+	{
+		return "glsl::" + type;
+	}
+	return "";
+}
+
+static std::string className(const std::string& program) {
+	std::string name = program;
+	name[0] = (char)std::toupper((unsigned char)name[0]);
+	return name + "Uniforms";
+}
+
+// walks every leaf uniform: GLSL name ("pointLights[2].position") and C++ access path
+static void leaves(const Field& field, const std::string& glslPrefix, const std::string& cppPrefix,
+	std::vector<std::pair<std::string, std::string> >& out) {
+	int count = field.arraySize > 0 ? field.arraySize : 1;
+	for (int e = 0; e < count; e++)
+	{
+		std::string index = field.arraySize > 0 ? "[" + std::to_string(e) + "]" : "";
+		std::string glsl = glslPrefix + field.name + index;
+		std::string cpp = cppPrefix + field.name + index;
+		if (structs.count(field.type))
+		{
+			for (const Field& member : structs[field.type])
+			{
+				leaves(member, glsl + ".", cpp + ".", out);
+			}
+		}
+		else
+		{
+			out.push_back(std::make_pair(glsl, cpp));
+		}
+	}
+}
+
+static void emitStruct(std::ostream& out, const std::string& name, const std::vector<Field>& members, std::set<std::string>& emitted) {
+	if (emitted.count(name))
+	{
+		return;
+	}
+	for (const Field& member : members)
+	{
+		if (structs.count(member.type))
+		{
+			emitStruct(out, member.type, structs[member.type], emitted);
+		}
+	}
+	emitted.insert(name);
+	out << "struct " << name << " {\n";
+	for (const Field& member : members)
+	{
+		out << "\t" << cppType(member.type) << " " << member.name;
+		if (member.arraySize > 0)
+		{
+			out << "[" << member.arraySize << "]";
+		}
+		out << ";\n";
+	}
+	out << "};\n\n";
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3)
+	{
+		std::cerr << "usage: uniform_gen <output.h> <programs.txt>" << std::endl;
+		return 1;
+	}
+	std::string manifest = normalizePath(argv[2]);
+	std::string manifestDir = directoryOf(manifest);
+	std::ifstream list(manifest);
+	if (!list)
+	{
+		std::cerr << "uniform_gen: cannot read " << manifest << std::endl;
+		return 1;
+	}
+
+	std::vector<Program> programs;
+	std::string line;
+	while (std::getline(list, line))
+	{
+		std::istringstream fields(line);
+		Program program;
+		if (!(fields >> program.name) || program.name[0] == '#')
+		{
+			continue;
+		}
+		std::string stage;
+		while (fields >> stage)
+		{
+			program.stages.push_back(manifestDir + "/" + stage);
+		}
+		for (const std::string& path : program.stages)
+		{
+			std::string source;
+			std::string error;
+			std::set<std::string> stack;
+			if (!preprocess(path, stack, source, error))
+			{
+				std::cerr << "uniform_gen: " << error << std::endl;
+				return 1;
+			}
+			collect(source, program.uniforms);
+		}
+		for (const Field& field : program.uniforms)
+		{
+			if (cppType(field.type).empty())
+			{
+				std::cerr << "uniform_gen: " << program.name << ": unsupported uniform type " << field.type << " " << field.name << std::endl;
+				return 1;
+			}
+		}
+		programs.push_back(program);
+	}
+
+	std::ostringstream out;
+	out << "// generated by tools/uniform_gen.cpp from assets/shaders/programs.txt, do not edit\n"
+		<< "#pragma once\n\n"
+		<< "#include <glad/glad.h>\n#include <glm/glm.hpp>\n\n"
+		<< "#include \"shader.h\"\n#include \"uniforms.h\"\n\n";
+
+	// GLSL structs live in their own namespace so they never clash with the C++ mirrors of
+	// uniform block structs (light_buffer.h)
+	out << "namespace glsl {\n\n";
+	std::set<std::string> emitted;
+	for (const Program& program : programs)
+	{
+		for (const Field& field : program.uniforms)
+		{
+			if (structs.count(field.type))
+			{
+				emitStruct(out, field.type, structs[field.type], emitted);
+			}
+		}
+	}
+	out << "}\n\n";
+
+	for (const Program& program : programs)
+	{
+		std::vector<std::pair<std::string, std::string> > all;
+		for (const Field& field : program.uniforms)
+		{
+			leaves(field, "", "", all);
+		}
+
+		std::string name = className(program.name);
+		out << "// " << program.name << ":";
+		for (const std::string& stage : program.stages)
+		{
+			out << " " << stage.substr(stage.find_last_of('/') + 1);
+		}
+		out << "\nstruct " << name << " {\n";
+		for (const Field& field : program.uniforms)
+		{
+			out << "\t" << cppType(field.type) << " " << field.name;
+			if (field.arraySize > 0)
+			{
+				out << "[" << field.arraySize << "]";
+			}
+			out << ";\n";
+		}
+		out << "\n\tGLuint program = 0;\n\n";
+
+		out << "\t// looks every location up once; called again automatically when the program is rebuilt\n"
+			<< "\tvoid bind(GLuint id) {\n"
+			<< "\t\tstatic const char* const names[] = {\n";
+		for (size_t i = 0; i < all.size(); i++)
+		{
+			out << "\t\t\t\"" << all[i].first << "\",\n";
+		}
+		out << "\t\t};\n\t\tGLint* locations[] = {\n";
+		for (size_t i = 0; i < all.size(); i++)
+		{
+			out << "\t\t\t&" << all[i].second << ".location,\n";
+		}
+		out << "\t\t};\n"
+			<< "\t\tresolveUniformLocations(id, names, locations, " << all.size() << ");\n";
+		for (size_t i = 0; i < all.size(); i++)
+		{
+			out << "\t\t" << all[i].second << ".invalidate();\n";
+		}
+		out << "\t\tprogram = id;\n\t}\n\n";
+
+		out << "\t// uploads every field that changed since the last call; the shader must be in use\n"
+			<< "\tvoid apply(const Shader& shader) {\n"
+			<< "\t\tif (program != shader.ID)\n\t\t{\n\t\t\tbind(shader.ID);\n\t\t}\n";
+		for (size_t i = 0; i < all.size(); i++)
+		{
+			out << "\t\t" << all[i].second << ".upload();\n";
+		}
+		out << "\t}\n};\n\n";
+	}
+
+	// an unchanged header keeps its timestamp, so the Visual Studio pre-build does not recompile main.cpp every time
+	std::string previous;
+	if (readFile(argv[1], previous) && previous == out.str())
+	{
+		std::cout << "uniform_gen: " << argv[1] << " is up to date" << std::endl;
+		return 0;
+	}
+	std::ofstream file(argv[1], std::ios::binary);
+	if (!(file << out.str()))
+	{
+		std::cerr << "uniform_gen: cannot write " << argv[1] << std::endl;
+		return 1;
+	}
+	std::cout << "uniform_gen: " << programs.size() << " programs -> " << argv[1] << std::endl;
+	return 0;
+}
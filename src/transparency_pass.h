@@ -0,0 +1,433 @@
+#pragma once
+#ifndef TRANSPARENCY_PASS_H
+#define TRANSPARENCY_PASS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "shader.h"
+#include "render_queue.h"
+#include "frustum.h"
+#include "parallel.h"
+#include "gl_state.h"
+
+// Back-to-front blended geometry in bulk (windows, glass, foliage cards). Each item is a kind (a
+// VAO + material, registered once) and a model matrix. sort() builds one 32-bit key per item in a
+// single SIMD pass over the item centers, far to near depth in the top 24 bits and the kind in
+// the low 8 so equal depths group by kind, and radix sorts them. execute() copies the models into
+// one instance buffer in that order and draws every run of consecutive items of the same kind
+// with one instanced draw. Everything is linear in the item count. The shader reads the model
+// matrix at attributes 3-6 (instance_vertex.vert).
+// Order-independent blending (WeightedBlendedOIT) needs no depth order: sortByKind() only groups
+// the items by kind with a counting sort, and draw() leaves the blend state to the caller.
+// Large sets are recorded in parallel (the submit taking a frustum), see there.
+class TransparencyPass {
+public:
+
+	static const uint32_t MAX_KINDS = 256;
+	static const size_t CHUNK_SIZE = 8192;
+
+	struct Stats {
+		unsigned int items = 0;
+		unsigned int batches = 0;
+		double sortMs = 0.0;
+		unsigned int culled = 0;        // by the parallel submits
+		double recordMs = 0.0;          // in the parallel submits
+	};
+
+	TransparencyPass() : instanceBuffer(0), capacity(0), modelProgram(0), modelLocation(-1), modelDeletions(0) {}
+
+	// a kind of transparent geometry; its VAO gets the instance matrix attributes 3-6. Returns
+	// MAX_KINDS when the kinds no longer fit the 8 bits of the sort key, submits of it are ignored
+	uint32_t addKind(GLuint vao, DrawMaterial material, GLenum mode, GLsizei count, bool indexed) {
+		if (kinds.size() >= MAX_KINDS)
+		{
+			std::cout << "ERROR::TRANSPARENCY_PASS:: more than " << MAX_KINDS << " kinds" << std::endl;
+			return MAX_KINDS;
+		}
+		if (material.specular == 0)
+		{
+			material.specular = material.diffuse;
+		}
+		Kind kind = { vao, material, mode, count, indexed };
+		kinds.push_back(kind);
+
+		GLState& state = GLState::get();
+		state.bindVertexArray(vao);
+		for (int i = 0; i < 4; i++)
+		{
+			glEnableVertexAttribArray(3 + i);
+			glVertexAttribDivisor(3 + i, 1);
+		}
+		state.bindVertexArray(0);
+		return (uint32_t)(kinds.size() - 1);
+	}
+
+	// the view is used for the depth keys
+	void begin(const glm::mat4& view, float farPlane) {
+		this->view = view;
+		this->farPlane = farPlane;
+		models.clear();
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		itemKinds.clear();
+		recordCulled = 0;
+		recordMs = 0.0;
+	}
+
+	// depth is taken at the origin of the model (its translation)
+	void submit(uint32_t kind, const glm::mat4& model) {
+		if (kind >= kinds.size())
+		{
+			return;
+		}
+		models.push_back(model);
+		centerX.push_back(model[3].x);
+		centerY.push_back(model[3].y);
+		centerZ.push_back(model[3].z);
+		itemKinds.push_back(kind);
+	}
+
+	void submit(uint32_t kind, const glm::mat4* models, size_t count) {
+		for (size_t i = 0; i < count; i++)
+		{
+			submit(kind, models[i]);
+		}
+	}
+
+	// Culls and records many items of one kind on the ThreadPool: each chunk of CHUNK_SIZE models lists
+	// the ones whose bounds (moved by the model, which must not scale) touch frustum in a list of its
+	// own, kept between frames so recording stops allocating once the lists have grown. The lists
+	// are then appended in chunk order, also in parallel, so the items are the same as submitting
+	// the visible models one by one, whichever thread ran which chunk.
+	void submit(uint32_t kind, const glm::mat4* source, size_t count, const Frustum& frustum, const Bounds& bounds) {
+		if (kind >= kinds.size())
+		{
+			return;
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		ThreadPool& pool = ThreadPool::get();
+		size_t chunks = ThreadPool::chunkCount(count, CHUNK_SIZE);
+		if (chunkLists.size() < chunks)
+		{
+			chunkLists.resize(chunks);
+		}
+		pool.parallelFor(count, CHUNK_SIZE, [&](size_t chunk, size_t begin, size_t end) {
+			std::vector<uint32_t>& list = chunkLists[chunk];
+			list.clear();
+			for (size_t i = begin; i < end; i++)
+			{
+				if (frustum.containsSphere(glm::vec3(source[i] * glm::vec4(bounds.center, 1.0f)), bounds.radius))
+				{
+					list.push_back((uint32_t)i);
+				}
+			}
+		});
+
+		// where the items of each chunk start
+		chunkOffsets.resize(chunks);
+		size_t total = models.size();
+		for (size_t c = 0; c < chunks; c++)
+		{
+			chunkOffsets[c] = total;
+			total += chunkLists[c].size();
+		}
+		recordCulled += (unsigned int)(count - (total - models.size()));
+		models.resize(total);
+		centerX.resize(total);
+		centerY.resize(total);
+		centerZ.resize(total);
+		itemKinds.resize(total);
+		pool.parallelFor(chunks, 1, [&](size_t chunk, size_t, size_t) {
+			size_t out = chunkOffsets[chunk];
+			for (uint32_t i : chunkLists[chunk])
+			{
+				const glm::mat4& model = source[i];
+				models[out] = model;
+				centerX[out] = model[3].x;
+				centerY[out] = model[3].y;
+				centerZ[out] = model[3].z;
+				itemKinds[out] = kind;
+				out++;
+			}
+		});
+		recordMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void sort() {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t n = models.size();
+		keys.resize(n);
+		order.resize(n);
+		ThreadPool::get().parallelFor(n, CHUNK_SIZE, [&](size_t, size_t begin, size_t end) {
+			buildKeys(begin, end);
+			for (size_t i = begin; i < end; i++)
+			{
+				order[i] = (uint32_t)i;
+			}
+		});
+		radixSort(keys, order, scratchKeys, scratchOrder);
+		frameStats = Stats();
+		frameStats.items = (unsigned int)n;
+		frameStats.sortMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		frameStats.culled = recordCulled;
+		frameStats.recordMs = recordMs;
+	}
+
+	// one batch per kind in submission order, no depth keys
+	void sortByKind() {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t n = models.size();
+		order.resize(n);
+		uint32_t offsets[MAX_KINDS];
+		memset(offsets, 0, sizeof(offsets));
+		for (size_t i = 0; i < n; i++)
+		{
+			offsets[itemKinds[i]]++;
+		}
+		uint32_t sum = 0;
+		for (uint32_t k = 0; k < MAX_KINDS; k++)
+		{
+			uint32_t count = offsets[k];
+			offsets[k] = sum;
+			sum += count;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			order[offsets[itemKinds[i]]++] = (uint32_t)i;
+		}
+		frameStats = Stats();
+		frameStats.items = (unsigned int)n;
+		frameStats.sortMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		frameStats.culled = recordCulled;
+		frameStats.recordMs = recordMs;
+	}
+
+	// draws the sorted items blended over what is already on screen; shader uniforms must be set
+	void execute(const Shader& shader) {
+		GLState& state = GLState::get();
+		state.enable(GL_BLEND);
+		state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		state.depthFunc(GL_LESS);
+		state.depthMask(GL_FALSE);
+		draw(shader);
+		state.depthMask(GL_TRUE);
+	}
+
+	// the items in the order of the last sort with the current blend and depth state
+	void draw(const Shader& shader) {
+		size_t n = order.size();
+		if (n == 0)
+		{
+			return;
+		}
+		GLState& state = GLState::get();
+		state.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer == 0 ? createBuffer() : instanceBuffer);
+		if (n > capacity)
+		{
+			capacity = std::max(n, capacity * 2);
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+		}
+		glm::mat4* out = (glm::mat4*)glMapBufferRange(GL_ARRAY_BUFFER, 0, n * sizeof(glm::mat4), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (out == NULL)
+		{
+			return;
+		}
+		ThreadPool::get().parallelFor(n, CHUNK_SIZE, [&](size_t, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				out[i] = models[order[i]];
+			}
+		});
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+
+		state.useProgram(shader.ID);
+		// a reload can hand the same name to a new program, GLState counts those deletions
+		if (modelProgram != shader.ID || modelDeletions != state.programDeletions())
+		{
+			modelLocation = glGetUniformLocation(shader.ID, "model");
+			modelProgram = shader.ID;
+			modelDeletions = state.programDeletions();
+		}
+		if (modelLocation >= 0)
+		{
+			glm::mat4 identity(1.0f);
+			glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &identity[0][0]);
+		}
+		size_t first = 0;
+		while (first < n)
+		{
+			uint32_t kind = itemKinds[order[first]];
+			size_t last = first + 1;
+			while (last < n && itemKinds[order[last]] == kind)
+			{
+				last++;
+			}
+			drawBatch(kinds[kind], first, (GLsizei)(last - first));
+			frameStats.batches++;
+			first = last;
+		}
+	}
+
+	const Stats& stats() const {
+		return frameStats;
+	}
+
+	void destroy() {
+		GLState::get().forgetBuffer(instanceBuffer);
+		glDeleteBuffers(1, &instanceBuffer);
+		instanceBuffer = 0;
+		capacity = 0;
+	}
+
+private:
+
+	struct Kind {
+		GLuint vao;
+		DrawMaterial material;
+		GLenum mode;
+		GLsizei count;
+		bool indexed;
+	};
+
+	std::vector<Kind> kinds;
+	std::vector<glm::mat4> models;
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<uint32_t> itemKinds;
+	std::vector<uint32_t> keys, order, scratchKeys, scratchOrder;
+	std::vector<std::vector<uint32_t>> chunkLists;  // visible models of each chunk of a parallel submit
+	std::vector<size_t> chunkOffsets;
+	unsigned int recordCulled = 0;
+	double recordMs = 0.0;
+	glm::mat4 view = glm::mat4(1.0f);
+	float farPlane = 100.0f;
+	GLuint instanceBuffer;
+	size_t capacity;
+	GLuint modelProgram;    // the program modelLocation belongs to
+	GLint modelLocation;
+	unsigned int modelDeletions;
+	Stats frameStats;
+
+	GLuint createBuffer() {
+		glGenBuffers(1, &instanceBuffer);
+		return instanceBuffer;
+	}
+
+	// attributes 3-6 re-pointed at the batch's first matrix: GL 3.3 has no baseInstance
+	void drawBatch(const Kind& kind, size_t first, GLsizei count) {
+		GLState& state = GLState::get();
+		GLenum target = kind.material.target != 0 ? kind.material.target : GL_TEXTURE_2D;
+		state.bindTexture(0, target, kind.material.diffuse);
+		state.bindTexture(1, target, kind.material.specular);
+		state.bindVertexArray(kind.vao);
+		state.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		for (int i = 0; i < 4; i++)
+		{
+			glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(first * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+		}
+		if (kind.indexed)
+		{
+			glDrawElementsInstanced(kind.mode, kind.count, GL_UNSIGNED_INT, 0, count);
+		}
+		else
+		{
+			glDrawArraysInstanced(kind.mode, 0, kind.count, count);
+		}
+	}
+
+	// key = (0xFFFFFF - view depth / far * 0xFFFFFF) << 8 | kind, so ascending keys go far to near;
+	// the items [begin, end)
+	void buildKeys(size_t begin, size_t end) {
+		// view space z of a point is the third row of the view matrix
+		float rowX = view[0][2], rowY = view[1][2], rowZ = view[2][2], rowW = view[3][2];
+		float scale = (float)0xFFFFFF / farPlane;
+		size_t i = begin;
+#if defined(FRUSTUM_AVX) || defined(FRUSTUM_SSE)
+		__m128 rx = _mm_set1_ps(rowX), ry = _mm_set1_ps(rowY), rz = _mm_set1_ps(rowZ), rw = _mm_set1_ps(rowW);
+		__m128 toKey = _mm_set1_ps(-scale); // depth = -z
+		__m128 zero = _mm_setzero_ps(), top = _mm_set1_ps((float)0xFFFFFF);
+		__m128i farthest = _mm_set1_epi32(0xFFFFFF);
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, _mm_loadu_ps(&centerX[i])), _mm_mul_ps(ry, _mm_loadu_ps(&centerY[i]))),
+				_mm_add_ps(_mm_mul_ps(rz, _mm_loadu_ps(&centerZ[i])), rw));
+			__m128 depth = _mm_min_ps(_mm_max_ps(_mm_mul_ps(z, toKey), zero), top);
+			__m128i key = _mm_slli_epi32(_mm_sub_epi32(farthest, _mm_cvttps_epi32(depth)), 8);
+			key = _mm_or_si128(key, _mm_loadu_si128((const __m128i*)&itemKinds[i]));
+			_mm_storeu_si128((__m128i*)&keys[i], key);
+		}
+#endif
+		for (; i < end; i++)
+		{
+			float z = rowX * centerX[i] + rowY * centerY[i] + rowZ * centerZ[i] + rowW;
+			uint32_t depth = (uint32_t)std::min(std::max(-z * scale, 0.0f), (float)0xFFFFFF);
+			keys[i] = ((0xFFFFFF - depth) << 8) | itemKinds[i];
+		}
+	}
+
+	// LSD radix sort of the keys and their item indices, 8 bits per pass, bytes equal in every key skipped
+	static void radixSort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, std::vector<uint32_t>& scratchKeys, std::vector<uint32_t>& scratchValues) {
+		size_t n = keys.size();
+		if (n < 2)
+		{
+			return;
+		}
+		uint32_t histograms[4][256];
+		memset(histograms, 0, sizeof(histograms));
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t key = keys[i];
+			histograms[0][key & 0xFF]++;
+			histograms[1][(key >> 8) & 0xFF]++;
+			histograms[2][(key >> 16) & 0xFF]++;
+			histograms[3][key >> 24]++;
+		}
+
+		scratchKeys.resize(n);
+		scratchValues.resize(n);
+		std::vector<uint32_t>* srcKeys = &keys;
+		std::vector<uint32_t>* srcValues = &values;
+		std::vector<uint32_t>* dstKeys = &scratchKeys;
+		std::vector<uint32_t>* dstValues = &scratchValues;
+		for (int b = 0; b < 4; b++)
+		{
+			uint32_t* histogram = histograms[b];
+			int shift = b * 8;
+			if (histogram[((*srcKeys)[0] >> shift) & 0xFF] == n)
+			{
+				continue;
+			}
+			uint32_t offsets[256];
+			uint32_t sum = 0;
+			for (int i = 0; i < 256; i++)
+			{
+				offsets[i] = sum;
+				sum += histogram[i];
+			}
+			for (size_t i = 0; i < n; i++)
+			{
+				uint32_t slot = offsets[((*srcKeys)[i] >> shift) & 0xFF]++;
+				(*dstKeys)[slot] = (*srcKeys)[i];
+				(*dstValues)[slot] = (*srcValues)[i];
+			}
+			std::swap(srcKeys, dstKeys);
+			std::swap(srcValues, dstValues);
+		}
+		if (srcKeys != &keys)
+		{
+			keys.swap(scratchKeys);
+			values.swap(scratchValues);
+		}
+	}
+
+};
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Hands the latest value from one producer thread to one consumer thread without either waiting.
+// Three slots: the producer fills its back slot and swaps it with the middle one, the consumer
+// swaps its front slot with the middle one when a newer value is there. The consumer always gets
+// the newest value published; values it had no time for are overwritten, never queued. Slots
+// are reused, so a T holding vectors stops allocating once they reach their size.
+template <typename T>
+class TripleBuffer {
+public:
+
+	TripleBuffer() : middle(1), backIndex(2), frontIndex(0) {}
+
+	// producer side: the slot being written, only the producer touches it until publish()
+	T& back() {
+		return slots[backIndex];
+	}
+
+	// makes back() the newest value; returns false if the one it replaces was never acquired
+	bool publish() {
+		unsigned int previous = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+		backIndex = previous & INDEX;
+		return (previous & FRESH) == 0;
+	}
+
+	// consumer side: moves to the newest value if one was published since the last call
+	bool acquire() {
+		if ((middle.load(std::memory_order_acquire) & FRESH) == 0)
+		{
+			return false;
+		}
+		unsigned int previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+		frontIndex = previous & INDEX;
+		return true;
+	}
+
+	// the value acquired last, stays valid until the next acquire()
+	const T& front() const {
+		return slots[frontIndex];
+	}
+
+private:
+
+	static const unsigned int INDEX = 3;
+	static const unsigned int FRESH = 4;
+
+	T slots[3];
+	std::atomic<unsigned int> middle;   // slot index, plus FRESH while not yet acquired
+	unsigned int backIndex;             // producer only
+	unsigned int frontIndex;            // consumer only
+
+};
+
+#endif
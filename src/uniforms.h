@@ -0,0 +1,73 @@
+#pragma once
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Building blocks of the structs that tools/uniform_gen.cpp generates from the shaders
+// (generated/shader_uniforms.h). A Uniform<T> only accepts values of its GLSL type and remembers
+// whether it changed since the last upload; the location is resolved once per program.
+template <typename T>
+class Uniform {
+public:
+	GLint location;
+	bool dirty;
+
+	Uniform() : location(-1), dirty(false), assigned(false), value() {}
+
+	Uniform& operator=(const T& v) {
+		if (!assigned || !(value == v))
+		{
+			value = v;
+			dirty = true;
+			assigned = true;
+		}
+		return *this;
+	}
+
+	// the program changed (first bind or hot reload): everything we ever set has to be sent again
+	void invalidate() {
+		dirty = assigned;
+	}
+
+	const T& get() const {
+		return value;
+	}
+
+	void upload() {
+		if (dirty)
+		{
+			uploadUniform(location, value);
+			dirty = false;
+		}
+	}
+
+private:
+	bool assigned;
+	T value;
+
+	static void uploadUniform(GLint location, GLfloat v) { glUniform1f(location, v); }
+	static void uploadUniform(GLint location, GLint v) { glUniform1i(location, v); }
+	static void uploadUniform(GLint location, GLuint v) { glUniform1ui(location, v); }
+	static void uploadUniform(GLint location, bool v) { glUniform1i(location, (int)v); }
+	static void uploadUniform(GLint location, const glm::vec2& v) { glUniform2fv(location, 1, &v[0]); }
+	static void uploadUniform(GLint location, const glm::vec3& v) { glUniform3fv(location, 1, &v[0]); }
+	static void uploadUniform(GLint location, const glm::vec4& v) { glUniform4fv(location, 1, &v[0]); }
+	static void uploadUniform(GLint location, const glm::mat2& m) { glUniformMatrix2fv(location, 1, GL_FALSE, &m[0][0]); }
+	static void uploadUniform(GLint location, const glm::mat3& m) { glUniformMatrix3fv(location, 1, GL_FALSE, &m[0][0]); }
+	static void uploadUniform(GLint location, const glm::mat4& m) { glUniformMatrix4fv(location, 1, GL_FALSE, &m[0][0]); }
+};
+
+// sampler uniforms hold the texture unit they read from
+typedef Uniform<GLint> SamplerUniform;
+
+// resolves a generated location table against a program
+inline void resolveUniformLocations(GLuint program, const char* const names[], GLint* locations[], int count) {
+	for (int i = 0; i < count; i++)
+	{
+		*locations[i] = glGetUniformLocation(program, names[i]);
+	}
+}
+
+#endif